@@ -141,6 +141,40 @@ oscore_cryptoerr_t oscore_crypto_aead_encrypt_inplace(
     return err;
 }
 
+oscore_cryptoerr_t oscore_crypto_aead_encrypt_outofplace(
+        oscore_crypto_aead_encryptstate_t *state,
+        const uint8_t *plaintext,
+        uint8_t *buffer,
+        size_t buffer_len
+        )
+{
+    size_t message_len = buffer_len - oscore_crypto_aead_get_taglength(state->alg);
+    size_t modified_buffer_len = buffer_len;
+
+    oscore_cryptoerr_t err = cose_crypto_aead_encrypt(
+            // ciphertext
+            buffer, &modified_buffer_len,
+            // message
+            plaintext, message_len,
+            // aad
+            state->aad, state->aad_cursor - state->aad,
+            // nsec: No secret nonce used with OSCORE
+            NULL,
+            // npub: public nonce
+            state->iv,
+            state->key,
+            state->alg
+            );
+
+    free(state->aad);
+
+    if (err == COSE_OK) {
+        assert(buffer_len == modified_buffer_len);
+    }
+
+    return err;
+}
+
 oscore_cryptoerr_t oscore_crypto_aead_decrypt_start(
         oscore_crypto_aead_decryptstate_t *state,
         oscore_crypto_aeadalg_t alg,
@@ -195,6 +229,38 @@ oscore_cryptoerr_t oscore_crypto_aead_decrypt_inplace(
     return err;
 }
 
+oscore_cryptoerr_t oscore_crypto_aead_decrypt_outofplace(
+        oscore_crypto_aead_encryptstate_t *state,
+        const uint8_t *buffer,
+        size_t buffer_len,
+        uint8_t *plaintext
+        )
+{
+    size_t message_len = buffer_len - oscore_crypto_aead_get_taglength(state->alg);
+    size_t modified_message_len = message_len;
+
+    oscore_cryptoerr_t err = cose_crypto_aead_decrypt(
+            // message space
+            plaintext, &modified_message_len,
+            // ciphertext
+            buffer, buffer_len,
+            // aad
+            state->aad, state->aad_cursor - state->aad,
+            // npub: public nonce
+            state->iv,
+            state->key,
+            state->alg
+            );
+
+    free(state->aad);
+
+    if (err == COSE_OK) {
+        assert(message_len == modified_message_len);
+    }
+
+    return err;
+}
+
 oscore_cryptoerr_t oscore_crypto_hkdf_from_number(oscore_crypto_hkdfalg_t *alg, int32_t number)
 {
     // Following libcose's practice to just numerically cast an int32_t to the enum
@@ -32,6 +32,9 @@ void abort(void);
 /** Copy non-overlapping memory from src to dest, returning dest */
 void *memcpy(void *dest, const void *src, size_t n);
 
+/** Copy possibly overlapping memory from src to dest, returning dest */
+void *memmove(void *dest, const void *src, size_t n);
+
 /** Compare memory areas, returning the sign of the difference between the
  * first pair of unsigned char values */
 int memcmp(const void *s1, const void *s2, size_t n);
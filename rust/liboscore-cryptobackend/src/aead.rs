@@ -241,24 +241,20 @@ pub extern "C" fn oscore_crypto_aead_encrypt_feed_aad(
     }
 }
 
-/// Workhorse of oscore_crypto_aead_encrypt_inplace that is generic and thus can access all the
-/// lengths
+/// Workhorse of oscore_crypto_aead_encrypt_inplace and oscore_crypto_aead_encrypt_outofplace that
+/// is generic and thus can access all the lengths
 ///
-/// This does duplicate some code that during monomorphization that *could* be deduplciated (esp.
-/// the (paincipher, tag) splitting, for which alg.tag_length could be used), but this way it's
-/// easier and duplicate code should be minimal, given that A::TagSize can be used right away.
-fn _encrypt_inplace<A>(state: &mut EncryptState, buffer: *mut u8, buffer_len: usize) -> CryptoErr
+/// This does duplicate some code that during monomorphization that *could* be deduplciated, but
+/// this way it's easier and duplicate code should be minimal, given that A::TagSize can be used
+/// right away.
+fn _encrypt_detached<A>(
+    state: &mut EncryptState,
+    plaincipher: &mut [u8],
+    tag: &mut [u8],
+) -> CryptoErr
 where
     A: aead::AeadMutInPlace + aead::KeyInit,
 {
-    let taglen = A::TagSize::to_usize();
-
-    let buffer = unsafe { core::slice::from_raw_parts_mut(buffer, buffer_len) };
-    let plaintextlength = match buffer.len().checked_sub(taglen) {
-        Some(x) => x,
-        None => return CryptoErr::BufferShorterThanTag,
-    };
-    let (plaincipher, tag) = buffer.split_at_mut(plaintextlength);
     log_secrets!("Encrypting plaintext {:?}", plaincipher);
 
     // The checks in GenericArray initialization should make the intermediary constant go away
@@ -285,11 +281,49 @@ where
         };
     tag.copy_from_slice(&tagdata);
 
-    log_secrets!("Encrypted ciphertext {:?}", buffer);
+    log_secrets!("Encrypted ciphertext {:?} tag {:?}", plaincipher, tag);
 
     CryptoErr::Ok
 }
 
+fn _encrypt_inplace<A>(state: &mut EncryptState, buffer: *mut u8, buffer_len: usize) -> CryptoErr
+where
+    A: aead::AeadMutInPlace + aead::KeyInit,
+{
+    let taglen = A::TagSize::to_usize();
+
+    let buffer = unsafe { core::slice::from_raw_parts_mut(buffer, buffer_len) };
+    let plaintextlength = match buffer.len().checked_sub(taglen) {
+        Some(x) => x,
+        None => return CryptoErr::BufferShorterThanTag,
+    };
+    let (plaincipher, tag) = buffer.split_at_mut(plaintextlength);
+    _encrypt_detached::<A>(state, plaincipher, tag)
+}
+
+fn _encrypt_outofplace<A>(
+    state: &mut EncryptState,
+    plaintext: *const u8,
+    buffer: *mut u8,
+    buffer_len: usize,
+) -> CryptoErr
+where
+    A: aead::AeadMutInPlace + aead::KeyInit,
+{
+    let taglen = A::TagSize::to_usize();
+
+    let buffer = unsafe { core::slice::from_raw_parts_mut(buffer, buffer_len) };
+    let plaintextlength = match buffer.len().checked_sub(taglen) {
+        Some(x) => x,
+        None => return CryptoErr::BufferShorterThanTag,
+    };
+    let plaintext = unsafe { core::slice::from_raw_parts(plaintext, plaintextlength) };
+    let (plaincipher, tag) = buffer.split_at_mut(plaintextlength);
+    // The AEAD crates only offer in-place operation, so the copy has to happen here
+    plaincipher.copy_from_slice(plaintext);
+    _encrypt_detached::<A>(state, plaincipher, tag)
+}
+
 #[no_mangle]
 pub extern "C" fn oscore_crypto_aead_encrypt_inplace(
     state: &mut EncryptState,
@@ -316,6 +350,37 @@ pub extern "C" fn oscore_crypto_aead_encrypt_inplace(
     }
 }
 
+#[no_mangle]
+pub extern "C" fn oscore_crypto_aead_encrypt_outofplace(
+    state: &mut EncryptState,
+    plaintext: *const u8,
+    buffer: *mut u8,
+    buffer_len: usize,
+) -> CryptoErr {
+    match state.alg {
+        #[cfg(feature = "chacha20poly1305")]
+        Algorithm::ChaCha20Poly1305 => {
+            _encrypt_outofplace::<AlgtypeChaCha20Poly1305>(state, plaintext, buffer, buffer_len)
+        }
+        #[cfg(feature = "aes-ccm")]
+        Algorithm::AesCcm16_64_128 => {
+            _encrypt_outofplace::<AlgtypeAesCcm16_64_128>(state, plaintext, buffer, buffer_len)
+        }
+        #[cfg(feature = "aes-ccm")]
+        Algorithm::AesCcm16_128_128 => {
+            _encrypt_outofplace::<AlgtypeAesCcm16_128_128>(state, plaintext, buffer, buffer_len)
+        }
+        #[cfg(feature = "aes-gcm")]
+        Algorithm::A128GCM => {
+            _encrypt_outofplace::<AlgtypeA128GCM>(state, plaintext, buffer, buffer_len)
+        }
+        #[cfg(feature = "aes-gcm")]
+        Algorithm::A256GCM => {
+            _encrypt_outofplace::<AlgtypeA256GCM>(state, plaintext, buffer, buffer_len)
+        }
+    }
+}
+
 #[no_mangle]
 pub extern "C" fn oscore_crypto_aead_decrypt_start(
     state: &mut MaybeUninit<DecryptState>,
@@ -353,28 +418,17 @@ pub extern "C" fn oscore_crypto_aead_decrypt_feed_aad(
     )
 }
 
-/// Workhorse of oscore_crypto_aead_decrypt_inplace that is generic and thus can access all the
-/// lengths
+/// Workhorse of oscore_crypto_aead_decrypt_inplace and oscore_crypto_aead_decrypt_outofplace that
+/// is generic and thus can access all the lengths
 ///
-/// This does duplicate some code that during monomorphization that *could* be deduplciated (esp.
-/// the (paincipher, tag) splitting, for which alg.tag_length could be used), but this way it's
-/// easier and duplicate code should be minimal, given that A::TagSize can be used right away.
-fn _decrypt_inplace<A>(state: &mut DecryptState, buffer: *mut u8, buffer_len: usize) -> CryptoErr
+/// This does duplicate some code that during monomorphization that *could* be deduplciated, but
+/// this way it's easier and duplicate code should be minimal.
+fn _decrypt_detached<A>(state: &mut DecryptState, plaincipher: &mut [u8], tag: &[u8]) -> CryptoErr
 where
     A: aead::AeadMutInPlace + aead::KeyInit,
 {
     let state = &mut state.actually_encrypt;
 
-    let taglen = state.alg.tag_length();
-
-    let buffer = unsafe { core::slice::from_raw_parts_mut(buffer, buffer_len) };
-    log_secrets!("Decrypting ciphertext {:?}", buffer);
-    let plaintextlength = match buffer.len().checked_sub(taglen) {
-        Some(x) => x,
-        None => return CryptoErr::BufferShorterThanTag,
-    };
-    let (plaincipher, tag) = buffer.split_at_mut(plaintextlength);
-
     // Suitable const propagation should eliminate this; unfortunately, GenericArray has no
     // from_raw_part
     let keylen = state.alg.key_length();
@@ -392,10 +446,6 @@ where
     // and similar but not quite like
     let tag = GenericArray::from_slice(tag);
 
-    let _aad: &[u8] = state.buffered_aad.as_ref();
-    let _nonce: &[u8] = nonce.as_ref();
-    let _key: &[u8] = key.as_ref();
-
     let mut aead = A::new(&key);
     match aead.decrypt_in_place_detached(nonce, state.buffered_aad.as_ref(), plaincipher, tag) {
         Ok(()) => {
@@ -410,6 +460,46 @@ where
     }
 }
 
+fn _decrypt_inplace<A>(state: &mut DecryptState, buffer: *mut u8, buffer_len: usize) -> CryptoErr
+where
+    A: aead::AeadMutInPlace + aead::KeyInit,
+{
+    let taglen = state.actually_encrypt.alg.tag_length();
+
+    let buffer = unsafe { core::slice::from_raw_parts_mut(buffer, buffer_len) };
+    log_secrets!("Decrypting ciphertext {:?}", buffer);
+    let plaintextlength = match buffer.len().checked_sub(taglen) {
+        Some(x) => x,
+        None => return CryptoErr::BufferShorterThanTag,
+    };
+    let (plaincipher, tag) = buffer.split_at_mut(plaintextlength);
+    _decrypt_detached::<A>(state, plaincipher, tag)
+}
+
+fn _decrypt_outofplace<A>(
+    state: &mut DecryptState,
+    buffer: *const u8,
+    buffer_len: usize,
+    plaintext: *mut u8,
+) -> CryptoErr
+where
+    A: aead::AeadMutInPlace + aead::KeyInit,
+{
+    let taglen = state.actually_encrypt.alg.tag_length();
+
+    let buffer = unsafe { core::slice::from_raw_parts(buffer, buffer_len) };
+    log_secrets!("Decrypting ciphertext {:?}", buffer);
+    let plaintextlength = match buffer.len().checked_sub(taglen) {
+        Some(x) => x,
+        None => return CryptoErr::BufferShorterThanTag,
+    };
+    let (ciphertext, tag) = buffer.split_at(plaintextlength);
+    let plaincipher = unsafe { core::slice::from_raw_parts_mut(plaintext, plaintextlength) };
+    // The AEAD crates only offer in-place operation, so the copy has to happen here
+    plaincipher.copy_from_slice(ciphertext);
+    _decrypt_detached::<A>(state, plaincipher, tag)
+}
+
 #[no_mangle]
 pub extern "C" fn oscore_crypto_aead_decrypt_inplace(
     state: &mut DecryptState,
@@ -435,3 +525,34 @@ pub extern "C" fn oscore_crypto_aead_decrypt_inplace(
         Algorithm::A256GCM => _decrypt_inplace::<AlgtypeA256GCM>(state, buffer, buffer_len),
     }
 }
+
+#[no_mangle]
+pub extern "C" fn oscore_crypto_aead_decrypt_outofplace(
+    state: &mut DecryptState,
+    buffer: *const u8,
+    buffer_len: usize,
+    plaintext: *mut u8,
+) -> CryptoErr {
+    match state.actually_encrypt.alg {
+        #[cfg(feature = "chacha20poly1305")]
+        Algorithm::ChaCha20Poly1305 => {
+            _decrypt_outofplace::<AlgtypeChaCha20Poly1305>(state, buffer, buffer_len, plaintext)
+        }
+        #[cfg(feature = "aes-ccm")]
+        Algorithm::AesCcm16_64_128 => {
+            _decrypt_outofplace::<AlgtypeAesCcm16_64_128>(state, buffer, buffer_len, plaintext)
+        }
+        #[cfg(feature = "aes-ccm")]
+        Algorithm::AesCcm16_128_128 => {
+            _decrypt_outofplace::<AlgtypeAesCcm16_128_128>(state, buffer, buffer_len, plaintext)
+        }
+        #[cfg(feature = "aes-gcm")]
+        Algorithm::A128GCM => {
+            _decrypt_outofplace::<AlgtypeA128GCM>(state, buffer, buffer_len, plaintext)
+        }
+        #[cfg(feature = "aes-gcm")]
+        Algorithm::A256GCM => {
+            _decrypt_outofplace::<AlgtypeA256GCM>(state, buffer, buffer_len, plaintext)
+        }
+    }
+}
@@ -27,6 +27,10 @@ pub use primitive::{DeriveError, PrimitiveContext, PrimitiveImmutables};
 pub enum PrepareError {
     /// The security context can not provide protection for this message
     SecurityContextUnavailable,
+    /// A key for the message could not be derived
+    Crypto,
+    /// The message's code can not be sent in this kind of message
+    Method,
 }
 
 impl PrepareError {
@@ -39,6 +43,8 @@ impl PrepareError {
             raw::oscore_prepare_result_OSCORE_PREPARE_SECCTX_UNAVAILABLE => {
                 Err(PrepareError::SecurityContextUnavailable)
             }
+            raw::oscore_prepare_result_OSCORE_PREPARE_ERROR_CRYPTO => Err(PrepareError::Crypto),
+            raw::oscore_prepare_result_OSCORE_PREPARE_ERROR_METHOD => Err(PrepareError::Method),
             _ => unreachable!(),
         }
     }
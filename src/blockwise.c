@@ -0,0 +1,142 @@
+#include <oscore/blockwise.h>
+#include <oscore_native/platform.h>
+
+/** Option number of Block2 */
+#define OPTNUM_BLOCK2 23
+
+/** Largest block number that fits into a 3-byte block option */
+#define BLOCK_NUM_MAX ((1u << 20) - 1)
+
+oscore_msgerr_protected_t oscore_block2_parse(
+        oscore_msg_protected_t *request,
+        struct oscore_block2_request *block
+        )
+{
+    bool valid = true;
+    block->num = 0;
+    block->szx = 6;
+
+    oscore_msg_protected_optiter_t iter;
+    uint16_t option_number;
+    const uint8_t *value;
+    size_t value_len;
+    oscore_msg_protected_optiter_init(request, &iter);
+    while (oscore_msg_protected_optiter_next(request, &iter, &option_number, &value, &value_len)) {
+        if (option_number != OPTNUM_BLOCK2) {
+            continue;
+        }
+        if (value_len > 3) {
+            valid = false;
+            break;
+        }
+        uint32_t numeric = 0;
+        for (size_t i = 0; i < value_len; ++i) {
+            numeric = (numeric << 8) | value[i];
+        }
+        block->num = numeric >> 4;
+        // The M bit carries no meaning in a request
+        block->szx = numeric & 0x7;
+        if (block->szx == 7) {
+            valid = false;
+        }
+        break;
+    }
+
+    oscore_msgerr_protected_t err = oscore_msg_protected_optiter_finish(request, &iter);
+    if (oscore_msgerr_protected_is_error(err)) {
+        return err;
+    }
+    return valid ? OK : INVALID_ARG_ERROR;
+}
+
+/** Encode a Block option value into @p buffer, returning its length */
+static size_t encode_blockopt(uint8_t buffer[3], uint32_t num, bool more, uint8_t szx)
+{
+    uint32_t numeric = (num << 4) | (more ? 0x8 : 0) | szx;
+    size_t len = numeric > 0xffff ? 3 : numeric > 0xff ? 2 : numeric > 0 ? 1 : 0;
+    for (size_t i = 0; i < len; ++i) {
+        buffer[i] = numeric >> (8 * (len - 1 - i));
+    }
+    return len;
+}
+
+enum oscore_block2_result oscore_block2_write(
+        oscore_msg_protected_t *msg,
+        const struct oscore_block2_source *source,
+        const struct oscore_block2_request *block
+        )
+{
+    uint32_t num = block->num;
+    uint8_t szx = block->szx;
+    assert(szx < 7);
+
+    if (num > BLOCK_NUM_MAX) {
+        return OSCORE_BLOCK2_OUT_OF_RANGE;
+    }
+    // Fits in a 32-bit size_t as num has at most 20 bits
+    size_t start = (size_t)num << (szx + 4);
+    // Block 0 of an empty representation is still served
+    if (start > source->length || (start == source->length && start != 0)) {
+        return OSCORE_BLOCK2_OUT_OF_RANGE;
+    }
+
+    uint8_t value[3];
+    struct oscore_msg_protected_option planned = {
+        .option_number = OPTNUM_BLOCK2,
+        .value = value,
+    };
+    size_t chunk;
+    while (true) {
+        size_t blocksize = (size_t)16 << szx;
+        size_t remaining = source->length - start;
+        chunk = remaining > blocksize ? blocksize : remaining;
+
+        planned.value_len = encode_blockopt(value, num, remaining > blocksize, szx);
+        size_t available;
+        oscore_msgerr_protected_t err = oscore_msg_protected_plan_payload(msg, &planned, 1, &available);
+        if (oscore_msgerr_protected_is_error(err)) {
+            return OSCORE_BLOCK2_ERROR_MESSAGE;
+        }
+        if (available >= chunk) {
+            break;
+        }
+        if (szx == 0) {
+            return OSCORE_BLOCK2_ERROR_MESSAGE;
+        }
+
+        // Going right to the size that fits may still be one step too large,
+        // as a larger block number can take another byte in the option
+        uint8_t fitting = oscore_msg_protected_largest_szx(available);
+        if (fitting >= szx) {
+            fitting = szx - 1;
+        }
+        num <<= szx - fitting;
+        szx = fitting;
+        if (num > BLOCK_NUM_MAX) {
+            return OSCORE_BLOCK2_ERROR_MESSAGE;
+        }
+    }
+
+    oscore_msgerr_protected_t err = oscore_msg_protected_append_option(msg, planned.option_number, planned.value, planned.value_len);
+    if (oscore_msgerr_protected_is_error(err)) {
+        return OSCORE_BLOCK2_ERROR_MESSAGE;
+    }
+
+    uint8_t *payload;
+    size_t payload_len;
+    err = oscore_msg_protected_map_payload(msg, &payload, &payload_len);
+    if (oscore_msgerr_protected_is_error(err) || payload_len < chunk) {
+        return OSCORE_BLOCK2_ERROR_MESSAGE;
+    }
+
+    if (chunk != 0 && !source->read(source->state, start, payload, chunk)) {
+        oscore_msg_protected_trim_payload(msg, 0);
+        return OSCORE_BLOCK2_ERROR_SOURCE;
+    }
+
+    err = oscore_msg_protected_trim_payload(msg, chunk);
+    if (oscore_msgerr_protected_is_error(err)) {
+        return OSCORE_BLOCK2_ERROR_MESSAGE;
+    }
+    return OSCORE_BLOCK2_OK;
+}
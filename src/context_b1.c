@@ -15,8 +15,11 @@ void oscore_context_b1_initialize(
     secctx->primitive.sender_sequence_number = seqno;
     // ie. that would be the next, but it's not usable yet
     secctx->high_sequence_number = seqno;
+    secctx->requested_sequence_number = seqno;
+    secctx->replay_generation = 0;
 
     secctx->echo_value_populated = 0;
+    secctx->echo_config = NULL;
 
     if (replaydata == NULL) {
         secctx->primitive.replay_window_left_edge = OSCORE_SEQNO_MAX;
@@ -33,18 +36,115 @@ void oscore_context_b1_allow_high(
         )
 {
     secctx->high_sequence_number = seqno;
+    if (secctx->requested_sequence_number < seqno) {
+        secctx->requested_sequence_number = seqno;
+    }
 }
 
 uint64_t oscore_context_b1_get_wanted(
         struct oscore_context_b1 *secctx
         )
 {
-    if (secctx->primitive.sender_sequence_number - secctx->high_sequence_number < K / 2) {
+    // The sender sequence number never exceeds the high sequence number, as
+    // oscore_context_take_seqno does not deal out anything at that limit.
+    if (secctx->high_sequence_number - secctx->primitive.sender_sequence_number < K / 2) {
         return secctx->high_sequence_number + K;
     }
     return secctx->high_sequence_number;
 }
 
+bool oscore_context_b1_reservation_begin(
+        struct oscore_context_b1 *secctx,
+        uint64_t *seqno
+        )
+{
+    if (secctx->requested_sequence_number != secctx->high_sequence_number) {
+        // A reservation is in flight already
+        return false;
+    }
+
+    uint64_t wanted = oscore_context_b1_get_wanted(secctx);
+    if (wanted == secctx->high_sequence_number) {
+        return false;
+    }
+
+    secctx->requested_sequence_number = wanted;
+    *seqno = wanted;
+    return true;
+}
+
+void oscore_context_b1_reservation_durable(
+        struct oscore_context_b1 *secctx,
+        uint64_t seqno
+        )
+{
+    oscore_context_b1_allow_high(secctx, seqno);
+}
+
+void oscore_context_b1_reservation_abandon(
+        struct oscore_context_b1 *secctx
+        )
+{
+    secctx->requested_sequence_number = secctx->high_sequence_number;
+}
+
+void oscore_context_b1_batch_init(
+        struct oscore_context_b1_batch *batch,
+        struct oscore_context_b1_reservation *entries,
+        size_t capacity
+        )
+{
+    batch->entries = entries;
+    batch->capacity = capacity;
+    batch->length = 0;
+}
+
+bool oscore_context_b1_batch_collect(
+        struct oscore_context_b1_batch *batch,
+        struct oscore_context_b1 *secctx
+        )
+{
+    if (batch->length == batch->capacity) {
+        return false;
+    }
+
+    struct oscore_context_b1_reservation *entry = &batch->entries[batch->length];
+    if (oscore_context_b1_reservation_begin(secctx, &entry->seqno)) {
+        entry->secctx = secctx;
+        batch->length += 1;
+    }
+    return true;
+}
+
+size_t oscore_context_b1_batch_get(
+        const struct oscore_context_b1_batch *batch,
+        const struct oscore_context_b1_reservation **entries
+        )
+{
+    *entries = batch->entries;
+    return batch->length;
+}
+
+void oscore_context_b1_batch_durable(
+        struct oscore_context_b1_batch *batch
+        )
+{
+    for (size_t i = 0; i < batch->length; ++i) {
+        oscore_context_b1_reservation_durable(batch->entries[i].secctx, batch->entries[i].seqno);
+    }
+    batch->length = 0;
+}
+
+void oscore_context_b1_batch_abandon(
+        struct oscore_context_b1_batch *batch
+        )
+{
+    for (size_t i = 0; i < batch->length; ++i) {
+        oscore_context_b1_reservation_abandon(batch->entries[i].secctx);
+    }
+    batch->length = 0;
+}
+
 void oscore_context_b1_replay_extract(
     struct oscore_context_b1 *secctx,
     struct oscore_context_b1_replaydata *replaydata
@@ -54,6 +154,23 @@ void oscore_context_b1_replay_extract(
     replaydata->window = secctx->primitive.replay_window;
 }
 
+uint32_t oscore_context_b1_replay_snapshot(
+    const struct oscore_context_b1 *secctx,
+    struct oscore_context_b1_replaydata *replaydata
+    )
+{
+    replaydata->left_edge = secctx->primitive.replay_window_left_edge;
+    replaydata->window = secctx->primitive.replay_window;
+    return secctx->replay_generation;
+}
+
+uint32_t oscore_context_b1_replay_generation(
+    const struct oscore_context_b1 *secctx
+    )
+{
+    return secctx->replay_generation;
+}
+
 
 void oscore_context_b1_get_echo(
         oscore_context_t *secctx,
@@ -75,6 +192,10 @@ void oscore_context_b1_get_echo(
     struct oscore_context_b1 *b1 = secctx->data;
 
     *value = b1->echo_value;
+    if (b1->echo_config != NULL) {
+        *value_length = 0;
+        return;
+    }
     if (b1->echo_value_populated != 0) {
         *value_length = b1->echo_value_populated;
         return;
@@ -93,6 +214,168 @@ void oscore_context_b1_get_echo(
     }
 }
 
+void oscore_context_b1_set_echo_config(
+        struct oscore_context_b1 *secctx,
+        const struct oscore_context_b1_echo_config *config
+        )
+{
+    secctx->echo_config = config;
+}
+
+void oscore_context_b1_clear_echo_config(
+        struct oscore_context_b1 *secctx
+        )
+{
+    secctx->echo_config = NULL;
+}
+
+/** Length of the time stamp at the start of a stateless Echo value */
+#define ECHO_TIME_BYTES 4
+
+/** Compute the tag of a stateless Echo value of the given time for the
+ * client (recipient) and ID Context of a security context.
+ *
+ * Returns false if the tag can not be computed, eg. because the Key ID is too
+ * long for the configured algorithm. */
+static bool stateless_echo_tag(
+        const struct oscore_context_b1_echo_config *config,
+        oscore_context_t *secctx,
+        uint32_t time,
+        uint8_t *tag,
+        size_t tag_length
+        )
+{
+    size_t iv_len = oscore_crypto_aead_get_ivlength(config->aeadalg);
+    assert(iv_len >= 7);
+    assert(iv_len <= OSCORE_CRYPTO_AEAD_IV_MAXLEN);
+
+    const uint8_t *kid;
+    size_t kid_len;
+    oscore_context_get_kid(secctx, OSCORE_ROLE_RECIPIENT, &kid, &kid_len);
+    if (kid_len > iv_len - 6) {
+        return false;
+    }
+
+    // Built like an OSCORE nonce, with the time in place of the Partial IV,
+    // and thus unique for every Key ID and time
+    uint8_t iv[OSCORE_CRYPTO_AEAD_IV_MAXLEN];
+    iv[0] = kid_len;
+    size_t pad1_len = iv_len - 6 - kid_len;
+    memset(&iv[1], 0, pad1_len);
+    memcpy(&iv[1 + pad1_len], kid, kid_len);
+    iv[iv_len - 5] = 0;
+    iv[iv_len - 4] = (time >> 24) & 0xff;
+    iv[iv_len - 3] = (time >> 16) & 0xff;
+    iv[iv_len - 2] = (time >> 8) & 0xff;
+    iv[iv_len - 1] = time & 0xff;
+
+    // Different ID Contexts may share a Key ID, and thus the nonce; each of
+    // them gets a key of its own.
+    const uint8_t *kidcontext = NULL;
+    size_t kidcontext_len;
+    oscore_context_get_kidcontext(secctx, &kidcontext, &kidcontext_len);
+
+    const uint8_t *key = config->key;
+    uint8_t derived_key[OSCORE_CRYPTO_AEAD_KEY_MAXLEN];
+    oscore_cryptoerr_t err;
+    if (kidcontext_len != 0) {
+        size_t key_len = oscore_crypto_aead_get_keylength(config->aeadalg);
+        err = oscore_crypto_hkdf_derive(
+                config->hkdfalg,
+                config->key, key_len,
+                kidcontext, kidcontext_len,
+                (const uint8_t *)"Echo", 4,
+                derived_key, key_len
+                );
+        if (oscore_cryptoerr_is_error(err)) {
+            return false;
+        }
+        key = derived_key;
+    }
+
+    oscore_crypto_aead_encryptstate_t enc;
+    err = oscore_crypto_aead_encrypt_start(&enc, config->aeadalg, 0, 0, iv, key);
+    if (!oscore_cryptoerr_is_error(err)) {
+        err = oscore_crypto_aead_encrypt_inplace(&enc, tag, tag_length);
+    }
+    return !oscore_cryptoerr_is_error(err);
+}
+
+/** Check whether a received Echo value was produced by @ref
+ * oscore_context_b1_build_echo with the given stateless configuration */
+static bool stateless_echo_verify(
+        const struct oscore_context_b1_echo_config *config,
+        oscore_context_t *secctx,
+        const uint8_t *value,
+        size_t value_length
+        )
+{
+    size_t tag_length = oscore_crypto_aead_get_taglength(config->aeadalg);
+    if (value_length != ECHO_TIME_BYTES + tag_length) {
+        return false;
+    }
+
+    uint32_t time = ((uint32_t)value[0] << 24) | ((uint32_t)value[1] << 16) |
+                    ((uint32_t)value[2] << 8) | value[3];
+    // Values from the future wrap around to large ages
+    uint32_t age = config->now(config->now_arg) - time;
+    if (age > config->lifetime) {
+        return false;
+    }
+
+    uint8_t expected[OSCORE_CONTEXT_B1_ECHO_MAXLEN - ECHO_TIME_BYTES];
+    if (tag_length > sizeof(expected) ||
+            !stateless_echo_tag(config, secctx, time, expected, tag_length)) {
+        return false;
+    }
+
+    uint8_t difference = 0;
+    for (size_t i = 0; i < tag_length; ++i) {
+        difference |= expected[i] ^ value[ECHO_TIME_BYTES + i];
+    }
+    return difference == 0;
+}
+
+void oscore_context_b1_build_echo(
+        oscore_context_t *secctx,
+        uint8_t value[OSCORE_CONTEXT_B1_ECHO_MAXLEN],
+        size_t *value_length
+        )
+{
+    *value_length = 0;
+
+    if (secctx->type != OSCORE_CONTEXT_B1) {
+        // FIXME introduce optional usage error callback
+        return;
+    }
+
+    struct oscore_context_b1 *b1 = secctx->data;
+    const struct oscore_context_b1_echo_config *config = b1->echo_config;
+
+    if (config == NULL) {
+        size_t length;
+        uint8_t *stateful;
+        oscore_context_b1_get_echo(secctx, &length, &stateful);
+        memcpy(value, stateful, length);
+        *value_length = length;
+        return;
+    }
+
+    size_t tag_length = oscore_crypto_aead_get_taglength(config->aeadalg);
+    if (ECHO_TIME_BYTES + tag_length > OSCORE_CONTEXT_B1_ECHO_MAXLEN) {
+        return;
+    }
+
+    uint32_t time = config->now(config->now_arg);
+    value[0] = (time >> 24) & 0xff;
+    value[1] = (time >> 16) & 0xff;
+    value[2] = (time >> 8) & 0xff;
+    value[3] = time & 0xff;
+    if (stateless_echo_tag(config, secctx, time, &value[ECHO_TIME_BYTES], tag_length)) {
+        *value_length = ECHO_TIME_BYTES + tag_length;
+    }
+}
+
 bool oscore_context_b1_process_request(
         oscore_context_t *secctx,
         oscore_msg_protected_t *request,
@@ -110,13 +393,16 @@ bool oscore_context_b1_process_request(
             b1->primitive.replay_window_left_edge != OSCORE_SEQNO_MAX)
         return false;
 
-    size_t echo_length;
-    uint8_t *echo_value;
-    oscore_context_b1_get_echo(secctx, &echo_length, &echo_value);
-    if (echo_length == 0) {
-        // Keep the lack of available sequence numbers from resulting in a
-        // request recognized as fresh
-        return true;
+    const struct oscore_context_b1_echo_config *config = b1->echo_config;
+    size_t echo_length = 0;
+    uint8_t *echo_value = NULL;
+    if (config == NULL) {
+        oscore_context_b1_get_echo(secctx, &echo_length, &echo_value);
+        if (echo_length == 0) {
+            // Keep the lack of available sequence numbers from resulting in a
+            // request recognized as fresh
+            return true;
+        }
     }
 
     bool result = true;
@@ -126,9 +412,13 @@ bool oscore_context_b1_process_request(
     size_t opt_len;
     oscore_msg_protected_optiter_init(request, &iter);
     while (oscore_msg_protected_optiter_next(request, &iter, &opt_num, &opt_val, &opt_len)) {
-        if (opt_num == 252 /* Echo */ &&
-                opt_len == echo_length &&
-                memcmp(opt_val, echo_value, echo_length) == 0) {
+        if (opt_num != 252 /* Echo */) {
+            continue;
+        }
+        bool echo_good = config != NULL ?
+                stateless_echo_verify(config, secctx, opt_val, opt_len) :
+                opt_len == echo_length && memcmp(opt_val, echo_value, echo_length) == 0;
+        if (echo_good) {
             // Matches, and replay window was previously checked to be uninitialized
             b1->primitive.replay_window_left_edge = \
                               request_id->bytes[4] + \
@@ -137,6 +427,7 @@ bool oscore_context_b1_process_request(
                               request_id->bytes[1] * ((int64_t)1 << 24) + \
                               request_id->bytes[0] * ((int64_t)1 << 32);
             b1->primitive.replay_window = 0;
+            b1->replay_generation += 1;
             request_id->is_first_use = true;
             *unprotectresult = OSCORE_UNPROTECT_REQUEST_OK;
             result = false;
@@ -168,8 +459,8 @@ bool oscore_context_b1_build_401echo(
     oscore_msg_protected_set_code(&outgoing_plaintext, 0x81 /* 4.01 Unauthorized */);
 
     size_t echo_size;
-    uint8_t *echo_value;
-    oscore_context_b1_get_echo(secctx, &echo_size, &echo_value);
+    uint8_t echo_value[OSCORE_CONTEXT_B1_ECHO_MAXLEN];
+    oscore_context_b1_build_echo(secctx, echo_value, &echo_size);
 
     oscore_msgerr_protected_t err = oscore_msg_protected_append_option(
             &outgoing_plaintext,
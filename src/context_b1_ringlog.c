@@ -0,0 +1,202 @@
+#include <oscore/context_impl/b1_ringlog.h>
+#include <oscore_native/platform.h>
+
+/* A record is the little-endian value, followed by a CRC-32 over it and four
+ * zero bytes.
+ *
+ * Slots that read as all-ones are empty; anything else is considered written
+ * (possibly partially, in which case the checksum does not match). */
+
+/* Bitwise CRC-32 (as used in Ethernet) */
+static uint32_t crc32(const uint8_t *data, size_t len)
+{
+    uint32_t crc = 0xffffffff;
+    for (size_t i = 0; i < len; ++i) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; ++bit) {
+            crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+        }
+    }
+    return ~crc;
+}
+
+static void record_encode(uint8_t record[OSCORE_CONTEXT_B1_RINGLOG_RECORD_SIZE], uint64_t value)
+{
+    for (int i = 0; i < 8; ++i) {
+        record[i] = (value >> (8 * i)) & 0xff;
+    }
+    uint32_t crc = crc32(record, 8);
+    for (int i = 0; i < 4; ++i) {
+        record[8 + i] = (crc >> (8 * i)) & 0xff;
+    }
+    memset(&record[12], 0, 4);
+}
+
+enum slot_state {
+    SLOT_EMPTY,
+    SLOT_INVALID,
+    SLOT_VALID,
+};
+
+static enum slot_state record_decode(const uint8_t record[OSCORE_CONTEXT_B1_RINGLOG_RECORD_SIZE], uint64_t *value)
+{
+    bool empty = true;
+    for (int i = 0; i < OSCORE_CONTEXT_B1_RINGLOG_RECORD_SIZE; ++i) {
+        empty &= record[i] == 0xff;
+    }
+    if (empty) {
+        return SLOT_EMPTY;
+    }
+
+    uint32_t crc = 0;
+    for (int i = 0; i < 4; ++i) {
+        crc |= (uint32_t)record[8 + i] << (8 * i);
+    }
+    if (crc != crc32(record, 8) || record[12] != 0 || record[13] != 0 ||
+            record[14] != 0 || record[15] != 0) {
+        return SLOT_INVALID;
+    }
+
+    *value = 0;
+    for (int i = 0; i < 8; ++i) {
+        *value |= (uint64_t)record[i] << (8 * i);
+    }
+    return SLOT_VALID;
+}
+
+static size_t slots_per_page(const struct oscore_context_b1_flash *flash)
+{
+    return flash->page_size / OSCORE_CONTEXT_B1_RINGLOG_RECORD_SIZE;
+}
+
+static bool read_slot(
+        const struct oscore_context_b1_flash *flash,
+        size_t page,
+        size_t slot,
+        enum slot_state *state,
+        uint64_t *value
+        )
+{
+    uint8_t record[OSCORE_CONTEXT_B1_RINGLOG_RECORD_SIZE];
+    size_t offset = page * flash->page_size + slot * OSCORE_CONTEXT_B1_RINGLOG_RECORD_SIZE;
+    if (!flash->read(flash->arg, offset, record, sizeof(record))) {
+        return false;
+    }
+    *state = record_decode(record, value);
+    return true;
+}
+
+bool oscore_context_b1_ringlog_open(
+        struct oscore_context_b1_ringlog *log,
+        const struct oscore_context_b1_flash *flash
+        )
+{
+    assert(flash->page_count >= 2);
+    assert(flash->page_size % OSCORE_CONTEXT_B1_RINGLOG_RECORD_SIZE == 0);
+    assert(flash->page_size != 0);
+
+    log->flash = flash;
+    log->has_latest = false;
+
+    size_t slots = slots_per_page(flash);
+    enum slot_state state;
+    uint64_t value;
+
+    // As values only increase, the page whose first valid record is the
+    // largest is the newest one. Typically, that is found in the very first
+    // slot; only pages that start with a torn write need more reads.
+    bool newest_found = false;
+    size_t newest_page = 0;
+    uint64_t newest_first = 0;
+    for (size_t page = 0; page < flash->page_count; ++page) {
+        for (size_t slot = 0; slot < slots; ++slot) {
+            if (!read_slot(flash, page, slot, &state, &value)) {
+                return false;
+            }
+            if (state == SLOT_EMPTY) {
+                break;
+            }
+            if (state == SLOT_VALID) {
+                if (!newest_found || value > newest_first) {
+                    newest_found = true;
+                    newest_page = page;
+                    newest_first = value;
+                }
+                break;
+            }
+        }
+    }
+
+    if (!newest_found) {
+        // Start with an erase of the first page
+        log->page = flash->page_count - 1;
+        log->slot = slots;
+        return true;
+    }
+
+    // Within the newest page, the next write goes behind the last used slot.
+    log->page = newest_page;
+    log->slot = 0;
+    for (size_t slot = 0; slot < slots; ++slot) {
+        if (!read_slot(flash, newest_page, slot, &state, &value)) {
+            return false;
+        }
+        if (state == SLOT_EMPTY) {
+            break;
+        }
+        log->slot = slot + 1;
+        if (state == SLOT_VALID && (!log->has_latest || value > log->latest)) {
+            log->has_latest = true;
+            log->latest = value;
+        }
+    }
+
+    return true;
+}
+
+bool oscore_context_b1_ringlog_latest(
+        const struct oscore_context_b1_ringlog *log,
+        uint64_t *value
+        )
+{
+    if (!log->has_latest) {
+        return false;
+    }
+    *value = log->latest;
+    return true;
+}
+
+bool oscore_context_b1_ringlog_append(
+        struct oscore_context_b1_ringlog *log,
+        uint64_t value
+        )
+{
+    const struct oscore_context_b1_flash *flash = log->flash;
+
+    if (log->has_latest && value <= log->latest) {
+        return false;
+    }
+
+    if (log->slot == slots_per_page(flash)) {
+        size_t next = (log->page + 1) % flash->page_count;
+        if (!flash->erase(flash->arg, next)) {
+            return false;
+        }
+        log->page = next;
+        log->slot = 0;
+    }
+
+    uint8_t record[OSCORE_CONTEXT_B1_RINGLOG_RECORD_SIZE];
+    record_encode(record, value);
+
+    size_t offset = log->page * flash->page_size + log->slot * OSCORE_CONTEXT_B1_RINGLOG_RECORD_SIZE;
+    // Whatever happened, that slot is not empty any more
+    log->slot += 1;
+    if (!flash->write(flash->arg, offset, record, sizeof(record))) {
+        return false;
+    }
+
+    log->latest = value;
+    log->has_latest = true;
+    return true;
+}
@@ -0,0 +1,356 @@
+#include <oscore/context_impl/b1_store.h>
+#include <oscore_native/platform.h>
+
+#define STORE_MAGIC 0x4f534231 /* "OSB1" */
+#define RECORD_MAGIC 0x52656332 /* "Rec2" */
+
+#define OSCORE_CONTEXT_B1_STORE_SEALED 1
+#define OSCORE_CONTEXT_B1_STORE_HAS_REPLAY 1
+
+/* Bitwise CRC-32 (as used in Ethernet), fed with the individual fields'
+ * values rather than their memory representation so that padding bytes do not
+ * matter. */
+static uint32_t crc_feed(uint32_t crc, uint64_t value, size_t bytes)
+{
+    for (size_t i = 0; i < bytes; ++i) {
+        crc ^= (value >> (8 * i)) & 0xff;
+        for (int bit = 0; bit < 8; ++bit) {
+            crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+        }
+    }
+    return crc;
+}
+
+static uint32_t header_checksum(const struct oscore_context_b1_store_header *header)
+{
+    uint32_t crc = 0xffffffff;
+    crc = crc_feed(crc, header->magic, 4);
+    crc = crc_feed(crc, header->flags, 4);
+    crc = crc_feed(crc, header->record_count, 4);
+    return ~crc;
+}
+
+static uint32_t record_checksum(const struct oscore_context_b1_store_record *record)
+{
+    uint32_t crc = 0xffffffff;
+    crc = crc_feed(crc, record->magic, 4);
+    crc = crc_feed(crc, record->flags, 4);
+    crc = crc_feed(crc, record->high_sequence_number, 8);
+    crc = crc_feed(crc, record->replay.left_edge, 8);
+    crc = crc_feed(crc, record->replay.window, 4);
+    crc = crc_feed(crc, record->replay_generation, 4);
+    return ~crc;
+}
+
+static void dirty_remove(struct oscore_context_b1_store *store, size_t index)
+{
+    store->dirty_count -= 1;
+    memmove(&store->dirty[index], &store->dirty[index + 1],
+            (store->dirty_count - index) * sizeof(store->dirty[0]));
+}
+
+static void mark_dirty(struct oscore_context_b1_store *store, const void *start, size_t length)
+{
+    size_t s = (const uint8_t *)start - (const uint8_t *)store->header;
+    size_t e = s + length;
+
+    while (true) {
+        // Absorb all ranges that overlap or touch the new one
+        size_t i = 0;
+        while (i < store->dirty_count) {
+            struct oscore_context_b1_store_range *r = &store->dirty[i];
+            if (r->start <= e && s <= r->end) {
+                s = r->start < s ? r->start : s;
+                e = r->end > e ? r->end : e;
+                dirty_remove(store, i);
+            } else {
+                ++i;
+            }
+        }
+
+        if (store->dirty_count < OSCORE_CONTEXT_B1_STORE_DIRTY_RANGES) {
+            break;
+        }
+
+        // Out of ranges: join the two closest ones, where the new range is
+        // one of the candidates
+        size_t best = 0;
+        size_t best_gap = SIZE_MAX;
+        bool best_with_new = false;
+        for (i = 0; i + 1 < store->dirty_count; ++i) {
+            size_t gap = store->dirty[i + 1].start - store->dirty[i].end;
+            if (gap < best_gap) {
+                best = i;
+                best_gap = gap;
+            }
+        }
+        for (i = 0; i < store->dirty_count; ++i) {
+            struct oscore_context_b1_store_range *r = &store->dirty[i];
+            size_t gap = r->end < s ? s - r->end : r->start - e;
+            if (gap < best_gap) {
+                best = i;
+                best_gap = gap;
+                best_with_new = true;
+            }
+        }
+        if (best_with_new) {
+            // The joined range may now touch others, which the next round
+            // absorbs
+            s = store->dirty[best].start < s ? store->dirty[best].start : s;
+            e = store->dirty[best].end > e ? store->dirty[best].end : e;
+            dirty_remove(store, best);
+        } else {
+            store->dirty[best].end = store->dirty[best + 1].end;
+            dirty_remove(store, best + 1);
+        }
+    }
+
+    size_t pos = 0;
+    while (pos < store->dirty_count && store->dirty[pos].start < s) {
+        ++pos;
+    }
+    memmove(&store->dirty[pos + 1], &store->dirty[pos],
+            (store->dirty_count - pos) * sizeof(store->dirty[0]));
+    store->dirty[pos].start = s;
+    store->dirty[pos].end = e;
+    store->dirty_count += 1;
+}
+
+static void header_write(struct oscore_context_b1_store *store)
+{
+    store->header->checksum = header_checksum(store->header);
+    mark_dirty(store, store->header, sizeof(*store->header));
+}
+
+static void record_write(struct oscore_context_b1_store *store, struct oscore_context_b1_store_record *record)
+{
+    record->checksum = record_checksum(record);
+    mark_dirty(store, record, sizeof(*record));
+}
+
+static bool record_is_valid(const struct oscore_context_b1_store_record *record)
+{
+    return record->magic == RECORD_MAGIC && record->checksum == record_checksum(record);
+}
+
+static struct oscore_context_b1_store_record *get_record(
+        struct oscore_context_b1_store *store,
+        size_t index
+        )
+{
+    assert(index < store->header->record_count);
+    return &store->records[index];
+}
+
+static void store_init(
+        struct oscore_context_b1_store *store,
+        void *memory
+        )
+{
+    store->header = memory;
+    store->records = (void*)((uint8_t*)memory + sizeof(struct oscore_context_b1_store_header));
+    store->dirty_count = 0;
+}
+
+/** Number of records that fit into a memory area of @p length bytes */
+static size_t records_in(size_t length)
+{
+    return (length - sizeof(struct oscore_context_b1_store_header)) / sizeof(struct oscore_context_b1_store_record);
+}
+
+enum oscore_context_b1_store_open_result oscore_context_b1_store_open(
+        struct oscore_context_b1_store *store,
+        void *memory,
+        size_t length
+        )
+{
+    assert(length >= OSCORE_CONTEXT_B1_STORE_SIZE(0));
+
+    size_t count = records_in(length);
+
+    const struct oscore_context_b1_store_header *header = memory;
+    if (header->magic == 0 && header->flags == 0 &&
+            header->record_count == 0 && header->checksum == 0) {
+        return OSCORE_CONTEXT_B1_STORE_OPEN_EMPTY;
+    }
+    if (header->magic != STORE_MAGIC ||
+            header->checksum != header_checksum(header)) {
+        return OSCORE_CONTEXT_B1_STORE_OPEN_INVALID;
+    }
+    if (header->record_count > count) {
+        return OSCORE_CONTEXT_B1_STORE_OPEN_TRUNCATED;
+    }
+
+    store_init(store, memory);
+
+    bool header_changed = false;
+    if (store->header->record_count < count) {
+        // The memory area was grown; the new records start out empty.
+        struct oscore_context_b1_store_record *added = &store->records[store->header->record_count];
+        size_t added_bytes = (count - store->header->record_count) * sizeof(struct oscore_context_b1_store_record);
+        memset(added, 0, added_bytes);
+        mark_dirty(store, added, added_bytes);
+        store->header->record_count = count;
+        header_changed = true;
+    }
+
+    store->was_sealed = (store->header->flags & OSCORE_CONTEXT_B1_STORE_SEALED) != 0;
+    if (store->was_sealed) {
+        store->header->flags &= ~OSCORE_CONTEXT_B1_STORE_SEALED;
+        header_changed = true;
+    }
+    if (header_changed) {
+        header_write(store);
+    }
+    return OSCORE_CONTEXT_B1_STORE_OPEN_OK;
+}
+
+void oscore_context_b1_store_format(
+        struct oscore_context_b1_store *store,
+        void *memory,
+        size_t length
+        )
+{
+    assert(length >= OSCORE_CONTEXT_B1_STORE_SIZE(0));
+
+    size_t count = records_in(length);
+
+    store_init(store, memory);
+    memset(memory, 0, OSCORE_CONTEXT_B1_STORE_SIZE(count));
+    store->header->magic = STORE_MAGIC;
+    store->header->flags = 0;
+    store->header->record_count = count;
+    header_write(store);
+    mark_dirty(store, store->records, count * sizeof(struct oscore_context_b1_store_record));
+    store->was_sealed = false;
+}
+
+size_t oscore_context_b1_store_capacity(
+        const struct oscore_context_b1_store *store
+        )
+{
+    return store->header->record_count;
+}
+
+bool oscore_context_b1_store_restore(
+        struct oscore_context_b1_store *store,
+        size_t index,
+        struct oscore_context_b1 *secctx,
+        const struct oscore_context_primitive_immutables *immutables
+        )
+{
+    struct oscore_context_b1_store_record *record = get_record(store, index);
+
+    if (!record_is_valid(record)) {
+        return false;
+    }
+
+    bool has_replay = (record->flags & OSCORE_CONTEXT_B1_STORE_HAS_REPLAY) != 0;
+
+    oscore_context_b1_initialize(
+            secctx,
+            immutables,
+            record->high_sequence_number,
+            has_replay && store->was_sealed ? &record->replay : NULL
+            );
+
+    if (has_replay) {
+        // Replay data is good for a single restore at most (and for none if
+        // the store was not sealed): once the context processed requests, it
+        // no longer describes it. The next checkpoint writes the window anew.
+        record->flags &= ~OSCORE_CONTEXT_B1_STORE_HAS_REPLAY;
+        record_write(store, record);
+    }
+
+    return true;
+}
+
+void oscore_context_b1_store_set_high(
+        struct oscore_context_b1_store *store,
+        size_t index,
+        uint64_t seqno
+        )
+{
+    struct oscore_context_b1_store_record *record = get_record(store, index);
+
+    if (!record_is_valid(record)) {
+        memset(record, 0, sizeof(*record));
+        record->magic = RECORD_MAGIC;
+    }
+
+    record->high_sequence_number = seqno;
+    record_write(store, record);
+}
+
+void oscore_context_b1_store_save_replay(
+        struct oscore_context_b1_store *store,
+        size_t index,
+        struct oscore_context_b1 *secctx
+        )
+{
+    struct oscore_context_b1_store_record *record = get_record(store, index);
+
+    // Without a sequence number, the record could not be restored anyway
+    assert(record_is_valid(record));
+
+    record->replay_generation = oscore_context_b1_replay_generation(secctx);
+    oscore_context_b1_replay_extract(secctx, &record->replay);
+    record->flags |= OSCORE_CONTEXT_B1_STORE_HAS_REPLAY;
+    record_write(store, record);
+}
+
+bool oscore_context_b1_store_checkpoint(
+        struct oscore_context_b1_store *store,
+        size_t index,
+        const struct oscore_context_b1 *secctx
+        )
+{
+    struct oscore_context_b1_store_record *record = get_record(store, index);
+
+    assert(record_is_valid(record));
+
+    if ((record->flags & OSCORE_CONTEXT_B1_STORE_HAS_REPLAY) != 0 &&
+            record->replay_generation == oscore_context_b1_replay_generation(secctx)) {
+        return false;
+    }
+
+    record->replay_generation = oscore_context_b1_replay_snapshot(secctx, &record->replay);
+    record->flags |= OSCORE_CONTEXT_B1_STORE_HAS_REPLAY;
+    record_write(store, record);
+    return true;
+}
+
+void oscore_context_b1_store_clear(
+        struct oscore_context_b1_store *store,
+        size_t index
+        )
+{
+    struct oscore_context_b1_store_record *record = get_record(store, index);
+
+    memset(record, 0, sizeof(*record));
+    mark_dirty(store, record, sizeof(*record));
+}
+
+void oscore_context_b1_store_seal(
+        struct oscore_context_b1_store *store
+        )
+{
+    store->header->flags |= OSCORE_CONTEXT_B1_STORE_SEALED;
+    header_write(store);
+}
+
+bool oscore_context_b1_store_take_dirty(
+        struct oscore_context_b1_store *store,
+        size_t *offset,
+        size_t *length
+        )
+{
+    if (store->dirty_count == 0) {
+        return false;
+    }
+
+    *offset = store->dirty[0].start;
+    *length = store->dirty[0].end - store->dirty[0].start;
+    dirty_remove(store, 0);
+    return true;
+}
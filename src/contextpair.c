@@ -176,6 +176,17 @@ static void advance_window(struct oscore_context_primitive *ctx, size_t n)
     }
 }
 
+/** @brief Sequence number represented by a request ID */
+static int64_t requestid_numeric(const oscore_requestid_t *request_id)
+{
+    // request_id->partial_iv is documented to always be zero-padded
+    return request_id->bytes[4] + \
+           request_id->bytes[3] * ((int64_t)1 << 8) + \
+           request_id->bytes[2] * ((int64_t)1 << 16) + \
+           request_id->bytes[1] * ((int64_t)1 << 24) + \
+           request_id->bytes[0] * ((int64_t)1 << 32);
+}
+
 void oscore_context_strikeout_requestid(
         oscore_context_t *secctx,
         oscore_requestid_t *request_id)
@@ -187,12 +198,7 @@ void oscore_context_strikeout_requestid(
     case OSCORE_CONTEXT_B1:
         {
             struct oscore_context_primitive *primitive = find_primitive(secctx);
-            // request_id->partial_iv is documented to always be zero-padded
-            int64_t numeric = request_id->bytes[4] + \
-                              request_id->bytes[3] * ((int64_t)1 << 8) + \
-                              request_id->bytes[2] * ((int64_t)1 << 16) + \
-                              request_id->bytes[1] * ((int64_t)1 << 24) + \
-                              request_id->bytes[0] * ((int64_t)1 << 32);
+            int64_t numeric = requestid_numeric(request_id);
 
             // We can keep comparing here as all is signed and the possible
             // input magnitudes come nowhere near over-/underflowing
@@ -215,6 +221,12 @@ void oscore_context_strikeout_requestid(
             }
 
             request_id->is_first_use = is_first;
+
+            // The window is only ever changed when the number is new
+            if (is_first && secctx->type == OSCORE_CONTEXT_B1) {
+                struct oscore_context_b1 *b1 = secctx->data;
+                b1->replay_generation += 1;
+            }
             return;
         }
     default:
@@ -222,6 +234,37 @@ void oscore_context_strikeout_requestid(
     }
 }
 
+bool oscore_context_is_replay(
+        const oscore_context_t *secctx,
+        const oscore_requestid_t *request_id)
+{
+    switch (secctx->type) {
+    case OSCORE_CONTEXT_PRIMITIVE:
+    case OSCORE_CONTEXT_B1:
+        {
+            struct oscore_context_primitive *primitive = find_primitive(secctx);
+            if (primitive->replay_window_left_edge == OSCORE_SEQNO_MAX) {
+                // Uninitialized; only full processing can tell
+                return false;
+            }
+
+            int64_t offset = requestid_numeric(request_id) - primitive->replay_window_left_edge;
+            if (offset < 0) {
+                return true;
+            }
+            // The left edge itself is never marked as seen, and anything
+            // beyond the window would advance it
+            if (offset == 0 || offset > 32) {
+                return false;
+            }
+            uint32_t mask = ((uint32_t)1) << (32 - offset);
+            return (mask & primitive->replay_window) != 0;
+        }
+    default:
+        abort();
+    }
+}
+
 void oscore_context_get_kidcontext(
         const oscore_context_t *secctx,
         const uint8_t **kidcontext,
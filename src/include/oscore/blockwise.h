@@ -0,0 +1,121 @@
+#ifndef OSCORE_BLOCKWISE_H
+#define OSCORE_BLOCKWISE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <oscore/message.h>
+
+/** @file */
+
+/** @ingroup oscore_api
+ *
+ * @addtogroup oscore_blockwise Block-wise responses
+ *
+ * @brief Serve a large representation in Block2 windows
+ *
+ * A server that has a representation too large for a single response sends
+ * it in blocks (RFC 7959), one for each request. Those Block2 options are
+ * Class E options, and thus part of the protected message.
+ *
+ * The functions in this group read the requested block from a request, and
+ * fill a response with the Block2 option and the corresponding window of the
+ * representation, which is read through a callback. The block size is
+ * reduced from the requested one if the response has no space for it.
+ *
+ * These only populate the protected message; preparing and encrypting it is
+ * left to the application. Across the requests of one exchange, the request
+ * part of the AAD can be kept from @ref oscore_unprotect_request_aad and
+ * passed into @ref oscore_prepare_response_aad for each block.
+ *
+ * @{
+ */
+
+/** @brief Callback that provides part of a representation
+ *
+ * @param[in] state The state from the @ref oscore_block2_source
+ * @param[in] offset Position of the first byte to read
+ * @param[out] buffer Location to write the bytes to
+ * @param[in] buffer_len Number of bytes to write
+ *
+ * The requested range always lies inside the source's length.
+ *
+ * @return true if @p buffer_len bytes were written
+ */
+typedef bool (*oscore_block2_read_t)(void *state, size_t offset, uint8_t *buffer, size_t buffer_len);
+
+/** @brief A representation that is served block-wise */
+struct oscore_block2_source {
+    /** Callback that reads from the representation */
+    oscore_block2_read_t read;
+    /** Argument passed to @ref read */
+    void *state;
+    /** Total length of the representation */
+    size_t length;
+};
+
+/** @brief Block requested by a client */
+struct oscore_block2_request {
+    /** Block number */
+    uint32_t num;
+    /** Block size exponent; the block size is `16 << szx` */
+    uint8_t szx;
+};
+
+/** @brief Results of @ref oscore_block2_write */
+enum oscore_block2_result {
+    /** The Block2 option and payload were written */
+    OSCORE_BLOCK2_OK,
+    /** The requested block starts beyond the end of the representation.
+     * Nothing was written to the message; a 4.02 Bad Option response can be
+     * sent in it. */
+    OSCORE_BLOCK2_OUT_OF_RANGE,
+    /** Not even the smallest block fits into the message, or it could not be
+     * written. */
+    OSCORE_BLOCK2_ERROR_MESSAGE,
+    /** The source's read callback failed. The Block2 option has been written,
+     * but only the code and the payload of the message can still be
+     * changed. */
+    OSCORE_BLOCK2_ERROR_SOURCE,
+};
+
+/** @brief Find the block requested in a Block2 option
+ *
+ * @param[in] request Unprotected request to read the option from
+ * @param[out] block Requested block; block 0 at the largest block size if
+ *     the request has no Block2 option
+ *
+ * @return OK on success, INVALID_ARG_ERROR if the Block2 option is malformed
+ * or asks for BERT, or the error from iterating over the options.
+ */
+OSCORE_NONNULL
+oscore_msgerr_protected_t oscore_block2_parse(
+        oscore_msg_protected_t *request,
+        struct oscore_block2_request *block
+        );
+
+/** @brief Write a block of a representation into a response
+ *
+ * @param[inout] msg Writable protected response whose code and options
+ *     before Block2 are set, and that has no payload yet
+ * @param[in] source The representation to serve
+ * @param[in] block Block requested by the client
+ *
+ * The block size is the requested one if the block fits into @p msg, and
+ * the largest smaller one that fits otherwise; the block number is adjusted
+ * accordingly. The last block of the representation is only as large as what
+ * is left of it, so it may fit even at a block size that would not.
+ *
+ * After this, no options can be added any more, and the payload is trimmed to
+ * the block.
+ */
+OSCORE_NONNULL
+enum oscore_block2_result oscore_block2_write(
+        oscore_msg_protected_t *msg,
+        const struct oscore_block2_source *source,
+        const struct oscore_block2_request *block
+        );
+
+/** @} */
+
+#endif
@@ -55,6 +55,18 @@
  *       correctly typically results in nonce reuse and subsequent breach of
  *       the key.
  *
+ *       Applications that do not want to perform I/O on the path on which
+ *       messages are protected can use the write-behind variant of this:
+ *       @ref oscore_context_b1_reservation_begin hands out the next number to
+ *       persist ahead of time (ie. when half of the current reservation is
+ *       used up, rather than when it is exhausted), and @ref
+ *       oscore_context_b1_reservation_durable takes the role of @ref
+ *       oscore_context_b1_allow_high once that number was written. Between
+ *       those calls, the context can be used as usual. A writer that serves
+ *       many contexts can gather the reservations of all of them in an @ref
+ *       oscore_context_b1_batch, and commit them with a single write and sync
+ *       operation.
+ *
  *       A method to extract and persist the current sequence number at
  *       shutdown (in analogy to the below) would be possible (mostly the
  *       documentation would become more verbose), but is currently not
@@ -76,6 +88,15 @@
  *     function is called.  Failure to do so affects security with the same
  *     results as above.
  *
+ *     Applications that keep many contexts can instead take snapshots
+ *     periodically using @ref oscore_context_b1_replay_snapshot, which does
+ *     not affect the security context, and only needs to save the contexts
+ *     whose replay generation changed since the last snapshot. Such snapshots
+ *     must still only be used at startup if no request was processed after
+ *     they were taken, eg. by marking the storage as cleanly shut down only
+ *     after a final round of snapshots (see @ref oscore_context_b1_store for
+ *     an implementation of this).
+ *
  *     On startups that were not immediately preceded by an extraction, no
  *     replay window is reinjected. That is fine, and only results in an
  *     additional roundtrip for the first exchange message.
@@ -110,6 +131,58 @@
  * @{
  */
 
+/** @brief Maximum length of an Echo option value produced by a B.1 context
+ *
+ * This is the maximum length permitted by RFC 9175.
+ */
+#define OSCORE_CONTEXT_B1_ECHO_MAXLEN 40
+
+/** @brief Configuration for stateless Echo values
+ *
+ * By default, a B.1 context uses one of its own sequence numbers as an Echo
+ * value, and stores it in the context until the replay window is recovered.
+ * When a context is configured with this using @ref
+ * oscore_context_b1_set_echo_config, it instead creates Echo values from the
+ * current time and an authentication tag over it and the client's Key ID, as
+ * described in [Appendix A of RFC
+ * 9175](https://www.rfc-editor.org/rfc/rfc9175#appendix-A) (method 3). Such
+ * values can be verified using nothing but this configuration, which is
+ * typically shared by all contexts of an application.
+ *
+ * The tag is produced by running the AEAD algorithm @p aeadalg on an empty
+ * plaintext, with a nonce built from the client's Key ID and the time. As
+ * contexts with different ID Contexts may share a Key ID (and thus nonces),
+ * contexts that have an ID Context use a key derived from @p key and their ID
+ * Context with @p hkdfalg.
+ *
+ * The configuration is not modified by the library, and can thus be used by
+ * any number of contexts concurrently.
+ */
+struct oscore_context_b1_echo_config {
+    /** AEAD algorithm used to authenticate Echo values */
+    oscore_crypto_aeadalg_t aeadalg;
+    /** Key of the length of @p aeadalg.
+     *
+     * This key must be chosen randomly at every startup (and never be
+     * persisted). As time values are not guaranteed to increase across
+     * reboots, nonces would otherwise be reused, and Echo values issued before
+     * a reboot would be accepted after it.
+     */
+    const uint8_t *key;
+    /** HKDF algorithm used to derive the key of each ID Context from @p key */
+    oscore_crypto_hkdfalg_t hkdfalg;
+    /** Function returning the current time in seconds
+     *
+     * The time values only need to increase steadily while the application
+     * runs, and may start at any value.
+     */
+    uint32_t (*now)(void *now_arg);
+    /** Argument passed to @p now */
+    void *now_arg;
+    /** Number of seconds after which an Echo value is not accepted any more */
+    uint32_t lifetime;
+};
+
 /** @brief Data for a security context that can perform B.1 recovery
  *
  * This must always be initialized using @ref oscore_context_b1_initialize.
@@ -136,6 +209,25 @@ struct oscore_context_b1 {
      * above this value.
      */
     uint64_t high_sequence_number;
+    /** @private
+     *
+     * @brief Upper limit to sequence numbers that is being persisted
+     *
+     * This is equal to @ref high_sequence_number unless a reservation handed
+     * out by @ref oscore_context_b1_reservation_begin is in flight, in which
+     * case it holds the value that is being written. It never goes below @ref
+     * high_sequence_number.
+     */
+    uint64_t requested_sequence_number;
+    /** @private
+     *
+     * @brief Counter of changes to the replay window
+     *
+     * This is incremented whenever a request is struck out of the replay
+     * window (or the window is initialized through the Echo mechanism); see
+     * @ref oscore_context_b1_replay_snapshot.
+     */
+    uint32_t replay_generation;
     /** @private
      *
      * @brief Echo value to send out and recognize
@@ -154,6 +246,13 @@ struct oscore_context_b1 {
      * value is a Partial IV, it never has zero length).
      */
     uint8_t echo_value_populated;
+    /** @private
+     *
+     * @brief Configuration for stateless Echo values, or NULL
+     *
+     * See @ref oscore_context_b1_set_echo_config.
+     */
+    const struct oscore_context_b1_echo_config *echo_config;
 };
 
 /** @brief Persistable replay data of a B.1 context
@@ -187,6 +286,9 @@ struct oscore_context_b1_replaydata {
  *     persisted), NULL may be passed to start the Appendix B.1.2 recovery
  *     process.
  *
+ * This does not configure stateless Echo values; @ref
+ * oscore_context_b1_set_echo_config needs to be called after every
+ * initialization of a context that should use them.
  */
 void oscore_context_b1_initialize(
         struct oscore_context_b1 *secctx,
@@ -237,6 +339,161 @@ uint64_t oscore_context_b1_get_wanted(
         struct oscore_context_b1 *secctx
         );
 
+/** @brief Start persisting the next sequence number limit of a B.1 context
+ *
+ * @param[inout] secctx B.1 security context to query
+ * @param[out] seqno Sequence number limit to persist
+ *
+ * @return true if a new limit should be persisted; false if the current
+ * reservation is still sufficient, or if a previous reservation is still in
+ * flight.
+ *
+ * This is a non-blocking alternative to calling @ref
+ * oscore_context_b1_get_wanted before persisting. The returned @p seqno is
+ * recorded as being in flight until it is acknowledged using @ref
+ * oscore_context_b1_reservation_durable, or given up on using @ref
+ * oscore_context_b1_reservation_abandon; until then, this function will not
+ * hand out another value.
+ *
+ * As reservations are requested when half of the previous one is used up,
+ * persisting the value in the background typically completes before the
+ * context runs out of sequence numbers.
+ */
+OSCORE_NONNULL
+bool oscore_context_b1_reservation_begin(
+        struct oscore_context_b1 *secctx,
+        uint64_t *seqno
+        );
+
+/** @brief Inform a B.1 context that a reservation has been persisted
+ *
+ * @param[inout] secctx B.1 security context to update
+ * @param[in] seqno A value previously obtained from @ref
+ *     oscore_context_b1_reservation_begin that has now been persisted
+ *
+ * This has the same effect as @ref oscore_context_b1_allow_high, and is
+ * subject to the same constraints. In addition, it ends the in-flight state of
+ * the reservation, allowing the next one to be started.
+ */
+OSCORE_NONNULL
+void oscore_context_b1_reservation_durable(
+        struct oscore_context_b1 *secctx,
+        uint64_t seqno
+        );
+
+/** @brief Inform a B.1 context that a reservation could not be persisted
+ *
+ * @param[inout] secctx B.1 security context to update
+ *
+ * This ends the in-flight state of any reservation obtained from @ref
+ * oscore_context_b1_reservation_begin without allowing any new sequence
+ * numbers to be used, so that the next call to that function can hand out a
+ * value again.
+ */
+OSCORE_NONNULL
+void oscore_context_b1_reservation_abandon(
+        struct oscore_context_b1 *secctx
+        );
+
+/** @brief A single in-flight reservation inside a @ref oscore_context_b1_batch */
+struct oscore_context_b1_reservation {
+    /** Security context the reservation was taken from */
+    struct oscore_context_b1 *secctx;
+    /** Sequence number limit that needs to be persisted for @p secctx */
+    uint64_t seqno;
+};
+
+/** @brief Group of reservations that are persisted together
+ *
+ * A batch allows a persistence writer to collect the reservations of many
+ * security contexts, write them out with a single (typically expensive)
+ * synchronization operation, and only then acknowledge them all.
+ *
+ * The typical cycle of a background writer is:
+ *
+ * * Call @ref oscore_context_b1_batch_collect for every context that might
+ *   need a reservation (or for every context that was used since the last
+ *   cycle).
+ * * Write the `seqno` of all entries in the batch to persistent storage, and
+ *   wait for the write to be durable.
+ * * Call @ref oscore_context_b1_batch_durable (or, if the write failed, @ref
+ *   oscore_context_b1_batch_abandon).
+ *
+ * The collecting and acknowledging steps act on the security contexts and are
+ * subject to the constraints of @ref design_thread; the writing step in
+ * between only accesses the batch, and thus does not need to keep the
+ * security contexts from being used.
+ *
+ * The memory for the entries is provided by the application; all fields are
+ * practically private.
+ */
+struct oscore_context_b1_batch {
+    /** @private Caller-provided storage for reservations */
+    struct oscore_context_b1_reservation *entries;
+    /** @private Number of elements available at @p entries */
+    size_t capacity;
+    /** @private Number of populated elements in @p entries */
+    size_t length;
+};
+
+/** @brief Initialize an empty batch of reservations
+ *
+ * @param[out] batch Batch to initialize
+ * @param[in] entries Memory to store reservations in
+ * @param[in] capacity Number of reservations that fit in @p entries
+ */
+OSCORE_NONNULL
+void oscore_context_b1_batch_init(
+        struct oscore_context_b1_batch *batch,
+        struct oscore_context_b1_reservation *entries,
+        size_t capacity
+        );
+
+/** @brief Add the reservation of a security context to a batch if one is due
+ *
+ * @param[inout] batch Batch to add to
+ * @param[inout] secctx B.1 security context to start a reservation on
+ *
+ * @return false if the batch is full, true otherwise (whether or not a
+ * reservation was added)
+ */
+OSCORE_NONNULL
+bool oscore_context_b1_batch_collect(
+        struct oscore_context_b1_batch *batch,
+        struct oscore_context_b1 *secctx
+        );
+
+/** @brief Access the reservations collected in a batch
+ *
+ * @param[in] batch Batch to access
+ * @param[out] entries Location of the collected reservations
+ *
+ * @return Number of reservations available at @p entries
+ */
+OSCORE_NONNULL
+size_t oscore_context_b1_batch_get(
+        const struct oscore_context_b1_batch *batch,
+        const struct oscore_context_b1_reservation **entries
+        );
+
+/** @brief Acknowledge all reservations of a batch as persisted, and empty it
+ *
+ * @param[inout] batch Batch whose entries have been persisted
+ */
+OSCORE_NONNULL
+void oscore_context_b1_batch_durable(
+        struct oscore_context_b1_batch *batch
+        );
+
+/** @brief Abandon all reservations of a batch, and empty it
+ *
+ * @param[inout] batch Batch whose entries could not be persisted
+ */
+OSCORE_NONNULL
+void oscore_context_b1_batch_abandon(
+        struct oscore_context_b1_batch *batch
+        );
+
 /** @brief Take the replay data of a security context for persistence
  *
  * @param[inout] secctx B.1 security context to shut down. This is marked inout
@@ -257,6 +514,42 @@ void oscore_context_b1_replay_extract(
     struct oscore_context_b1_replaydata *replaydata
     );
 
+/** @brief Copy the replay data of a security context without shutting it down
+ *
+ * @param[in] secctx B.1 security context to query
+ * @param[out] replaydata Location into which to copy the replay window data
+ *
+ * @return The replay generation the copied data corresponds to
+ *
+ * Unlike @ref oscore_context_b1_replay_extract, the security context can be
+ * used on after this. The data is only suitable for passing to @ref
+ * oscore_context_b1_initialize if no further request was received between
+ * taking the snapshot and shutting down, ie. if the return value of @ref
+ * oscore_context_b1_replay_generation did not change in the meantime.
+ */
+OSCORE_NONNULL
+uint32_t oscore_context_b1_replay_snapshot(
+    const struct oscore_context_b1 *secctx,
+    struct oscore_context_b1_replaydata *replaydata
+    );
+
+/** @brief Query whether the replay data of a security context changed
+ *
+ * @param[in] secctx B.1 security context to query
+ *
+ * @return A counter that changes (wrapping around at its maximum value)
+ * whenever the replay window of the context changes. After an @ref
+ * oscore_context_b1_initialize call, it is 0.
+ *
+ * Applications that persist replay data periodically can compare this to the
+ * value returned by @ref oscore_context_b1_replay_snapshot at the last save,
+ * and skip contexts that did not change.
+ */
+OSCORE_NONNULL
+uint32_t oscore_context_b1_replay_generation(
+    const struct oscore_context_b1 *secctx
+    );
+
 /** @brief Find the Echo value used by a B.1 context for recovery
  *
  * This function provides access to the Echo value that is used (sent in
@@ -276,6 +569,9 @@ void oscore_context_b1_replay_extract(
  *
  * This must only be called on a B.1 backed security context.
  *
+ * If the context is configured for stateless Echo values, this always reports
+ * a zero-length slice; use @ref oscore_context_b1_build_echo instead.
+ *
  */
 OSCORE_NONNULL
 void oscore_context_b1_get_echo(
@@ -284,6 +580,57 @@ void oscore_context_b1_get_echo(
         uint8_t **value
         );
 
+/** @brief Configure a B.1 context to use stateless Echo values
+ *
+ * @param[inout] secctx B.1 security context to configure
+ * @param[in] config Configuration to use. This needs to stay valid for as
+ *     long as the context uses it.
+ *
+ * With a configuration set, @ref oscore_context_b1_get_echo reports no Echo
+ * value; @ref oscore_context_b1_build_echo needs to be used instead. No
+ * sequence numbers are spent on Echo values, and verifying them in @ref
+ * oscore_context_b1_process_request does not depend on any earlier call to
+ * the context.
+ *
+ * The configuration is reset by @ref oscore_context_b1_initialize, and needs
+ * to be set again after that.
+ */
+OSCORE_NONNULL
+void oscore_context_b1_set_echo_config(
+        struct oscore_context_b1 *secctx,
+        const struct oscore_context_b1_echo_config *config
+        );
+
+/** @brief Return a B.1 context to per-context Echo values
+ *
+ * @param[inout] secctx B.1 security context to configure
+ *
+ * This undoes @ref oscore_context_b1_set_echo_config. Echo values that were
+ * issued under the configuration are not accepted any more.
+ */
+OSCORE_NONNULL
+void oscore_context_b1_clear_echo_config(
+        struct oscore_context_b1 *secctx
+        );
+
+/** @brief Produce an Echo value for B.1 recovery into a buffer
+ *
+ * @param[inout] secctx B.1 security context to build the value for
+ * @param[out] value Buffer into which the value is written
+ * @param[out] value_length Number of bytes written into @p value
+ *
+ * This works like @ref oscore_context_b1_get_echo, but copies the value out
+ * and thus works for stateless Echo values as well (see @ref
+ * oscore_context_b1_set_echo_config). On failure, @p value_length is set to
+ * zero.
+ */
+OSCORE_NONNULL
+void oscore_context_b1_build_echo(
+        oscore_context_t *secctx,
+        uint8_t value[OSCORE_CONTEXT_B1_ECHO_MAXLEN],
+        size_t *value_length
+        );
+
 /** @brief Helper function for processing incoming requests in B.1 contexts
  *
  * This function performs two tasks:
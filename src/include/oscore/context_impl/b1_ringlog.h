@@ -0,0 +1,132 @@
+#ifndef OSCORE_CONTEXT_B1_RINGLOG_H
+#define OSCORE_CONTEXT_B1_RINGLOG_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <oscore/helpers.h>
+
+/** @file */
+
+/** @ingroup oscore_context_b1
+ *
+ * @addtogroup oscore_context_b1_ringlog Wear-leveled flash log for B.1 sequence numbers
+ *
+ * @brief Append-only storage of sequence number limits on flash memory
+ *
+ * Devices that persist the values of @ref oscore_context_b1_allow_high to
+ * flash memory wear out their flash quickly if they erase and rewrite a page
+ * for every new value. This log instead appends each value as a small record
+ * to a ring of pages, and only erases a page when the ring wraps around onto
+ * it. On startup, @ref oscore_context_b1_ringlog_open finds the latest
+ * record by inspecting the start of each page and then only the newest page.
+ *
+ * Each record is @ref OSCORE_CONTEXT_B1_RINGLOG_RECORD_SIZE bytes long and
+ * carries a checksum, so records that were only partially written on loss of
+ * power are ignored. Values need to increase strictly with every append, which
+ * is naturally the case for sequence number limits.
+ *
+ * Access to the flash memory is provided by the application through an @ref
+ * oscore_context_b1_flash; the write granularity of the flash memory must
+ * divide the record size. Flash memory is expected to read as all-ones bytes
+ * after an erase.
+ *
+ * @{
+ */
+
+/** @brief Size of a single record in the log */
+#define OSCORE_CONTEXT_B1_RINGLOG_RECORD_SIZE 16
+
+/** @brief Access to a flash memory area that holds a log
+ *
+ * The callbacks report success by returning true; offsets are relative to the
+ * start of the area.
+ */
+struct oscore_context_b1_flash {
+    /** Size of an erase unit (a page) in bytes. Needs to be a multiple of
+     * @ref OSCORE_CONTEXT_B1_RINGLOG_RECORD_SIZE. */
+    size_t page_size;
+    /** Number of pages in the area; at least 2 */
+    size_t page_count;
+    /** Read @p len bytes starting at @p offset into @p buf */
+    bool (*read)(void *arg, size_t offset, void *buf, size_t len);
+    /** Write @p len bytes starting at @p offset from @p buf into erased flash */
+    bool (*write)(void *arg, size_t offset, const void *buf, size_t len);
+    /** Erase the page with the given number */
+    bool (*erase)(void *arg, size_t page);
+    /** Argument passed to all callbacks */
+    void *arg;
+};
+
+/** @brief State of an opened log
+ *
+ * All fields are private; the struct is initialized by @ref
+ * oscore_context_b1_ringlog_open.
+ */
+struct oscore_context_b1_ringlog {
+    /** @private Flash area holding the log */
+    const struct oscore_context_b1_flash *flash;
+    /** @private Page the next record goes to */
+    size_t page;
+    /** @private Slot within @ref page the next record goes to */
+    size_t slot;
+    /** @private Latest value in the log, if @ref has_latest is set */
+    uint64_t latest;
+    /** @private Whether the log contains any valid record */
+    bool has_latest;
+};
+
+/** @brief Open a log and find its latest record
+ *
+ * @param[out] log Log state to initialize
+ * @param[in] flash Flash memory access; needs to stay valid as long as @p log
+ *     is used
+ *
+ * @return false if the flash memory could not be read
+ *
+ * An area that contains no valid records (eg. because it was never used) is
+ * opened as an empty log.
+ */
+OSCORE_NONNULL
+bool oscore_context_b1_ringlog_open(
+        struct oscore_context_b1_ringlog *log,
+        const struct oscore_context_b1_flash *flash
+        );
+
+/** @brief Read the latest value of a log
+ *
+ * @param[in] log Opened log
+ * @param[out] value Latest value appended to the log
+ *
+ * @return false if the log is empty
+ *
+ * The result is suitable for passing into @ref oscore_context_b1_initialize.
+ */
+OSCORE_NONNULL
+bool oscore_context_b1_ringlog_latest(
+        const struct oscore_context_b1_ringlog *log,
+        uint64_t *value
+        );
+
+/** @brief Append a value to a log
+ *
+ * @param[inout] log Opened log
+ * @param[in] value New value, typically obtained from @ref
+ *     oscore_context_b1_get_wanted or @ref
+ *     oscore_context_b1_reservation_begin
+ *
+ * @return true if the value was persisted, false if it was not larger than
+ * the latest value or the flash memory access failed
+ *
+ * This erases the next page if the current one is full; otherwise, it only
+ * writes a single record.
+ */
+OSCORE_NONNULL
+bool oscore_context_b1_ringlog_append(
+        struct oscore_context_b1_ringlog *log,
+        uint64_t value
+        );
+
+/** @} */
+
+#endif
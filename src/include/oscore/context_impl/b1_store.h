@@ -0,0 +1,352 @@
+#ifndef OSCORE_CONTEXT_B1_STORE_H
+#define OSCORE_CONTEXT_B1_STORE_H
+
+#include <oscore/context_impl/b1.h>
+
+/** @file */
+
+/** @ingroup oscore_context_b1
+ *
+ * @addtogroup oscore_context_b1_store Persistent store for many B.1 contexts
+ *
+ * @brief Fixed-size record format for the mutable state of B.1 contexts
+ *
+ * A store keeps the sequence number reservations (as passed to @ref
+ * oscore_context_b1_allow_high) and the replay data (as produced by @ref
+ * oscore_context_b1_replay_extract) of many @ref oscore_context_b1 contexts
+ * in a single, application-provided memory area.
+ *
+ * The store does not perform any I/O on its own. It is designed to be used on
+ * top of a memory mapped file, where restoring a context is a plain memory
+ * access, and changes are flushed by synchronizing only the areas reported
+ * by @ref oscore_context_b1_store_take_dirty. On POSIX systems, that is
+ * typically:
+ *
+ * ```
+ * int fd = open("contexts.store", O_RDWR | O_CREAT, 0600);
+ * ftruncate(fd, OSCORE_CONTEXT_B1_STORE_SIZE(n));
+ * void *mem = mmap(NULL, OSCORE_CONTEXT_B1_STORE_SIZE(n),
+ *         PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+ * switch (oscore_context_b1_store_open(&store, mem, OSCORE_CONTEXT_B1_STORE_SIZE(n))) {
+ * case OSCORE_CONTEXT_B1_STORE_OPEN_OK:
+ *     break;
+ * case OSCORE_CONTEXT_B1_STORE_OPEN_EMPTY:
+ *     // The file was just created
+ *     oscore_context_b1_store_format(&store, mem, OSCORE_CONTEXT_B1_STORE_SIZE(n));
+ *     break;
+ * default:
+ *     // Do not overwrite the data; an operator needs to look at it
+ *     abort();
+ * }
+ *
+ * // ... restore contexts, set their high sequence numbers ...
+ *
+ * size_t offset, length;
+ * while (oscore_context_b1_store_take_dirty(&store, &offset, &length)) {
+ *     // msync needs page aligned addresses
+ *     size_t start = offset - offset % pagesize;
+ *     msync((char*)mem + start, offset + length - start, MS_SYNC);
+ * }
+ * ```
+ *
+ * Any data written to the store only becomes durable once the dirty areas
+ * have been synchronized; in particular, @ref oscore_context_b1_allow_high (or
+ * @ref oscore_context_b1_reservation_durable) may only be called after that.
+ *
+ * Replay data is only trusted when the store was sealed at its last use
+ * (see @ref oscore_context_b1_store_seal). Opening a sealed store unseals it,
+ * and that change needs to be synchronized before any of the restored
+ * contexts are used, as otherwise a crash would leave stale replay data in
+ * the store.
+ *
+ * Replay data can be written either at shutdown (using @ref
+ * oscore_context_b1_store_save_replay), or periodically using @ref
+ * oscore_context_b1_store_checkpoint. Checkpoints only write records whose
+ * context's replay window changed since the last checkpoint, so that a final
+ * round of checkpoints before sealing only touches the contexts that were
+ * active recently.
+ *
+ * A store can be grown by opening it in a larger memory area (eg. after
+ * extending the file); the records it contained are kept, and the added ones
+ * are empty.
+ *
+ * Records are stored in the host's native byte order and alignment; a store
+ * can not be moved between platforms that differ in those.
+ *
+ * @{
+ */
+
+/** @brief Per-store data at the start of the memory area
+ *
+ * @private
+ */
+struct oscore_context_b1_store_header {
+    /** Constant that identifies the format of the store */
+    uint32_t magic;
+    /** Bit field of OSCORE_CONTEXT_B1_STORE_SEALED */
+    uint32_t flags;
+    /** Number of records following the header */
+    uint32_t record_count;
+    /** Checksum over the preceding fields */
+    uint32_t checksum;
+};
+
+/** @brief State of a single context in the store
+ *
+ * @private
+ */
+struct oscore_context_b1_store_record {
+    /** Constant that indicates the record is populated */
+    uint32_t magic;
+    /** Bit field of OSCORE_CONTEXT_B1_STORE_HAS_REPLAY */
+    uint32_t flags;
+    /** Persisted sequence number limit */
+    uint64_t high_sequence_number;
+    /** Replay data saved at shutdown or at a checkpoint; only valid with
+     * OSCORE_CONTEXT_B1_STORE_HAS_REPLAY */
+    struct oscore_context_b1_replaydata replay;
+    /** Replay generation of the context at the time @p replay was written
+     * (see @ref oscore_context_b1_replay_generation) */
+    uint32_t replay_generation;
+    /** Checksum over the preceding fields */
+    uint32_t checksum;
+};
+
+/** @brief Number of bytes needed to hold a store of @p n records */
+#define OSCORE_CONTEXT_B1_STORE_SIZE(n) \
+    (sizeof(struct oscore_context_b1_store_header) + \
+     (n) * sizeof(struct oscore_context_b1_store_record))
+
+/** @brief Number of separate areas a store tracks as dirty
+ *
+ * When more areas change between two calls to @ref
+ * oscore_context_b1_store_take_dirty, the closest ones are joined, and bytes
+ * between them are reported as dirty along with them.
+ *
+ * The value can be overridden at build time by predefining it to a numeric
+ * value in the compiler invocation.
+ */
+#ifndef OSCORE_CONTEXT_B1_STORE_DIRTY_RANGES
+#define OSCORE_CONTEXT_B1_STORE_DIRTY_RANGES 4
+#endif
+
+/** @brief An area of a store that needs to be synchronized
+ *
+ * @private
+ */
+struct oscore_context_b1_store_range {
+    /** Offset of the first changed byte */
+    size_t start;
+    /** Offset after the last changed byte */
+    size_t end;
+};
+
+/** @brief An opened store of B.1 context states
+ *
+ * All fields are private; the struct is initialized by @ref
+ * oscore_context_b1_store_open or @ref oscore_context_b1_store_format.
+ */
+struct oscore_context_b1_store {
+    /** @private Start of the memory area */
+    struct oscore_context_b1_store_header *header;
+    /** @private Records in the memory area */
+    struct oscore_context_b1_store_record *records;
+    /** @private Areas changed since the last @ref
+     * oscore_context_b1_store_take_dirty, sorted, neither overlapping nor
+     * adjacent */
+    struct oscore_context_b1_store_range dirty[OSCORE_CONTEXT_B1_STORE_DIRTY_RANGES];
+    /** @private Number of populated entries in @ref dirty */
+    uint8_t dirty_count;
+    /** @private The store was sealed when it was opened */
+    bool was_sealed;
+};
+
+/** @brief Results of @ref oscore_context_b1_store_open */
+enum oscore_context_b1_store_open_result {
+    /** The memory area contains a store, which is now opened */
+    OSCORE_CONTEXT_B1_STORE_OPEN_OK,
+    /** The memory area is all zero at the position of the store's header, as
+     * is typical of a newly created file. */
+    OSCORE_CONTEXT_B1_STORE_OPEN_EMPTY,
+    /** The memory area's header is damaged, or of a different format */
+    OSCORE_CONTEXT_B1_STORE_OPEN_INVALID,
+    /** The store in the memory area has more records than fit in it */
+    OSCORE_CONTEXT_B1_STORE_OPEN_TRUNCATED,
+};
+
+/** @brief Open a store in a memory area
+ *
+ * @param[out] store Store to initialize
+ * @param[inout] memory Memory area to use. It needs to be suitably aligned to
+ *     hold a `uint64_t` (which is always the case for memory mapped files).
+ * @param[in] length Size of @p memory. Should be a result of @ref
+ *     OSCORE_CONTEXT_B1_STORE_SIZE.
+ *
+ * @return OSCORE_CONTEXT_B1_STORE_OPEN_OK if @p memory contained a valid
+ * store. On any other result, @p memory is left untouched and @p store can
+ * not be used; unless it is then formatted using @ref
+ * oscore_context_b1_store_format.
+ *
+ * If the store was sealed, it is unsealed in this process, and the header is
+ * reported as dirty. If @p length has space for more records than the store
+ * contains, the store is grown to hold them, and the added records are
+ * reported as dirty along with the header.
+ */
+OSCORE_NONNULL
+enum oscore_context_b1_store_open_result oscore_context_b1_store_open(
+        struct oscore_context_b1_store *store,
+        void *memory,
+        size_t length
+        );
+
+/** @brief Create an empty store in a memory area
+ *
+ * @param[out] store Store to initialize
+ * @param[out] memory Memory area to use, aligned as described for @ref
+ *     oscore_context_b1_store_open
+ * @param[in] length Size of @p memory
+ *
+ * Any data previously in @p memory is lost. The store is opened, and the
+ * complete memory area is reported as dirty.
+ */
+OSCORE_NONNULL
+void oscore_context_b1_store_format(
+        struct oscore_context_b1_store *store,
+        void *memory,
+        size_t length
+        );
+
+/** @brief Number of records in a store */
+OSCORE_NONNULL
+size_t oscore_context_b1_store_capacity(
+        const struct oscore_context_b1_store *store
+        );
+
+/** @brief Initialize a B.1 context from a record in the store
+ *
+ * @param[inout] store Store to read from
+ * @param[in] index Record number to read
+ * @param[out] secctx Security context to initialize
+ * @param[in] immutables Key material of the context (which is not kept in the
+ *     store)
+ *
+ * @return true if the context was initialized; false if the record is empty
+ * or corrupted.
+ *
+ * The context is initialized from the record's persisted sequence number
+ * limit, so that sequence numbers need to be reserved again before it can be
+ * used in the sender role. Any replay data is used only if the store was
+ * sealed, and is removed from the record in any case, so that a second
+ * restore of the same record in one run does not see it again.
+ */
+OSCORE_NONNULL
+bool oscore_context_b1_store_restore(
+        struct oscore_context_b1_store *store,
+        size_t index,
+        struct oscore_context_b1 *secctx,
+        const struct oscore_context_primitive_immutables *immutables
+        );
+
+/** @brief Record a new sequence number limit for a context
+ *
+ * @param[inout] store Store to write to
+ * @param[in] index Record number to write
+ * @param[in] seqno Value to store, typically obtained from @ref
+ *     oscore_context_b1_reservation_begin
+ *
+ * This also creates the record if it was empty.
+ */
+OSCORE_NONNULL
+void oscore_context_b1_store_set_high(
+        struct oscore_context_b1_store *store,
+        size_t index,
+        uint64_t seqno
+        );
+
+/** @brief Extract the replay data of a context into its record
+ *
+ * @param[inout] store Store to write to
+ * @param[in] index Record number of the context
+ * @param[inout] secctx Context to shut down; see @ref
+ *     oscore_context_b1_replay_extract.
+ */
+OSCORE_NONNULL
+void oscore_context_b1_store_save_replay(
+        struct oscore_context_b1_store *store,
+        size_t index,
+        struct oscore_context_b1 *secctx
+        );
+
+/** @brief Write the replay data of a context into its record if it changed
+ *
+ * @param[inout] store Store to write to
+ * @param[in] index Record number of the context
+ * @param[in] secctx Context whose replay data to save; it can be used on
+ *     afterwards.
+ *
+ * @return true if the record was written, false if it was up to date already
+ *
+ * The record needs to be populated (see @ref
+ * oscore_context_b1_store_set_high).
+ *
+ * Running this over all contexts and then sealing the store is equivalent to
+ * saving all replay data using @ref oscore_context_b1_store_save_replay.
+ */
+OSCORE_NONNULL
+bool oscore_context_b1_store_checkpoint(
+        struct oscore_context_b1_store *store,
+        size_t index,
+        const struct oscore_context_b1 *secctx
+        );
+
+/** @brief Remove a context from the store
+ *
+ * @param[inout] store Store to write to
+ * @param[in] index Record number to clear
+ */
+OSCORE_NONNULL
+void oscore_context_b1_store_clear(
+        struct oscore_context_b1_store *store,
+        size_t index
+        );
+
+/** @brief Mark the store as cleanly shut down
+ *
+ * @param[inout] store Store to seal
+ *
+ * This is to be called after all contexts' replay data was saved, and before
+ * the last synchronization. No context restored from the store may be used
+ * any more afterwards.
+ */
+OSCORE_NONNULL
+void oscore_context_b1_store_seal(
+        struct oscore_context_b1_store *store
+        );
+
+/** @brief Find an area that needs to be synchronized
+ *
+ * @param[inout] store Store to query
+ * @param[out] offset Offset of the first changed byte from the start of the
+ *     memory area
+ * @param[out] length Number of bytes to synchronize
+ *
+ * @return false if nothing changed since all areas were taken
+ *
+ * Changes to separate parts of the store are reported as separate areas (see
+ * @ref OSCORE_CONTEXT_B1_STORE_DIRTY_RANGES), in ascending order. This is
+ * called repeatedly until it returns false to find all of them.
+ *
+ * This removes the area from the store's dirty tracking; if the
+ * synchronization fails, the application needs to retry it (or treat the
+ * store as broken).
+ */
+OSCORE_NONNULL
+bool oscore_context_b1_store_take_dirty(
+        struct oscore_context_b1_store *store,
+        size_t *offset,
+        size_t *length
+        );
+
+/** @} */
+
+#endif
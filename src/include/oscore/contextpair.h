@@ -77,6 +77,25 @@ void oscore_context_strikeout_requestid(
         oscore_context_t *secctx,
         oscore_requestid_t *request_id);
 
+/** @brief Determine whether a request is known to be a replay
+ *
+ * @param[in] secctx Security context pair in which @p request_id is used
+ * @param[input] request_id Request ID whose partial IV (and thus sequence number) to look up
+ *
+ * This looks up the sequence number represented by @p request_id like @ref
+ * oscore_context_strikeout_requestid does, but without altering the replay
+ * window. It returns true if the number was used before, or lies before the
+ * window (and would thus not be accepted as a first use).
+ *
+ * If the context's replay window is not initialized, this returns false, as
+ * such a request may still serve to initialize it (see @ref
+ * oscore_context_b1).
+ */
+OSCORE_NONNULL
+bool oscore_context_is_replay(
+        const oscore_context_t *secctx,
+        const oscore_requestid_t *request_id);
+
 oscore_crypto_aeadalg_t oscore_context_get_aeadalg(const oscore_context_t *secctx);
 
 OSCORE_NONNULL
@@ -78,6 +78,66 @@ typedef struct {
     bool is_first_use;
 } oscore_requestid_t;
 
+/** @brief Maximum length of the encoded request dependent part of the
+ * external AAD
+ *
+ * This covers the AEAD algorithm identifier as a CBOR integer, the request
+ * KID and the request Partial IV as CBOR byte strings.
+ */
+#define OSCORE_REQUEST_AAD_MAXLEN (5 + 2 + OSCORE_KEYID_MAXLEN + 1 + PIV_BYTES)
+
+/** @brief Request dependent part of the AAD
+ *
+ * This contains the encoded parts of the external AAD that a response shares
+ * with the request it answers. It can be obtained while unprotecting a
+ * request using @ref oscore_unprotect_request_aad, and spares building those
+ * parts again for the response in @ref oscore_prepare_response_aad.
+ *
+ * Like a @ref oscore_requestid_t, it must only be used with the security
+ * context of the request it was obtained from. Unlike that, it may be copied
+ * freely; it can be used for any number of responses (eg. observation
+ * notifications) to the same request.
+ */
+typedef struct {
+    /** @private Number of populated bytes in @ref bytes */
+    uint8_t length;
+    /** @private Encoded algorithm, request_kid and request_piv */
+    uint8_t bytes[OSCORE_REQUEST_AAD_MAXLEN];
+} oscore_request_aad_t;
+
+/** @brief Option number of the Request-Hash option
+ *
+ * This is the number suggested for the option in the cacheable OSCORE draft
+ * (draft-amsuess-core-cachable-oscore), which has not been assigned yet. The
+ * value this library sends in it is not the draft's hash; see @ref
+ * oscore_prepare_request_deterministic.
+ */
+#define OSCORE_OPTNUM_REQUEST_HASH 548
+
+/** @brief Length of the request hash of a deterministic request
+ *
+ * This can be overridden at build time; all parties using a deterministic
+ * client's context need to agree on it.
+ */
+#ifndef OSCORE_REQUEST_HASH_LEN
+#define OSCORE_REQUEST_HASH_LEN 16
+#endif
+
+/** @brief Request hash and key of a deterministic request
+ *
+ * This is populated when a deterministic request is prepared or unprotected,
+ * and needed again for the response to it.
+ *
+ * All fields are private.
+ */
+typedef struct {
+    /** @private Request hash, as sent in the Request-Hash option */
+    uint8_t hash[OSCORE_REQUEST_HASH_LEN];
+    /** @private Key derived from the hash, which protects the request and its
+     * responses */
+    uint8_t key[OSCORE_CRYPTO_AEAD_KEY_MAXLEN];
+} oscore_deterministic_t;
+
 /** @brief Portability helper for declaring pointers non-null
  *
  * Prefix this to a function signature to declare that none of its pointers
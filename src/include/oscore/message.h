@@ -82,11 +82,37 @@ enum oscore_msg_protected_flags {
      * This is set at message creation time, and cleared when the OSCORE option
      * is written as an autooption. */
     OSCORE_MSG_PROTECTED_FLAG_PENDING_OSCORE = 1 << 4,
+
+    /** The plaintext was decrypted out of place, and is not in the backend's
+     * payload but in the buffer at `mapped_payload` (which is therefore never
+     * reset). Such messages have no space reserved for the tag. */
+    OSCORE_MSG_PROTECTED_FLAG_DETACHED = 1 << 5,
+
+    /** The Request-Hash option of a deterministic request still needs to be
+     * written
+     *
+     * This is set when a deterministic request is prepared, and cleared when
+     * the option is written as an autooption. */
+    OSCORE_MSG_PROTECTED_FLAG_PENDING_REQUEST_HASH = 1 << 6,
+
+    /** A template was applied to the message, which trimmed the backend's
+     * payload to the template's content. No inner options can be added any
+     * more, as there is no space left to move the payload into. */
+    OSCORE_MSG_PROTECTED_FLAG_TEMPLATE_APPLIED = 1 << 7,
+
+    /** The message is a deterministic request or a response to one, and its
+     * `deterministic` member is set instead of `request_aad`. */
+    OSCORE_MSG_PROTECTED_FLAG_DETERMINISTIC = 1 << 8,
 };
 
 /** @brief OSCORE protected CoAP message
  *
- * @todo This struct may need splitting up according to read/write state
+ * Received messages only use the fields up to and including @ref
+ * mapped_payload_len; they can be kept in the smaller @ref
+ * oscore_msg_protected_compact_t while they are not being worked on. While
+ * they are being worked on, they take the full size of this structure: the
+ * writable-message-only fields are not overlaid with anything, as all
+ * message functions take this one type for both directions.
  *
  * This structure represents a CoAP message built ready for in-place
  * encryption, or decrypted in-place. Its outer options are placed as options
@@ -128,13 +154,30 @@ typedef struct {
      *
      * In writable messages, it being zero indicates that the inner payload has
      * not been mapped yet (and adding options therefore does not require
-     * memmoving the payload, if implemented and enabled). In readable
-     * messages, it being zero indicates that the inner options have not been
-     * iterated over, and is used to memoize the payload's offset on the first
-     * mapping.
+     * memmoving the payload). In readable messages, it being zero indicates
+     * that the inner options have not been iterated over, and is used to
+     * memoize the payload's offset on the first mapping.
      * */
     size_t payload_offset;
 
+    /** @brief Backend payload as last mapped
+     *
+     * If not NULL, this (together with @ref mapped_payload_len) holds the
+     * result of the last call to @ref oscore_msg_native_map_payload on the
+     * backend. It is reset whenever the library performs an operation on the
+     * backend that may move its payload (appending or updating outer options,
+     * or trimming the payload), and saves repeated mapping of the payload
+     * otherwise.
+     *
+     * @private
+     */
+    uint8_t *mapped_payload;
+    /** @brief Length of @ref mapped_payload
+     *
+     * @private
+     */
+    size_t mapped_payload_len;
+
     //
     // only used in writable messages
     //
@@ -170,8 +213,47 @@ typedef struct {
     oscore_requestid_t request_id;
 
     struct oscore_opttrack class_e;
+
+    union {
+        /** @private
+         *
+         * @brief Request dependent part of the AAD of a writable message
+         *
+         * Valid unless @ref OSCORE_MSG_PROTECTED_FLAG_DETERMINISTIC is set.
+         * This is NULL unless it was provided in @ref
+         * oscore_prepare_response_aad.
+         */
+        const oscore_request_aad_t *request_aad;
+        /** @private
+         *
+         * @brief Request hash and key of a deterministic exchange
+         *
+         * Valid if @ref OSCORE_MSG_PROTECTED_FLAG_DETERMINISTIC is set. Its key
+         * replaces the security context's sender key.
+         */
+        const oscore_deterministic_t *deterministic;
+    };
 } oscore_msg_protected_t;
 
+/** @brief Compact form of a received OSCORE protected CoAP message
+ *
+ * Messages obtained from @ref oscore_unprotect_request or @ref
+ * oscore_unprotect_response do not use any of the writable-message-only
+ * fields of @ref oscore_msg_protected_t. Applications that keep many received
+ * messages around (eg. while their processing is deferred) can store them in
+ * this smaller form using @ref oscore_msg_protected_compact, and turn them
+ * back into a full message for use with the message API with @ref
+ * oscore_msg_protected_expand when they are processed.
+ */
+typedef struct {
+    /** @private */
+    oscore_msg_native_t backend;
+    /** @private See @ref oscore_msg_protected_t::payload_offset */
+    size_t payload_offset;
+    /** @private See @ref oscore_msg_protected_t::tag_length */
+    uint8_t tag_length;
+} oscore_msg_protected_compact_t;
+
 /** @brief OSCORE message operation error type
  *
  * These errors are returned by functions manipulating a @ref oscore_msg_protected_t.
@@ -201,6 +283,9 @@ typedef enum {
  */
 typedef struct {
     uint16_t inner_peeked_optionnumber;
+    uint16_t backend_peeked_optionnumber;
+    bool backend_exhausted;
+
     /** @private
      *
      * @brief Pointer to the next available inner option value
@@ -233,13 +318,125 @@ typedef struct {
     };
 
     oscore_msg_native_optiter_t backend;
-    bool backend_exhausted;
 
-    uint16_t backend_peeked_optionnumber;
     const uint8_t *backend_peeked_value;
     size_t backend_peeked_value_len;
 } oscore_msg_protected_optiter_t;
 
+/** @brief Location of a single option in an @ref oscore_msg_protected_optindex_t
+ *
+ * @private
+ */
+struct oscore_msg_protected_optindex_entry {
+    const uint8_t *value;
+    size_t value_len;
+    uint16_t option_number;
+};
+
+/** @brief Index of the options in a protected CoAP message
+ *
+ * An index allows looking up options by number (using @ref
+ * oscore_msg_protected_find_option) without iterating over the message for
+ * every lookup. It is built when it is first used, by a single iteration over
+ * the message's options, and records the inner and outer options (as they
+ * would be reported by @ref oscore_msg_protected_optiter_next) in
+ * caller-provided memory.
+ *
+ * If the message has more options than fit the index, lookups of option
+ * numbers beyond the indexed ones fall back to iterating over the message.
+ *
+ * The index is only valid as long as the message is not altered.
+ */
+typedef struct {
+    /** @private Caller-provided storage for entries */
+    struct oscore_msg_protected_optindex_entry *entries;
+    /** @private Number of elements available at @ref entries */
+    size_t capacity;
+    /** @private Number of populated elements in @ref entries */
+    size_t length;
+    /** @private The entries have been populated */
+    bool built;
+    /** @private All of the message's options are in @ref entries */
+    bool complete;
+    /** @private Result of the iteration that populated @ref entries */
+    oscore_msgerr_protected_t status;
+} oscore_msg_protected_optindex_t;
+
+/** @brief Single option passed to @ref oscore_msg_protected_append_options */
+struct oscore_msg_protected_option {
+    /** Option number */
+    uint16_t option_number;
+    /** Option value; may be NULL if @ref value_len is 0 */
+    const uint8_t *value;
+    /** Number of bytes in @ref value */
+    size_t value_len;
+};
+
+/** @brief Space for the plaintext of a message template
+ *
+ * This bounds the code, options and payload of an @ref
+ * oscore_msg_protected_template_t. It can be overridden at build time.
+ */
+#ifndef OSCORE_MSG_PROTECTED_TEMPLATE_MAXLEN
+#define OSCORE_MSG_PROTECTED_TEMPLATE_MAXLEN 64
+#endif
+
+/** @brief Pre-encoded content of a protected message
+ *
+ * Messages whose code, inner options and payload are the same every time
+ * they are sent (eg. error responses) can be encoded once with @ref
+ * oscore_msg_protected_template_build. Each copy is then written into a
+ * prepared message by @ref oscore_msg_protected_apply_template in a single
+ * step, leaving only the encryption.
+ *
+ * All fields are private.
+ */
+typedef struct {
+    /** @private Number of bytes in @ref plaintext that are the code and options */
+    size_t options_end;
+    /** @private Number of populated bytes in @ref plaintext */
+    size_t length;
+    /** @private Number of the last option in @ref plaintext */
+    uint16_t last_option_number;
+    /** @private Whether @ref plaintext contains an inner Observe option */
+    bool observe;
+    /** @private Code, encoded options, payload marker and payload */
+    uint8_t plaintext[OSCORE_MSG_PROTECTED_TEMPLATE_MAXLEN];
+} oscore_msg_protected_template_t;
+
+/** @brief Store a received message in compact form
+ *
+ * @param[out] compact Caller-allocated (previously uninitialized) storage
+ * @param[in] msg Message obtained from unprotecting a message
+ *
+ * Any information about the message's options that was gathered while working
+ * with @p msg is preserved, so it does not need to be gathered again after
+ * expanding it.
+ *
+ * This must not be used with writable messages, or with messages that were
+ * unprotected out of place.
+ */
+OSCORE_NONNULL
+void oscore_msg_protected_compact(
+        oscore_msg_protected_compact_t *compact,
+        const oscore_msg_protected_t *msg
+        );
+
+/** @brief Recreate a received message from its compact form
+ *
+ * @param[out] msg Caller-allocated (previously uninitialized) message
+ * @param[in] compact Message stored using @ref oscore_msg_protected_compact
+ *
+ * The resulting message can be used with all read functions of the message
+ * API, and released just like the message it was compacted from. The @p
+ * compact form stays valid and can be expanded again later.
+ */
+OSCORE_NONNULL
+void oscore_msg_protected_expand(
+        oscore_msg_protected_t *msg,
+        const oscore_msg_protected_compact_t *compact
+        );
+
 /** Retrieve the inner CoAP code (request method or response code) from a protected message */
 OSCORE_NONNULL
 uint8_t oscore_msg_protected_get_code(oscore_msg_protected_t *msg);
@@ -260,6 +457,14 @@ void oscore_msg_protected_set_code(oscore_msg_protected_t *msg, uint8_t code);
  * Valid reasons for this to return an unsuccessful response include space
  * inside the message, options being written in the wrong order or payload
  * having been written to the message.
+ *
+ * Inner (class E) options can still be appended after the payload was mapped
+ * using @ref oscore_msg_protected_map_payload, eg. when an ETag is only known
+ * after the payload was rendered. The payload written so far is then moved
+ * back by the size of the new option, and bytes that are moved beyond the end
+ * of the payload area are lost. Any previously mapped payload pointer becomes
+ * invalid; the payload needs to be mapped again to find its new location and
+ * size.
  */
 oscore_msgerr_protected_t oscore_msg_protected_append_option(
         oscore_msg_protected_t *msg,
@@ -268,6 +473,27 @@ oscore_msgerr_protected_t oscore_msg_protected_append_option(
         size_t value_len
         );
 
+/** @brief Append several options to a protected CoAP message
+ *
+ * @param[inout] msg Message to append to
+ * @param[in] options Options to append, sorted by option number
+ * @param[in] count Number of elements in @p options
+ *
+ * This has the same effect as calling @ref oscore_msg_protected_append_option
+ * for each of the @p options in sequence, but encodes consecutive inner (class
+ * E) options in one pass, after checking once whether they fit into the
+ * message.
+ *
+ * If an error is returned, the options that precede the run of inner options
+ * that caused it were appended; the failing run itself was not.
+ */
+OSCORE_NONNULL
+oscore_msgerr_protected_t oscore_msg_protected_append_options(
+        oscore_msg_protected_t *msg,
+        const struct oscore_msg_protected_option *options,
+        size_t count
+        );
+
 /** @brief Update an single occurrence of an option in a protected CoAP message
  *
  * @param[inout] msg Message to update
@@ -350,6 +576,64 @@ oscore_msgerr_protected_t oscore_msg_protected_optiter_finish(
         oscore_msg_protected_optiter_t *iter
         );
 
+/** @brief Set up an option index for a protected CoAP message
+ *
+ * @param[out] index Caller-allocated (previously uninitialized) index
+ * @param[in] entries Memory to store option locations in
+ * @param[in] capacity Number of options that fit in @p entries
+ *
+ * The index is not populated until it is first used with a message.
+ */
+OSCORE_NONNULL
+void oscore_msg_protected_optindex_init(
+        oscore_msg_protected_optindex_t *index,
+        struct oscore_msg_protected_optindex_entry *entries,
+        size_t capacity
+        );
+
+/** @brief Find an option in a protected CoAP message
+ *
+ * @param[in] msg Message to search in
+ * @param[inout] index Option index of @p msg. It must only ever be used with
+ *     one message.
+ * @param[in] option_number Option number to look for
+ * @param[in] occurrence Index inside the list of options of the same option
+ *     number to find (starting at zero)
+ * @param[out] value Data inside the found option
+ * @param[out] value_len Number of bytes inside the found option
+ *
+ * @return true if the option was found
+ *
+ * Like @ref oscore_msg_protected_optiter_next, this reports inner and outer
+ * options alike. If the message's options could not be read completely, this
+ * only finds options before the erroneous one; use @ref
+ * oscore_msg_protected_optindex_status to tell absent options from such
+ * errors.
+ */
+OSCORE_NONNULL
+bool oscore_msg_protected_find_option(
+        oscore_msg_protected_t *msg,
+        oscore_msg_protected_optindex_t *index,
+        uint16_t option_number,
+        size_t occurrence,
+        const uint8_t **value,
+        size_t *value_len
+        );
+
+/** @brief Report whether all options of a message could be read
+ *
+ * @param[in] msg Message indexed by @p index
+ * @param[inout] index Option index of @p msg
+ *
+ * @return The error that @ref oscore_msg_protected_optiter_finish reported
+ * when @p index was populated
+ */
+OSCORE_NONNULL
+oscore_msgerr_protected_t oscore_msg_protected_optindex_status(
+        oscore_msg_protected_t *msg,
+        oscore_msg_protected_optindex_t *index
+        );
+
 /** @brief Provide address and size information to writable payload
  *
  * @param[inout] msg Message whose payload is accessed
@@ -399,9 +683,253 @@ oscore_msgerr_protected_t oscore_msg_protected_trim_payload(
         size_t payload_len
         );
 
+/** @brief Determine how much payload fits into a message being written
+ *
+ * @param[inout] msg Writable message to query
+ * @param[in] planned Options that are still to be added, sorted by option
+ *     number, in the form accepted by @ref oscore_msg_protected_append_options;
+ *     may be NULL if @p planned_count is 0
+ * @param[in] planned_count Number of elements in @p planned
+ * @param[out] payload_len Size of the payload that would be available through
+ *     @ref oscore_msg_protected_map_payload after adding the planned options
+ *
+ * This accounts for options already added, for the OSCORE and inner
+ * Observe options that are still pending, for the planned options, and for
+ * the tag. It does not alter the message.
+ *
+ * Outer options are assumed to take space in the backend's payload buffer,
+ * as they do in the serialized CoAP message; on backends that store options
+ * elsewhere, the actual payload size will be larger.
+ *
+ * @return OK if @p payload_len was set, MESSAGESIZE if the planned options
+ * do not fit into the message, or the error that adding the planned options
+ * would cause.
+ */
+oscore_msgerr_protected_t oscore_msg_protected_plan_payload(
+        oscore_msg_protected_t *msg,
+        const struct oscore_msg_protected_option *planned,
+        size_t planned_count,
+        size_t *payload_len
+        );
+
+/** @brief Largest block size that fits into a given payload length
+ *
+ * @param[in] payload_len Available payload, eg. as obtained from @ref
+ *     oscore_msg_protected_plan_payload
+ * @return The largest SZX value (as used in the Block1 and Block2 options,
+ * from 0 to 6) whose block size `16 << SZX` is at most @p payload_len. If not
+ * even a block of 16 bytes fits, 0 is returned nonetheless.
+ *
+ * As the length of an encoded Block option depends on the block number and
+ * thus on the block size, it is best planned with the smallest block size
+ * under consideration.
+ */
+uint8_t oscore_msg_protected_largest_szx(size_t payload_len);
+
+/** @brief Encode a message template
+ *
+ * @param[out] tpl Caller-allocated (previously uninitialized) template
+ * @param[in] code Inner code of the message
+ * @param[in] options Inner options of the message, sorted by option number;
+ *     may be NULL if @p count is 0
+ * @param[in] count Number of elements in @p options
+ * @param[in] payload Inner payload of the message; may be NULL if @p
+ *     payload_len is 0
+ * @param[in] payload_len Number of bytes in @p payload
+ *
+ * Only Class E options can be part of a template. The Observe option can be
+ * included as well; it then stands for the inner Observe option, whose outer
+ * counterpart is added to each message individually (see @ref
+ * oscore_msg_protected_apply_template).
+ *
+ * @return OK on success, NOTIMPLEMENTED_ERROR if any of the options is not
+ * a Class E option or Observe, OPTION_SEQUENCE if the options are not sorted,
+ * or MESSAGESIZE if the content does not fit into @ref
+ * OSCORE_MSG_PROTECTED_TEMPLATE_MAXLEN bytes.
+ */
+oscore_msgerr_protected_t oscore_msg_protected_template_build(
+        oscore_msg_protected_template_t *tpl,
+        uint8_t code,
+        const struct oscore_msg_protected_option *options,
+        size_t count,
+        const uint8_t *payload,
+        size_t payload_len
+        );
+
+/** @brief Write a template's content into a message
+ *
+ * @param[inout] msg Message freshly obtained from @ref oscore_prepare_request
+ *     or @ref oscore_prepare_response, to which only outer options were
+ *     written yet
+ * @param[in] tpl Template built with @ref
+ *     oscore_msg_protected_template_build
+ *
+ * This sets the code, options and payload of @p msg, and trims it to them.
+ * The message can then be passed to @ref oscore_encrypt_message; it must not
+ * be altered any more before that. Attempts to append further inner options
+ * fail with INVALID_ARG_ERROR.
+ *
+ * If an Observe option was appended to @p msg before, the template needs to
+ * contain the matching inner Observe option.
+ *
+ * @return OK on success, MESSAGESIZE if the content does not fit into the
+ * message, or INVALID_ARG_ERROR if an Observe option was appended but the
+ * template lacks it.
+ */
+OSCORE_NONNULL
+oscore_msgerr_protected_t oscore_msg_protected_apply_template(
+        oscore_msg_protected_t *msg,
+        const oscore_msg_protected_template_t *tpl
+        );
+
 /** Return true if an error type indicates an unsuccessful operation */
 bool oscore_msgerr_protected_is_error(oscore_msgerr_protected_t);
 
+/** @brief Number of options that can be registered with @ref
+ * oscore_option_register_class
+ *
+ * This can be overridden at build time; it needs to be at least 1.
+ */
+#ifndef OSCORE_OPTION_REGISTRY_SIZE
+#define OSCORE_OPTION_REGISTRY_SIZE 4
+#endif
+
+/** @brief Protection classes an application can assign to options */
+enum oscore_option_class {
+    /** Encrypted option. Outer options of this number make the message
+     * unreadable. */
+    OSCORE_OPTION_CLASS_E,
+    /** Encrypted option. Outer options of this number are ignored when
+     * reading. */
+    OSCORE_OPTION_CLASS_E_IGNORE_OUTER,
+    /** Unprotected option */
+    OSCORE_OPTION_CLASS_U,
+    /** Integrity protected option. These are sent as outer options, and
+     * included in the AAD. */
+    OSCORE_OPTION_CLASS_I,
+};
+
+/** @brief Assign a protection class to an option number
+ *
+ * @param[in] option_number Option number to classify
+ * @param[in] option_class Class the option should be processed as
+ *
+ * @return true if the class was assigned; false if the option is one of those
+ * known to the library (whose classification can not be changed), the
+ * requested class is not supported, or the registry is full (see @ref
+ * OSCORE_OPTION_REGISTRY_SIZE).
+ *
+ * Options that are neither known to the library nor registered are treated as
+ * Class E, as RFC8613 requires. When read from the outer message, unknown
+ * critical options make the message unreadable, and unknown elective options
+ * are ignored.
+ *
+ * The registry is global to the library. Registrations must be done before
+ * any messages are processed, as they are not synchronized with concurrent
+ * message processing; they should not be changed later either, as that would
+ * change how messages are protected.
+ */
+bool oscore_option_register_class(
+        uint16_t option_number,
+        enum oscore_option_class option_class
+        );
+
+/** @brief Determine whether an intermediary may alter an outer option
+ *
+ * @param[in] option_number Option number to check
+ *
+ * @return true for options whose outer occurrences are not protected by
+ * OSCORE (Class U options, the outer Observe option, and Class E options
+ * whose outer occurrences are ignored, like Max-Age); false for options that
+ * can not be altered without breaking the protected message (like the OSCORE
+ * option, Class I options or Class E options that are invalid outside).
+ */
+bool oscore_option_is_outer_mutable(uint16_t option_number);
+
+/** @brief Encoded size of a message's Class I options
+ *
+ * @param[in] msg Native message whose outer options are considered
+ *
+ * @return Number of bytes the Class I options of @p msg take in the AAD,
+ * encoded as CoAP options with deltas relative to the previous Class I
+ * option (RFC8613 Section 5.4).
+ *
+ * As long as no Class I options are registered with @ref
+ * oscore_option_register_class, this returns 0 without looking at the
+ * message.
+ */
+size_t oscore_option_class_i_length(oscore_msg_native_t msg);
+
+/** @brief Feed a message's encoded Class I options into an AEAD operation
+ *
+ * @param[in] msg Native message whose outer options are considered
+ * @param[in] feeder @ref oscore_crypto_aead_encrypt_feed_aad or @ref oscore_crypto_aead_decrypt_feed_aad
+ * @param[inout] state State to pass to @p feeder
+ * @param[inout] err Non-error value on entry; set to the result of the last
+ *     @p feeder call (feeding stops at the first error)
+ *
+ * This feeds exactly the @ref oscore_option_class_i_length bytes of the
+ * message, and does not look at the message either when that is guaranteed
+ * to be 0.
+ */
+void oscore_option_class_i_feed(
+        oscore_msg_native_t msg,
+        oscore_cryptoerr_t (*feeder)(void *, const uint8_t *, size_t),
+        void *state,
+        oscore_cryptoerr_t *err
+        );
+
+/** @brief Callback for @ref oscore_msg_outer_rewrite
+ *
+ * @param[in] arg Argument passed to @ref oscore_msg_outer_rewrite
+ * @param[in] option_number Number of an outer option in the source message
+ * @param[inout] value Value of the option; can be pointed to a replacement
+ *     value that needs to stay valid until the rewrite is complete
+ * @param[inout] value_len Length of @p value; can be altered along with it
+ *
+ * @return false if the option is to be removed from the message
+ */
+typedef bool (*oscore_msg_outer_filter_t)(
+        void *arg,
+        uint16_t option_number,
+        const uint8_t **value,
+        size_t *value_len
+        );
+
+/** @brief Copy a protected message while altering its outer options
+ *
+ * @param[in] source Protected message as received
+ * @param[inout] destination Empty message to build the altered copy in
+ * @param[in] filter Function to decide about all options of @p source for
+ *     which @ref oscore_option_is_outer_mutable is true; may be NULL to keep
+ *     them all
+ * @param[in] filter_arg Argument passed to @p filter
+ * @param[in] added Options to add, sorted by option number; may be NULL if
+ *     @p added_count is 0
+ * @param[in] added_count Number of elements in @p added
+ *
+ * This copies the code, the options and the ciphertext of a protected
+ * message without decrypting it, as a forward proxy or load balancer would
+ * when it changes Class U options like Uri-Host or Proxy-Scheme, or the outer
+ * Max-Age option. No security context is involved.
+ *
+ * Options that can not be altered are copied unconditionally. Added options
+ * are placed after any options of the same number in @p source.
+ *
+ * @return OK on success; INVALID_ARG_ERROR if any of the @p added options is
+ * not mutable, OPTION_SEQUENCE if they are not sorted, MESSAGESIZE if the
+ * ciphertext does not fit into @p destination, or NATIVE_ERROR if any of the
+ * backend operations failed.
+ */
+oscore_msgerr_protected_t oscore_msg_outer_rewrite(
+        oscore_msg_native_t source,
+        oscore_msg_native_t destination,
+        oscore_msg_outer_filter_t filter,
+        void *filter_arg,
+        const struct oscore_msg_protected_option *added,
+        size_t added_count
+        );
+
 /** @} */
 
 #endif
@@ -194,6 +194,206 @@ enum oscore_unprotect_request_result oscore_unprotect_request(
         oscore_requestid_t *request_id
         );
 
+/** @brief Request message decryption into a separate buffer
+ *
+ * This is equivalent to @ref oscore_unprotect_request, except that the
+ * plaintext is written into @p plaintext instead of into the payload of @p
+ * protected, which is not altered and may thus reside in read-only or shared
+ * memory.
+ *
+ * @param[in] protected A received request message
+ * @param[out] unprotected A pre-allocated, uninitialized @ref oscore_msg_protected_t that will be made available on success
+ * @param[in] header An @ref oscore_oscoreoption_t extracted from `message`
+ * @param[inout] secctx The security context with which to decrypt (and by which to validate) the message
+ * @param[out] request_id An uninitialized request ID that can later be used to protect the response
+ * @param[out] plaintext Buffer to hold the plaintext; it needs to stay valid as long as @p unprotected is used
+ * @param[in] plaintext_len Size of @p plaintext. Unprotection fails if it is shorter than the payload of @p protected minus the AEAD tag.
+ *
+ * Messages unprotected this way can not be stored using @ref
+ * oscore_msg_protected_compact.
+ */
+OSCORE_NONNULL
+enum oscore_unprotect_request_result oscore_unprotect_request_outofplace(
+        oscore_msg_native_t protected,
+        oscore_msg_protected_t *unprotected,
+        const oscore_oscoreoption_t *header,
+        oscore_context_t *secctx,
+        oscore_requestid_t *request_id,
+        uint8_t *plaintext,
+        size_t plaintext_len
+        );
+
+/** @brief Request message decryption that keeps the request's part of the AAD
+ *
+ * This is equivalent to @ref oscore_unprotect_request, except that the parts
+ * of the AAD that responses to this request share with it are stored in @p
+ * request_aad. Passing that to @ref oscore_prepare_response_aad spares
+ * building them again for each response.
+ *
+ * @param[in] protected A received request message
+ * @param[out] unprotected A pre-allocated, uninitialized @ref oscore_msg_protected_t that will be made available on success
+ * @param[in] header An @ref oscore_oscoreoption_t extracted from `message`
+ * @param[inout] secctx The security context with which to decrypt (and by which to validate) the message
+ * @param[out] request_id An uninitialized request ID that can later be used to protect the response
+ * @param[out] request_aad Storage for the request dependent part of the AAD; it is populated when the result is @ref OSCORE_UNPROTECT_REQUEST_OK or @ref OSCORE_UNPROTECT_REQUEST_DUPLICATE
+ */
+OSCORE_NONNULL
+enum oscore_unprotect_request_result oscore_unprotect_request_aad(
+        oscore_msg_native_t protected,
+        oscore_msg_protected_t *unprotected,
+        const oscore_oscoreoption_t *header,
+        oscore_context_t *secctx,
+        oscore_requestid_t *request_id,
+        oscore_request_aad_t *request_aad
+        );
+
+/** @brief Request message decryption with several candidate security contexts
+ *
+ * This is equivalent to @ref oscore_unprotect_request, but tries each of
+ * the @p candidates in turn until one decrypts the message. It is useful
+ * when the KID (and KID context) of a request do not identify a single
+ * security context.
+ *
+ * Candidates whose recipient ID differs from the request's KID, or whose ID
+ * context differs from the request's KID context (if it has one), are
+ * skipped without decryption. Each remaining attempt decrypts into @p scratch, so
+ * that the payload of @p protected stays intact for the next one; only the
+ * successful attempt's plaintext is moved into it. Likewise, only the
+ * matching context's replay window is updated.
+ *
+ * @param[in] protected A received request message
+ * @param[out] unprotected A pre-allocated, uninitialized @ref oscore_msg_protected_t that will be made available on success
+ * @param[in] header An @ref oscore_oscoreoption_t extracted from `message`
+ * @param[inout] candidates Security contexts to try, in order of preference
+ * @param[in] candidates_count Number of elements in @p candidates
+ * @param[out] matched Index of the context in @p candidates that decrypted
+ *     the message; it is only set when the result is @ref
+ *     OSCORE_UNPROTECT_REQUEST_OK or @ref OSCORE_UNPROTECT_REQUEST_DUPLICATE,
+ *     and that context is then the one to use for the response.
+ * @param[out] request_id An uninitialized request ID that can later be used to protect the response
+ * @param[out] scratch Buffer for the plaintext of the attempts; it is not
+ *     used any more when this function returns
+ * @param[in] scratch_len Size of @p scratch. Unprotection fails if it is
+ *     shorter than the payload of @p protected minus the AEAD tag.
+ */
+OSCORE_NONNULL
+enum oscore_unprotect_request_result oscore_unprotect_request_trial(
+        oscore_msg_native_t protected,
+        oscore_msg_protected_t *unprotected,
+        const oscore_oscoreoption_t *header,
+        oscore_context_t *const *candidates,
+        size_t candidates_count,
+        size_t *matched,
+        oscore_requestid_t *request_id,
+        uint8_t *scratch,
+        size_t scratch_len
+        );
+
+/** @brief Callback that finds the security context for an incoming request
+ *
+ * @param[in] state The @p lookup_state passed to @ref oscore_demux_request
+ * @param[in] kid KID of the request; NULL if the request carries none
+ * @param[in] kid_len Length of @p kid
+ * @param[in] kid_context KID context of the request; NULL if the request
+ *     carries none
+ * @param[in] kid_context_len Length of @p kid_context
+ *
+ * @return The security context whose recipient sent the request, or NULL if
+ * there is none.
+ */
+typedef oscore_context_t *(*oscore_context_lookup_t)(
+        void *state,
+        const uint8_t *kid,
+        size_t kid_len,
+        const uint8_t *kid_context,
+        size_t kid_context_len
+        );
+
+/** @brief Results of @ref oscore_demux_request
+ *
+ * Users of the library should only distinguish these to the extent they
+ * need; additional rejection reasons may be introduced.
+ */
+enum oscore_demux_result {
+    /** The request can be unprotected with @ref oscore_unprotect_demuxed */
+    OSCORE_DEMUX_OK,
+    /** The request has no OSCORE option */
+    OSCORE_DEMUX_NOT_OSCORE,
+    /** The OSCORE option is malformed, repeated, or lacks the Partial IV
+     * every request needs */
+    OSCORE_DEMUX_MALFORMED,
+    /** No security context was found for the request's KID and KID context */
+    OSCORE_DEMUX_UNKNOWN_KID,
+    /** The request's Partial IV was already used in the context; this is
+     * what @ref oscore_unprotect_request would report as @ref
+     * OSCORE_UNPROTECT_REQUEST_DUPLICATE after decrypting it */
+    OSCORE_DEMUX_REPLAY,
+};
+
+/** @brief Incoming request whose security context was determined
+ *
+ * This is populated by @ref oscore_demux_request. It points into the
+ * request's options, and is only valid as long as the request is not
+ * altered or moved.
+ */
+typedef struct {
+    /** OSCORE option of the request */
+    oscore_oscoreoption_t header;
+    /** Security context found for the request; NULL unless the request
+     * passed the lookup */
+    oscore_context_t *secctx;
+} oscore_demux_t;
+
+/** @brief Check an incoming request before decrypting it
+ *
+ * This finds and parses the request's OSCORE option, looks up the security
+ * context through @p lookup, and checks the request's Partial IV against the
+ * context's replay window without altering it (see @ref
+ * oscore_context_is_replay). Requests that fail any of these steps are
+ * rejected without any cryptographic operation.
+ *
+ * @param[in] protected A received request message
+ * @param[in] lookup Callback that maps the request's KID and KID context to a
+ *     security context
+ * @param[in] lookup_state Argument passed to @p lookup
+ * @param[out] demux Pre-allocated, uninitialized storage for the result
+ *
+ * On @ref OSCORE_DEMUX_REPLAY, the context in @p demux is populated, so
+ * applications can still pass the request on to @ref oscore_unprotect_demuxed.
+ * Nothing about the request is authenticated at this point: anyone can send
+ * a message with a KID and Partial IV they observed. A cached response (see
+ * @ref oscore_response_cache) must therefore only be sent after @ref
+ * oscore_unprotect_demuxed returned @ref OSCORE_UNPROTECT_REQUEST_DUPLICATE,
+ * never on the demux result alone.
+ */
+OSCORE_NONNULL
+enum oscore_demux_result oscore_demux_request(
+        oscore_msg_native_t protected,
+        oscore_context_lookup_t lookup,
+        void *lookup_state,
+        oscore_demux_t *demux
+        );
+
+/** @brief Request message decryption after @ref oscore_demux_request
+ *
+ * This is equivalent to @ref oscore_unprotect_request with the header and
+ * security context found by @ref oscore_demux_request. The replay window is
+ * only updated here, after the request was decrypted successfully.
+ *
+ * @param[in] protected The request message that was passed to @ref oscore_demux_request
+ * @param[out] unprotected A pre-allocated, uninitialized @ref oscore_msg_protected_t that will be made available on success
+ * @param[in] demux Result of a @ref oscore_demux_request call that returned
+ *     @ref OSCORE_DEMUX_OK or @ref OSCORE_DEMUX_REPLAY
+ * @param[out] request_id An uninitialized request ID that can later be used to protect the response
+ */
+OSCORE_NONNULL
+enum oscore_unprotect_request_result oscore_unprotect_demuxed(
+        oscore_msg_native_t protected,
+        oscore_msg_protected_t *unprotected,
+        const oscore_demux_t *demux,
+        oscore_requestid_t *request_id
+        );
+
 /** @brief Results of unprotect response operations
  *
  * This is different from @ref oscore_unprotect_request_result in that no
@@ -233,6 +433,31 @@ enum oscore_unprotect_response_result oscore_unprotect_response(
         oscore_requestid_t *request_id
         );
 
+/** @brief Response message decryption into a separate buffer
+ *
+ * This is equivalent to @ref oscore_unprotect_response, except that the
+ * plaintext is written into @p plaintext as described for @ref
+ * oscore_unprotect_request_outofplace.
+ *
+ * @param[in] protected A received message
+ * @param[out] unprotected A pre-allocated, uninitialized @ref oscore_msg_protected_t that will be made available on success
+ * @param[in] header An @ref oscore_oscoreoption_t extracted from `message`
+ * @param[inout] secctx The security context with which to decrypt (and by which to validate) the message
+ * @param[in] request_id Matching information from the protect step of the request message.
+ * @param[out] plaintext Buffer to hold the plaintext; it needs to stay valid as long as @p unprotected is used
+ * @param[in] plaintext_len Size of @p plaintext
+ */
+OSCORE_NONNULL
+enum oscore_unprotect_response_result oscore_unprotect_response_outofplace(
+        oscore_msg_native_t protected,
+        oscore_msg_protected_t *unprotected,
+        const oscore_oscoreoption_t *header,
+        oscore_context_t *secctx,
+        oscore_requestid_t *request_id,
+        uint8_t *plaintext,
+        size_t plaintext_len
+        );
+
 /** @brief Free a native message from a protected message's control
  *
  * This relinquishes an @ref oscore_msg_protected_t's hold on a native message
@@ -263,6 +488,10 @@ enum oscore_prepare_result {
     // There may be a future distinction between temporary ("Can't send yet,
     // flash write not completed yet") and permanent failures
     OSCORE_PREPARE_SECCTX_UNAVAILABLE,
+    /** A key for the message could not be derived */
+    OSCORE_PREPARE_ERROR_CRYPTO,
+    /** The message's code can not be sent in this kind of message */
+    OSCORE_PREPARE_ERROR_METHOD,
 };
 
 /** @brief Response message preparation
@@ -291,6 +520,27 @@ enum oscore_prepare_result oscore_prepare_response(
         oscore_requestid_t *request_id
         );
 
+/** @brief Response message preparation with the request's part of the AAD
+ *
+ * This is equivalent to @ref oscore_prepare_response, except that the request
+ * dependent part of the response's AAD is taken from @p request_aad instead of
+ * being built again when the message is encrypted.
+ *
+ * @param[in] protected An allocated message into which the operations on @p unprotected can write
+ * @param[in] unprotected A pre-allocated, uninititialized @ref oscore_msg_protected_t that the message can be written to
+ * @param[inout] secctx A security context used to protect the message, which a sequence number will be taken from on demand
+ * @param[inout] request_id The request ID of the incoming message, as in @ref oscore_prepare_response
+ * @param[in] request_aad Request dependent AAD obtained along with @p request_id from @ref oscore_unprotect_request_aad. It needs to stay valid until the message is encrypted.
+ */
+OSCORE_NONNULL
+enum oscore_prepare_result oscore_prepare_response_aad(
+        oscore_msg_native_t protected,
+        oscore_msg_protected_t *unprotected,
+        oscore_context_t *secctx,
+        oscore_requestid_t *request_id,
+        const oscore_request_aad_t *request_aad
+        );
+
 /** @brief Request message preparation
  *
  * Start building a message for encryption with a given security context.
@@ -376,6 +626,206 @@ enum oscore_finish_result oscore_encrypt_message(
         oscore_msg_native_t *protected
         );
 
+/** @brief Deterministic request preparation
+ *
+ * Start building a request as a deterministic client. All clients that share
+ * @p secctx produce the same protected request when they send the same
+ * content, so proxies can cache the response for all of them.
+ *
+ * This follows the idea of the cacheable OSCORE draft
+ * (draft-amsuess-core-cachable-oscore), but not its construction: the crypto
+ * backends provide no hash function, so hash and key are derived with HKDF in
+ * a scheme private to this library, and only interoperate with peers that
+ * use this library:
+ *
+ * * The request hash is HKDF with the client's key as salt, the encoded inner
+ *   code, options and payload as input keying material, and the request
+ *   dependent part of the AAD (see @ref oscore_request_aad_t) as info.
+ * * The request's key is HKDF with the client's key as salt, the request hash
+ *   as input keying material, and "Key" as info.
+ *
+ * Instead of taking a sequence number, the request always uses Partial IV 0.
+ * It is protected with the request's key, and the hash is sent in the
+ * Request-Hash option. As the hash is needed before the message is written,
+ * the content is given as a template up front.
+ *
+ * After this, outer options (eg. Uri-Host or Proxy-Scheme) can be appended,
+ * and then @p tpl must be applied with @ref
+ * oscore_msg_protected_apply_template before the message is encrypted. The
+ * outer code is FETCH. The hash only covers the template's content, so the
+ * inner code, options and payload must not be altered in any other way:
+ * appending inner options fails with INVALID_ARG_ERROR.
+ *
+ * @param[in] protected An allocated message into which the operations on @p unprotected can write
+ * @param[in] unprotected A pre-allocated, uninititialized @ref oscore_msg_protected_t that the message can be written to
+ * @param[inout] secctx The deterministic client's security context
+ * @param[out] request_id An uninitialized request ID that can later be used to verify the response
+ * @param[in] tpl Code, inner options and payload of the request
+ * @param[in] hkdfalg HKDF algorithm of @p secctx
+ * @param[out] deterministic Storage for the request hash and key. It needs to
+ *     stay valid until the message is encrypted, and is needed again for @ref
+ *     oscore_unprotect_response_deterministic.
+ *
+ * @return OSCORE_PREPARE_OK on success, OSCORE_PREPARE_ERROR_METHOD if the
+ * code of @p tpl is not GET or FETCH, or OSCORE_PREPARE_ERROR_CRYPTO if the
+ * hash or the key could not be derived.
+ *
+ * Deterministic requests are not protected against replay, so they are only
+ * available for the safe methods GET and FETCH.
+ */
+OSCORE_NONNULL
+enum oscore_prepare_result oscore_prepare_request_deterministic(
+        oscore_msg_native_t protected,
+        oscore_msg_protected_t *unprotected,
+        oscore_context_t *secctx,
+        oscore_requestid_t *request_id,
+        const oscore_msg_protected_template_t *tpl,
+        oscore_crypto_hkdfalg_t hkdfalg,
+        oscore_deterministic_t *deterministic
+        );
+
+/** @brief Unprotect a deterministic request
+ *
+ * This is the counterpart of @ref oscore_prepare_request_deterministic on
+ * the server, and otherwise behaves like @ref oscore_unprotect_request.
+ *
+ * The request must carry a Request-Hash option, and is only accepted if its
+ * content matches the hash. As deterministic requests are repeated by design,
+ * they are never reported as duplicates and do not alter the replay window;
+ * requests whose inner code is not GET or FETCH are therefore rejected as
+ * invalid.
+ *
+ * @param[in] protected The message to unprotect
+ * @param[out] unprotected A pre-allocated, uninitialized @ref oscore_msg_protected_t that will be made available on success
+ * @param[in] header An @ref oscore_oscoreoption_t extracted from `message`
+ * @param[inout] secctx The security context whose recipient is the deterministic client
+ * @param[out] request_id An uninitialized request ID that can later be used to protect the response
+ * @param[in] hkdfalg HKDF algorithm of @p secctx
+ * @param[out] deterministic Storage for the request hash and key, which are
+ *     needed again for @ref oscore_prepare_response_deterministic
+ */
+OSCORE_NONNULL
+enum oscore_unprotect_request_result oscore_unprotect_request_deterministic(
+        oscore_msg_native_t protected,
+        oscore_msg_protected_t *unprotected,
+        const oscore_oscoreoption_t *header,
+        oscore_context_t *secctx,
+        oscore_requestid_t *request_id,
+        oscore_crypto_hkdfalg_t hkdfalg,
+        oscore_deterministic_t *deterministic
+        );
+
+/** @brief Response message preparation for a deterministic request
+ *
+ * This is equivalent to @ref oscore_prepare_response, except that the
+ * response is protected with the key of the deterministic request. It always
+ * carries a Partial IV of its own.
+ *
+ * @param[in] protected An allocated message into which the operations on @p unprotected can write
+ * @param[in] unprotected A pre-allocated, uninititialized @ref oscore_msg_protected_t that the message can be written to
+ * @param[inout] secctx The security context the request was unprotected with
+ * @param[inout] request_id The request ID of the incoming message
+ * @param[in] deterministic Hash and key obtained from @ref
+ *     oscore_unprotect_request_deterministic; it needs to stay valid until
+ *     the message is encrypted.
+ */
+OSCORE_NONNULL
+enum oscore_prepare_result oscore_prepare_response_deterministic(
+        oscore_msg_native_t protected,
+        oscore_msg_protected_t *unprotected,
+        oscore_context_t *secctx,
+        oscore_requestid_t *request_id,
+        const oscore_deterministic_t *deterministic
+        );
+
+/** @brief Unprotect the response to a deterministic request
+ *
+ * This is equivalent to @ref oscore_unprotect_response, except that the
+ * response is decrypted with the key of the deterministic request. Responses
+ * without a Partial IV are rejected.
+ *
+ * @param[in] protected The message to unprotect
+ * @param[out] unprotected A pre-allocated, uninitialized @ref oscore_msg_protected_t that will be made available on success
+ * @param[in] header An @ref oscore_oscoreoption_t extracted from `message`
+ * @param[inout] secctx The deterministic client's security context
+ * @param[in] request_id The request ID obtained when preparing the request
+ * @param[in] deterministic Hash and key obtained from @ref
+ *     oscore_prepare_request_deterministic
+ */
+OSCORE_NONNULL
+enum oscore_unprotect_response_result oscore_unprotect_response_deterministic(
+        oscore_msg_native_t protected,
+        oscore_msg_protected_t *unprotected,
+        const oscore_oscoreoption_t *header,
+        oscore_context_t *secctx,
+        oscore_requestid_t *request_id,
+        const oscore_deterministic_t *deterministic
+        );
+
+/** @brief Results of protecting a message for a single target of @ref
+ * oscore_protect_fanout */
+enum oscore_fanout_result {
+    /** The message was protected and can be sent */
+    OSCORE_FANOUT_OK,
+    /** The target's security context could not provide a sequence number */
+    OSCORE_FANOUT_SECCTX_UNAVAILABLE,
+    /** The Observe option or the template's content did not fit into the
+     * target's message */
+    OSCORE_FANOUT_ERROR_MESSAGE,
+    /** Encryption failed, see @ref oscore_finish_result */
+    OSCORE_FANOUT_ERROR_CRYPTO,
+};
+
+/** @brief A single response built by @ref oscore_protect_fanout */
+struct oscore_fanout_target {
+    /** Allocated native message the response is written into */
+    oscore_msg_native_t message;
+    /** Security context the request was received on */
+    oscore_context_t *secctx;
+    /** Request ID of the request; as in @ref oscore_prepare_response, this is
+     * typically a clone kept from the request (eg. of an observation) */
+    oscore_requestid_t *request_id;
+    /** Request dependent part of the AAD (see @ref
+     * oscore_prepare_response_aad), or NULL if it is to be built */
+    const oscore_request_aad_t *request_aad;
+    /** Outcome for this target, set by @ref oscore_protect_fanout */
+    enum oscore_fanout_result result;
+};
+
+/** @brief Protect the same response for many requests
+ *
+ * @param[in] tpl Content of the response, see @ref
+ *     oscore_msg_protected_template_build
+ * @param[in] outer_observe Value of the outer Observe option, or NULL if no
+ *     Observe option is to be sent
+ * @param[in] outer_observe_len Length of @p outer_observe
+ * @param[inout] targets Messages to build, along with the requests they
+ *     respond to
+ * @param[in] count Number of elements in @p targets
+ *
+ * This is intended for sending the same notification to many observers: The
+ * inner plaintext is rendered only once into @p tpl, and each target only
+ * takes a sequence number, writes its outer options, copies the plaintext and
+ * runs the AEAD operation. If an Observe option is sent, @p tpl needs to
+ * contain the inner Observe option.
+ *
+ * @return The number of targets whose result is @ref OSCORE_FANOUT_OK
+ *
+ * Failing targets do not stop the others from being processed; their
+ * messages may be in any state and must not be sent.
+ *
+ * The targets are processed independently of each other, so a long list can
+ * be split up and processed in parallel, provided that the threads do not
+ * share security contexts (see @ref design_thread).
+ */
+size_t oscore_protect_fanout(
+        const oscore_msg_protected_template_t *tpl,
+        const uint8_t *outer_observe,
+        size_t outer_observe_len,
+        struct oscore_fanout_target *targets,
+        size_t count
+        );
+
 /** @} */
 
 #endif
@@ -0,0 +1,149 @@
+#ifndef OSCORE_RESPONSE_CACHE_H
+#define OSCORE_RESPONSE_CACHE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <oscore/helpers.h>
+#include <oscore/contextpair.h>
+#include <oscore_native/message.h>
+
+/** @file */
+
+/** @ingroup oscore_api
+ *
+ * @addtogroup oscore_response_cache Cache of protected responses
+ *
+ * @brief Answer retransmitted requests without processing them again
+ *
+ * When a request is received a second time, eg. because the response to a
+ * confirmable request got lost, @ref oscore_unprotect_request reports it as
+ * @ref OSCORE_UNPROTECT_REQUEST_DUPLICATE. Rather than running the handler
+ * again and protecting a new response, a server can keep the protected
+ * responses it sent in this cache, and send a copy of the original response.
+ *
+ * Entries are looked up by the security context and the Partial IV of the
+ * request. Only the code, options and payload of the protected (outer)
+ * message are stored; message ID and token are left to the CoAP library.
+ *
+ * The cache is bounded by the number of entries the application provides;
+ * when it is full, the oldest entry is replaced.
+ *
+ * @{
+ */
+
+/** @brief Space for a single protected response in the cache
+ *
+ * Responses whose code, options and payload take more than this many bytes
+ * (with 4 bytes of overhead per option) are not cached.
+ *
+ * This can be overridden at build time.
+ */
+#ifndef OSCORE_RESPONSE_CACHE_MAXLEN
+#define OSCORE_RESPONSE_CACHE_MAXLEN 128
+#endif
+
+/** @brief Storage for a single cached response
+ *
+ * All fields are private; entries are initialized by @ref
+ * oscore_response_cache_init.
+ */
+struct oscore_response_cache_entry {
+    /** @private Context the request was received on; its data is NULL if the entry is unused */
+    oscore_context_t secctx;
+    /** @private Number of bytes in @ref request_piv */
+    uint8_t request_piv_len;
+    /** @private Partial IV of the request, left-padded with zeros */
+    uint8_t request_piv[PIV_BYTES];
+    /** @private Number of bytes at the start of @ref data that are the code and options */
+    size_t payload_offset;
+    /** @private Number of populated bytes in @ref data */
+    size_t length;
+    /** @private Code, options and payload of the response */
+    uint8_t data[OSCORE_RESPONSE_CACHE_MAXLEN];
+};
+
+/** @brief A response cache
+ *
+ * All fields are private; the struct is initialized by @ref
+ * oscore_response_cache_init.
+ */
+struct oscore_response_cache {
+    /** @private Caller-provided storage for entries */
+    struct oscore_response_cache_entry *entries;
+    /** @private Number of elements at @ref entries */
+    size_t capacity;
+    /** @private Entry that is replaced next when no entry matches */
+    size_t next;
+};
+
+/** @brief Results of @ref oscore_response_cache_replay */
+enum oscore_response_cache_result {
+    /** The response was copied into the message */
+    OSCORE_RESPONSE_CACHE_HIT,
+    /** No response is cached for the request */
+    OSCORE_RESPONSE_CACHE_MISS,
+    /** A response is cached, but the message could not take it */
+    OSCORE_RESPONSE_CACHE_ERROR,
+};
+
+/** @brief Set up an empty cache
+ *
+ * @param[out] cache Cache to initialize
+ * @param[in] entries Storage for @p capacity entries; needs to stay valid as
+ *     long as @p cache is used
+ * @param[in] capacity Number of entries at @p entries; at least 1
+ */
+OSCORE_NONNULL
+void oscore_response_cache_init(
+        struct oscore_response_cache *cache,
+        struct oscore_response_cache_entry *entries,
+        size_t capacity
+        );
+
+/** @brief Keep a copy of a protected response
+ *
+ * @param[inout] cache Cache to store the response in
+ * @param[in] secctx Security context the request was unprotected with
+ * @param[in] request_id Request ID of the request, as obtained from @ref
+ *     oscore_unprotect_request
+ * @param[in] response Response message after @ref oscore_encrypt_message
+ *
+ * @return false if the response was not cached because it is too large, or
+ * its options could not be read
+ *
+ * A response previously stored for the same request is replaced. If storing
+ * fails, the entry that was to be replaced is dropped.
+ */
+OSCORE_NONNULL
+bool oscore_response_cache_store(
+        struct oscore_response_cache *cache,
+        const oscore_context_t *secctx,
+        const oscore_requestid_t *request_id,
+        oscore_msg_native_t response
+        );
+
+/** @brief Write a cached response for a duplicate request
+ *
+ * @param[in] cache Cache to look the response up in
+ * @param[in] secctx Security context the duplicate request was unprotected with
+ * @param[in] request_id Request ID of the duplicate request, as obtained
+ *     from an unprotect function that reported it as @ref
+ *     OSCORE_UNPROTECT_REQUEST_DUPLICATE
+ * @param[inout] response Freshly allocated native message to write the
+ *     cached code, options and payload into
+ *
+ * The copy is an exact copy of the protected response that was stored, and is
+ * sent without protecting it again. On a miss, @p response is left untouched.
+ */
+OSCORE_NONNULL
+enum oscore_response_cache_result oscore_response_cache_replay(
+        const struct oscore_response_cache *cache,
+        const oscore_context_t *secctx,
+        const oscore_requestid_t *request_id,
+        oscore_msg_native_t response
+        );
+
+/** @} */
+
+#endif
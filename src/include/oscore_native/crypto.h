@@ -217,6 +217,26 @@ oscore_cryptoerr_t oscore_crypto_aead_encrypt_inplace(
         size_t buffer_len
         );
 
+/** @brief Finish an AEAD encryption operation by encrypting a plaintext into a separate buffer
+ *
+ * @param[inout] state Encryption state use and finalize
+ * @param[in] plaintext Plaintext to encrypt; it is not altered
+ * @param[out] buffer Memory location to which the ciphertext and the tag are written
+ * @param[in] buffer_len Writable size of the buffer
+ *
+ * This is equivalent to copying the plaintext into @p buffer and calling @ref
+ * oscore_crypto_aead_encrypt_inplace, but can be implemented without the
+ * copy. @p plaintext is the ``plaintext_len`` given at setup long, and may not
+ * overlap @p buffer.
+ */
+OSCORE_NONNULL
+oscore_cryptoerr_t oscore_crypto_aead_encrypt_outofplace(
+        oscore_crypto_aead_encryptstate_t *state,
+        const uint8_t *plaintext,
+        uint8_t *buffer,
+        size_t buffer_len
+        );
+
 /** @brief Start an AEAD decryption operation
  *
  * This is fully analogous to @ref oscore_crypto_aead_encrypt_start; see there.
@@ -267,6 +287,28 @@ oscore_cryptoerr_t oscore_crypto_aead_decrypt_inplace(
         size_t buffer_len
         );
 
+/** @brief Finish an AEAD decryption operation by decrypting a buffer that holds ciphertext followed by tag into a separate buffer
+ *
+ * @param[inout] state Decryption state use and finalize
+ * @param[in] buffer Memory location in which the concatenation of ciphertext and tag is stored; it is not altered
+ * @param[in] buffer_len Readable size of the buffer
+ * @param[out] plaintext Memory location to which the plaintext is written
+ *
+ * This is analogous to @ref oscore_crypto_aead_decrypt_inplace, but leaves
+ * @p buffer untouched, so that it can be read-only or shared memory. @p
+ * plaintext has room for exactly the ``plaintext_len`` given at setup, and may
+ * not overlap @p buffer.
+ *
+ * If decryption fails, the content of @p plaintext is unspecified.
+ */
+OSCORE_NONNULL
+oscore_cryptoerr_t oscore_crypto_aead_decrypt_outofplace(
+        oscore_crypto_aead_decryptstate_t *state,
+        const uint8_t *buffer,
+        size_t buffer_len,
+        uint8_t *plaintext
+        );
+
 
 /** @brief Set up an algorithm descriptor from a numerically identified COSE
  * Direct Key with KDF
@@ -3,6 +3,12 @@
 #include <oscore_native/message.h>
 
 enum option_behavior {
+    /** Not a known option: this is only used in the lookup tables, and
+     * resolved to ONLY_E for critical and ONLY_E_IGNORE_OUTER for elective
+     * options by @ref get_option_behaviour, as options are Class E unless
+     * specified otherwise (RFC8613 Section 4.1). */
+    UNKNOWN = 0,
+
     /** Place this in Class E unconditionally, and refuse to decrypt messages
      * with this as an outer option
      *
@@ -45,39 +51,275 @@ enum option_behavior {
 
 };
 
+/** Number of option numbers covered by @ref option_table */
+#define OPTION_TABLE_SIZE 64
+
+/** Behavior of the options known to the library with small numbers, indexed
+ * by option number */
+static const uint8_t option_table[OPTION_TABLE_SIZE] = {
+    [1] = ONLY_E, // If-Match
+    [3] = PRIMARILY_U, // Uri-Host
+    [4] = ONLY_E_IGNORE_OUTER, // ETag
+    [5] = ONLY_E, // If-None-Match
+    [6] = HARDCODED, // Observe
+    [7] = PRIMARILY_U, // Uri-Port
+    [8] = ONLY_E, // Location-Path
+    [9] = HARDCODED, // OSCORE
+    [11] = ONLY_E, // Uri-Path
+    [12] = ONLY_E, // Content-Format
+    [14] = ONLY_E_IGNORE_OUTER, // Max-Age
+    [15] = ONLY_E, // Uri-Query
+    [17] = ONLY_E, // Accept
+    [20] = ONLY_E, // Location-Query
+    [23] = ONLY_E, // Block2
+    [27] = ONLY_E, // Block1
+    [28] = ONLY_E, // Size2
+    [35] = HARDCODED, // Proxy-Uri
+    [39] = PRIMARILY_U, // Proxy-Scheme
+    [60] = ONLY_E, // Size1
+};
+
+/** Behavior of the options known to the library with numbers beyond @ref
+ * option_table, sorted by option number */
+static const struct option_table_entry {
+    uint16_t number;
+    uint8_t behavior;
+} option_table_large[] = {
+    { 252, ONLY_E_IGNORE_OUTER }, // Echo
+    { 258, ONLY_E_IGNORE_OUTER }, // No-Response
+    { OSCORE_OPTNUM_REQUEST_HASH, PRIMARILY_U }, // Request-Hash
+};
+
+/** Options registered by the application at runtime */
+static struct option_table_entry option_registry[OSCORE_OPTION_REGISTRY_SIZE];
+/** Number of populated entries in @ref option_registry */
+static size_t option_registry_used;
+/** Number of entries in @ref option_registry that are Class I
+ *
+ * None of the built-in options are Class I, so while this is 0, messages need
+ * not be searched for Class I options. */
+static size_t option_registry_class_i;
+
+/** Look up an option's behavior in the built-in tables */
+static enum option_behavior builtin_option_behaviour(uint16_t option_number) {
+    if (option_number < OPTION_TABLE_SIZE) {
+        return option_table[option_number];
+    }
+    for (size_t i = 0; i < sizeof(option_table_large) / sizeof(option_table_large[0]); ++i) {
+        if (option_table_large[i].number >= option_number) {
+            return option_table_large[i].number == option_number ?
+                    option_table_large[i].behavior : UNKNOWN;
+        }
+    }
+    return UNKNOWN;
+}
+
 /**
  * Returns the behaviour (U, I, E, special) for a given option number.
  */
 static enum option_behavior get_option_behaviour(uint16_t option_number) {
-    switch (option_number) {
-        case 1: // If-Match
-        case 5: // If-None-Match
-        case 8: // Location-Path
-        case 11: // Uri-Path
-        case 12: // Content-Format
-        case 15: // Uri-Query
-        case 17: // Accept
-        case 20: // Location-Query
-        case 23: // Block2
-        case 27: // Block1
-        case 28: // Size2
-        case 60: // Size1
-            return ONLY_E;
-        case 4: // ETag
-        case 14: // Max-Age
-        case 258: // No-Response
-        case 252: // Echo
-            return ONLY_E_IGNORE_OUTER;
-        case 3: // Uri-Host
-        case 7: // Uri-Port
-        case 39: // Proxy-Scheme
-            return PRIMARILY_U;
-        case 6: // Observe
-        case 9: // OSCORE
-        case 35: // Proxy-Uri
-            return HARDCODED;
-        default:
-            return HARDCODED;
+    enum option_behavior behavior = builtin_option_behaviour(option_number);
+
+    if (behavior == UNKNOWN) {
+        for (size_t i = 0; i < option_registry_used; ++i) {
+            if (option_registry[i].number == option_number) {
+                return option_registry[i].behavior;
+            }
+        }
+        // Critical options are odd-numbered
+        return (option_number & 1) ? ONLY_E : ONLY_E_IGNORE_OUTER;
+    }
+
+    return behavior;
+}
+
+bool oscore_option_register_class(
+        uint16_t option_number,
+        enum oscore_option_class option_class
+        )
+{
+    enum option_behavior behavior;
+    switch (option_class) {
+    case OSCORE_OPTION_CLASS_E:
+        behavior = ONLY_E;
+        break;
+    case OSCORE_OPTION_CLASS_E_IGNORE_OUTER:
+        behavior = ONLY_E_IGNORE_OUTER;
+        break;
+    case OSCORE_OPTION_CLASS_U:
+        behavior = PRIMARILY_U;
+        break;
+    case OSCORE_OPTION_CLASS_I:
+        behavior = PRIMARILY_I;
+        break;
+    default:
+        return false;
+    }
+
+    if (builtin_option_behaviour(option_number) != UNKNOWN) {
+        return false;
+    }
+
+    for (size_t i = 0; i < option_registry_used; ++i) {
+        if (option_registry[i].number == option_number) {
+            option_registry_class_i -= option_registry[i].behavior == PRIMARILY_I;
+            option_registry_class_i += behavior == PRIMARILY_I;
+            option_registry[i].behavior = behavior;
+            return true;
+        }
+    }
+
+    if (option_registry_used == OSCORE_OPTION_REGISTRY_SIZE) {
+        return false;
+    }
+    option_registry[option_registry_used].number = option_number;
+    option_registry[option_registry_used].behavior = behavior;
+    option_registry_used += 1;
+    option_registry_class_i += behavior == PRIMARILY_I;
+    return true;
+}
+
+bool oscore_option_is_outer_mutable(uint16_t option_number)
+{
+    enum option_behavior behavior = get_option_behaviour(option_number);
+    return behavior == PRIMARILY_U || behavior == ONLY_E_IGNORE_OUTER ||
+        option_number == 6 /* Observe */;
+}
+
+/** Append those of the @p added options to @p destination that sort before
+ * @p limit, starting at @p *cursor and advancing it */
+static oscore_msgerr_protected_t outer_rewrite_add_until(
+        oscore_msg_native_t destination,
+        const struct oscore_msg_protected_option *added,
+        size_t added_count,
+        size_t *cursor,
+        uint32_t limit
+        )
+{
+    for (; *cursor < added_count && added[*cursor].option_number < limit; *cursor += 1) {
+        oscore_msgerr_native_t err = oscore_msg_native_append_option(
+                destination,
+                added[*cursor].option_number,
+                added[*cursor].value,
+                added[*cursor].value_len);
+        if (oscore_msgerr_native_is_error(err)) {
+            return NATIVE_ERROR;
+        }
+    }
+    return OK;
+}
+
+oscore_msgerr_protected_t oscore_msg_outer_rewrite(
+        oscore_msg_native_t source,
+        oscore_msg_native_t destination,
+        oscore_msg_outer_filter_t filter,
+        void *filter_arg,
+        const struct oscore_msg_protected_option *added,
+        size_t added_count
+        )
+{
+    for (size_t i = 0; i < added_count; ++i) {
+        if (!oscore_option_is_outer_mutable(added[i].option_number)) {
+            return INVALID_ARG_ERROR;
+        }
+        if (i > 0 && added[i].option_number < added[i - 1].option_number) {
+            return OPTION_SEQUENCE;
+        }
+    }
+
+    oscore_msg_native_set_code(destination, oscore_msg_native_get_code(source));
+
+    oscore_msgerr_protected_t result = OK;
+    size_t added_cursor = 0;
+
+    oscore_msg_native_optiter_t iter;
+    uint16_t option_number;
+    const uint8_t *value;
+    size_t value_len;
+    oscore_msg_native_optiter_init(source, &iter);
+    while (oscore_msg_native_optiter_next(source, &iter, &option_number, &value, &value_len)) {
+        result = outer_rewrite_add_until(destination, added, added_count, &added_cursor, option_number);
+        if (result != OK) {
+            break;
+        }
+
+        if (filter != NULL && oscore_option_is_outer_mutable(option_number) &&
+                !filter(filter_arg, option_number, &value, &value_len)) {
+            continue;
+        }
+
+        oscore_msgerr_native_t err = oscore_msg_native_append_option(
+                destination,
+                option_number,
+                value,
+                value_len);
+        if (oscore_msgerr_native_is_error(err)) {
+            result = NATIVE_ERROR;
+            break;
+        }
+    }
+    if (oscore_msgerr_native_is_error(oscore_msg_native_optiter_finish(source, &iter)) && result == OK) {
+        result = NATIVE_ERROR;
+    }
+    if (result == OK) {
+        result = outer_rewrite_add_until(destination, added, added_count, &added_cursor, UINT32_MAX);
+    }
+    if (result != OK) {
+        return result;
+    }
+
+    uint8_t *source_payload, *destination_payload;
+    size_t source_len, destination_len;
+    if (oscore_msgerr_native_is_error(oscore_msg_native_map_payload(source, &source_payload, &source_len)) ||
+            oscore_msgerr_native_is_error(oscore_msg_native_map_payload(destination, &destination_payload, &destination_len))) {
+        return NATIVE_ERROR;
+    }
+    if (source_len > destination_len) {
+        return MESSAGESIZE;
+    }
+    if (source_len != 0) {
+        memcpy(destination_payload, source_payload, source_len);
+    }
+    if (oscore_msgerr_native_is_error(oscore_msg_native_trim_payload(destination, source_len))) {
+        return NATIVE_ERROR;
+    }
+    return OK;
+}
+
+/** Access the payload of the message's backend
+ *
+ * This only calls into the backend if the payload was not mapped before, or
+ * if the backend was changed since (see @ref invalidate_mapped_payload). On
+ * error, a zero-length payload is reported. */
+static bool map_backend_payload(
+        oscore_msg_protected_t *msg,
+        uint8_t **payload,
+        size_t *payload_len
+        )
+{
+    if (msg->mapped_payload == NULL) {
+        oscore_msgerr_native_t err = oscore_msg_native_map_payload(
+                msg->backend,
+                &msg->mapped_payload,
+                &msg->mapped_payload_len);
+        if (oscore_msgerr_native_is_error(err)) {
+            msg->mapped_payload = NULL;
+            *payload = NULL;
+            *payload_len = 0;
+            return false;
+        }
+    }
+    *payload = msg->mapped_payload;
+    *payload_len = msg->mapped_payload_len;
+    return true;
+}
+
+/** Forget the cached mapping of the backend's payload; to be called after any
+ * operation on the backend that might move or resize the payload */
+static void invalidate_mapped_payload(oscore_msg_protected_t *msg)
+{
+    if (!(msg->flags & OSCORE_MSG_PROTECTED_FLAG_DETACHED)) {
+        msg->mapped_payload = NULL;
     }
 }
 
@@ -140,6 +382,180 @@ static size_t _optparts_encode(uint8_t *buffer, uint16_t delta, uint16_t size) {
     return buffer - startbuffer;
 }
 
+/** Pass the Class I options of @p msg to @p handler in order, along with the
+ * delta to the previous Class I option, until it returns false */
+static void class_i_foreach(
+        oscore_msg_native_t msg,
+        bool (*handler)(void *, uint16_t, const uint8_t *, size_t),
+        void *arg
+        )
+{
+    oscore_msg_native_optiter_t iter;
+    uint16_t option_number;
+    const uint8_t *value;
+    size_t value_len;
+    uint16_t last_number = 0;
+
+    oscore_msg_native_optiter_init(msg, &iter);
+    while (oscore_msg_native_optiter_next(msg, &iter, &option_number, &value, &value_len)) {
+        if (get_option_behaviour(option_number) != PRIMARILY_I) {
+            continue;
+        }
+        if (!handler(arg, option_number - last_number, value, value_len)) {
+            break;
+        }
+        last_number = option_number;
+    }
+    // Not much that can be done about errors here; the message's options were
+    // readable when it was received or built.
+    oscore_msg_native_optiter_finish(msg, &iter);
+}
+
+static bool class_i_sum_length(void *arg, uint16_t delta, const uint8_t *value, size_t value_len)
+{
+    (void) value;
+    size_t *length = arg;
+    *length += 1 + _optpart_length(delta) + _optpart_length(value_len) + value_len;
+    return true;
+}
+
+size_t oscore_option_class_i_length(oscore_msg_native_t msg)
+{
+    size_t length = 0;
+    if (option_registry_class_i != 0) {
+        class_i_foreach(msg, class_i_sum_length, &length);
+    }
+    return length;
+}
+
+/** Arguments passed through @ref class_i_foreach by @ref
+ * oscore_option_class_i_feed */
+struct class_i_feed_arg {
+    oscore_cryptoerr_t (*feeder)(void *, const uint8_t *, size_t);
+    void *state;
+    oscore_cryptoerr_t *err;
+};
+
+static bool class_i_feed_one(void *arg, uint16_t delta, const uint8_t *value, size_t value_len)
+{
+    struct class_i_feed_arg *feed = arg;
+    uint8_t header[5];
+    *feed->err = feed->feeder(feed->state, header, _optparts_encode(header, delta, value_len));
+    if (!oscore_cryptoerr_is_error(*feed->err) && value_len != 0) {
+        *feed->err = feed->feeder(feed->state, value, value_len);
+    }
+    return !oscore_cryptoerr_is_error(*feed->err);
+}
+
+void oscore_option_class_i_feed(
+        oscore_msg_native_t msg,
+        oscore_cryptoerr_t (*feeder)(void *, const uint8_t *, size_t),
+        void *state,
+        oscore_cryptoerr_t *err
+        )
+{
+    if (option_registry_class_i == 0) {
+        return;
+    }
+    struct class_i_feed_arg feed = { feeder, state, err };
+    class_i_foreach(msg, class_i_feed_one, &feed);
+}
+
+/** Append a run of options sorted by number to the inner options of @p msg
+ *
+ * The space needed by all options is determined before any of them is
+ * written, so that either all or none of them are added. */
+static oscore_msgerr_protected_t append_inner_run(
+    oscore_msg_protected_t *msg,
+    const struct oscore_msg_protected_option *options,
+    size_t count
+    )
+{
+    if (msg->payload_offset != 0 && !(msg->flags & OSCORE_MSG_PROTECTED_FLAG_WRITABLE)) {
+        return OPTION_SEQUENCE;
+    }
+    if (msg->flags & OSCORE_MSG_PROTECTED_FLAG_TEMPLATE_APPLIED) {
+        // The payload could only be moved into the area that was trimmed off
+        return INVALID_ARG_ERROR;
+    }
+    if ((msg->flags & OSCORE_MSG_PROTECTED_FLAG_REQUEST) && (msg->flags & OSCORE_MSG_PROTECTED_FLAG_DETERMINISTIC)) {
+        // The request hash was taken over the template, which the inner
+        // options need to come from
+        return INVALID_ARG_ERROR;
+    }
+
+    size_t total_length = 0;
+    uint16_t last_number = msg->class_e.option_number;
+    for (size_t i = 0; i < count; ++i) {
+        size_t value_len = options[i].value_len;
+        if (options[i].option_number < last_number) {
+            return OPTION_SEQUENCE;
+        }
+        if (value_len > UINT16_MAX) {
+            /* can't be expressed in encoded options */
+            return OPTION_SIZE;
+        }
+        uint16_t delta = options[i].option_number - last_number;
+        size_t option_length = value_len + 1 + \
+                               _optpart_length(delta) + \
+                               _optpart_length(value_len);
+        if (option_length < value_len || total_length + option_length < total_length) {
+            /* overflow occurred -- after the above, this can only happen where size_t == uint16_t */
+            return OPTION_SIZE;
+        }
+        total_length += option_length;
+        last_number = options[i].option_number;
+    }
+
+    uint8_t *payload;
+    size_t payload_length;
+    if (!map_backend_payload(msg, &payload, &payload_length)) {
+        return NATIVE_ERROR;
+    }
+
+    if (total_length > payload_length - msg->class_e.cursor - 1) {
+        /* Regular 'option too long' */
+        return OPTION_SIZE;
+    }
+
+    if (msg->payload_offset != 0) {
+        // The payload was mapped already (and possibly written to): Shift it
+        // back to make room for the options. What falls off the end was
+        // beyond the (new) end of the payload area and can not have been
+        // trimmed into the message any more.
+        size_t payload_end = payload_length - msg->tag_length;
+        if (msg->payload_offset > payload_end ||
+                total_length > payload_end - msg->payload_offset) {
+            return OPTION_SIZE;
+        }
+        size_t new_offset = msg->payload_offset + total_length;
+        memmove(&payload[new_offset],
+                &payload[msg->payload_offset],
+                payload_end - new_offset);
+        if (msg->payload_offset > 1 + msg->class_e.cursor) {
+            // Inner payload marker
+            payload[new_offset - 1] = 0xff;
+        }
+        msg->payload_offset = new_offset;
+    }
+
+    uint8_t *cursor = &payload[1 + msg->class_e.cursor];
+    last_number = msg->class_e.option_number;
+    for (size_t i = 0; i < count; ++i) {
+        uint16_t delta = options[i].option_number - last_number;
+        cursor += _optparts_encode(cursor, delta, options[i].value_len);
+        if (options[i].value_len) {
+            memcpy(cursor, options[i].value, options[i].value_len);
+            cursor += options[i].value_len;
+        }
+        last_number = options[i].option_number;
+    }
+
+    msg->class_e.cursor += total_length;
+    msg->class_e.option_number = last_number;
+    return OK;
+}
+
 /** Like @ref oscore_msg_protected_append_option, but without flushing any
  * autooptions, and going into an inner option unconditionally.
  *
@@ -152,49 +568,79 @@ oscore_msgerr_protected_t oscore_msg_protected_append_option_inner(
         size_t value_len
         )
 {
-        if (option_number < msg->class_e.option_number) {
-            return OPTION_SEQUENCE;
-        }
-        if (msg->payload_offset != 0) {
-            // FIXME (but probably more "extend me"): Allow this case, set the
-            // payload_offset right after, and move any existing memory. (That
-            // should be optional, as this behavior is sufficient in most
-            // applications other than OSCORE-in-OSCORE).
-            return OPTION_SEQUENCE;
-        }
+        struct oscore_msg_protected_option option = {
+            .option_number = option_number,
+            .value = value,
+            .value_len = value_len,
+        };
+        return append_inner_run(msg, &option, 1);
+}
 
-        uint8_t *payload;
-        size_t payload_length;
-        oscore_msgerr_native_t err = oscore_msg_native_map_payload(msg->backend, &payload, &payload_length);
-        if (oscore_msgerr_native_is_error(err)) {
-            return NATIVE_ERROR;
-        }
+/** Maximum length of the OSCORE option value written by @ref build_oscore_option */
+#define OSCORE_OPTION_MAXLEN (1 + PIV_BYTES + 1 + OSCORE_KEYIDCONTEXT_MAXLEN + OSCORE_KEYID_MAXLEN)
 
-        uint16_t delta = option_number - msg->class_e.option_number;
-        size_t total_length = value_len + 1 + \
-                              _optpart_length(delta) + \
-                              _optpart_length(value_len);
-
-        if (
-                /* can't be expressed in encoded options */
-                value_len > UINT16_MAX
-                ||
-                /* overflow occurred -- after the above, this can only happen where size_t == uint16_t */
-                total_length < value_len
-                ||
-                /* Regular 'option too long' */
-                total_length > payload_length - msg->class_e.cursor - 1
-                ) {
-            return OPTION_SIZE;
-        }
-        size_t opthead = _optparts_encode(&payload[1 + msg->class_e.cursor], delta, value_len);
-        if (value_len) {
-            memcpy(&payload[1 + msg->class_e.cursor + opthead], value, value_len);
-        }
+/** Produce the value of the OSCORE option of a writable message
+ *
+ * @param[in] msg The message whose OSCORE option to build
+ * @param[out] optionbuffer Buffer of OSCORE_OPTION_MAXLEN bytes for the value
+ * @return the length of the option value
+ *
+ * This only depends on properties that are fixed when the message is
+ * prepared, and can thus be used both to write the option and to predict its
+ * size.
+ */
+static size_t build_oscore_option(
+        const oscore_msg_protected_t *msg,
+        uint8_t optionbuffer[OSCORE_OPTION_MAXLEN]
+        )
+{
+    size_t optionlength = 0;
 
-        msg->class_e.cursor += opthead + value_len;
-        msg->class_e.option_number = option_number;
-        return OK;
+    uint8_t n;
+    const oscore_requestid_t *piv_source;
+    if (msg->request_id.is_first_use && !(msg->flags & OSCORE_MSG_PROTECTED_FLAG_REQUEST)) {
+        n = 0;
+    } else {
+        piv_source = msg->request_id.is_first_use ? &msg->request_id : &msg->partial_iv;
+        n = piv_source->used_bytes;
+    }
+    // In multicast responses, that'd be set as well.
+    // FIXME any other situation? probably context dependent -- ask context?
+    bool k = msg->flags & OSCORE_MSG_PROTECTED_FLAG_REQUEST;
+
+    bool h = oscore_context_emit_kidcontext(msg->secctx,
+            msg->flags & OSCORE_MSG_PROTECTED_FLAG_REQUEST);
+
+    optionbuffer[0] = n | (k << 3) | (h << 4);
+    optionlength = 1;
+    if (n != 0) {
+        memcpy(&optionbuffer[optionlength], &piv_source->bytes[PIV_BYTES - n], n);
+        optionlength += n;
+    }
+
+    if (h) {
+        const uint8_t *kidcontext;
+        size_t kidcontext_len;
+        oscore_context_get_kidcontext(msg->secctx, &kidcontext, &kidcontext_len);
+        optionbuffer[optionlength++] = kidcontext_len;
+        memcpy(&optionbuffer[optionlength], kidcontext, kidcontext_len);
+        optionlength += kidcontext_len;
+    }
+
+    if (k) {
+        const uint8_t *kid;
+        size_t kid_length;
+        oscore_context_get_kid(msg->secctx, OSCORE_ROLE_SENDER, &kid, &kid_length);
+        memcpy(&optionbuffer[optionlength], kid, kid_length);
+        optionlength += kid_length;
+    }
+
+    if (optionlength == 1 && optionbuffer[0] == 0) {
+        // The typical response option is encoded in zero length
+        optionlength = 0;
+    }
+
+    return optionlength;
 }
 
 /** @brief Set autogenerated outer options on a message up to and including a given number
@@ -208,6 +654,7 @@ oscore_msgerr_protected_t oscore_msg_protected_append_option_inner(
  * higher outer option then the last written one. In particular, this generates
  *
  * * the OSCORE option
+ * * the Request-Hash option of deterministic requests
  * */
 OSCORE_NONNULL
 oscore_msgerr_protected_t flush_autooptions_outer_until(oscore_msg_protected_t *msg, uint16_t optnum)
@@ -221,55 +668,26 @@ oscore_msgerr_protected_t flush_autooptions_outer_until(oscore_msg_protected_t *
 
         // Write OSCORE option
 
-        uint8_t optionbuffer[1 + PIV_BYTES + 1 + OSCORE_KEYIDCONTEXT_MAXLEN + OSCORE_KEYID_MAXLEN];
-        size_t optionlength = 0;
-
-        uint8_t n;
-        oscore_requestid_t *piv_source;
-        if (msg->request_id.is_first_use && !(msg->flags & OSCORE_MSG_PROTECTED_FLAG_REQUEST)) {
-            n = 0;
-        } else {
-            piv_source = msg->request_id.is_first_use ? &msg->request_id : &msg->partial_iv;
-            n = piv_source->used_bytes;
-        }
-        // In multicast responses, that'd be set as well.
-        // FIXME any other situation? probably context dependent -- ask context?
-        bool k = msg->flags & OSCORE_MSG_PROTECTED_FLAG_REQUEST;
-
-        bool h = oscore_context_emit_kidcontext(msg->secctx,
-                msg->flags & OSCORE_MSG_PROTECTED_FLAG_REQUEST);
-
-        optionbuffer[0] = n | (k << 3) | (h << 4);
-        optionlength = 1;
-        if (n != 0) {
-            memcpy(&optionbuffer[optionlength], &piv_source->bytes[PIV_BYTES - n], n);
-            optionlength += n;
-        }
-
-        if (h) {
-            const uint8_t *kidcontext;
-            size_t kidcontext_len;
-            oscore_context_get_kidcontext(msg->secctx, &kidcontext, &kidcontext_len);
-            optionbuffer[optionlength++] = kidcontext_len;
-            memcpy(&optionbuffer[optionlength], kidcontext, kidcontext_len);
-            optionlength += kidcontext_len;
-        }
+        uint8_t optionbuffer[OSCORE_OPTION_MAXLEN];
+        size_t optionlength = build_oscore_option(msg, optionbuffer);
 
-        if (k) {
-            const uint8_t *kid;
-            size_t kid_length;
-            oscore_context_get_kid(msg->secctx, OSCORE_ROLE_SENDER, &kid, &kid_length);
-            memcpy(&optionbuffer[optionlength], kid, kid_length);
-            optionlength += kid_length;
-        }
+        oscore_msgerr_native_t err;
+        err = oscore_msg_native_append_option(msg->backend, 9, optionbuffer, optionlength);
+        invalidate_mapped_payload(msg);
+        if (oscore_msgerr_native_is_error(err))
+            return NATIVE_ERROR;
+    }
 
-        if (optionlength == 1 && optionbuffer[0] == 0) {
-            // The typical response option is encoded in zero length
-            optionlength = 0;
-        }
+    if (msg->flags & OSCORE_MSG_PROTECTED_FLAG_PENDING_REQUEST_HASH && optnum >= OSCORE_OPTNUM_REQUEST_HASH) {
+        msg->flags &= ~OSCORE_MSG_PROTECTED_FLAG_PENDING_REQUEST_HASH;
 
         oscore_msgerr_native_t err;
-        err = oscore_msg_native_append_option(msg->backend, 9, optionbuffer, optionlength);
+        err = oscore_msg_native_append_option(
+                msg->backend,
+                OSCORE_OPTNUM_REQUEST_HASH,
+                msg->deterministic->hash,
+                OSCORE_REQUEST_HASH_LEN);
+        invalidate_mapped_payload(msg);
         if (oscore_msgerr_native_is_error(err))
             return NATIVE_ERROR;
     }
@@ -396,7 +814,7 @@ static void optiter_peek_inner_option(
 {
     uint8_t *payload;
     size_t payload_len;
-    oscore_msg_native_map_payload(msg->backend, &payload, &payload_len);
+    map_backend_payload(msg, &payload, &payload_len);
     payload_len -= msg->tag_length;
 
     const uint8_t *cursor_inner;
@@ -444,11 +862,37 @@ static void optiter_peek_inner_option(
     }
 }
 
+void oscore_msg_protected_compact(
+        oscore_msg_protected_compact_t *compact,
+        const oscore_msg_protected_t *msg
+        )
+{
+    assert(!(msg->flags & (OSCORE_MSG_PROTECTED_FLAG_WRITABLE | OSCORE_MSG_PROTECTED_FLAG_DETACHED)));
+    assert(msg->tag_length <= UINT8_MAX);
+
+    compact->backend = msg->backend;
+    compact->payload_offset = msg->payload_offset;
+    compact->tag_length = msg->tag_length;
+}
+
+void oscore_msg_protected_expand(
+        oscore_msg_protected_t *msg,
+        const oscore_msg_protected_compact_t *compact
+        )
+{
+    msg->backend = compact->backend;
+    msg->flags = OSCORE_MSG_PROTECTED_FLAG_NONE;
+    msg->tag_length = compact->tag_length;
+    msg->payload_offset = compact->payload_offset;
+    // The backend may have been moved around in memory in the meantime
+    msg->mapped_payload = NULL;
+}
+
 uint8_t oscore_msg_protected_get_code(oscore_msg_protected_t *msg)
 {
     uint8_t *payload;
     size_t payload_len;
-    oscore_msg_native_map_payload(msg->backend, &payload, &payload_len);
+    map_backend_payload(msg, &payload, &payload_len);
 
     assert(payload_len);
     return payload[0];
@@ -458,7 +902,7 @@ void oscore_msg_protected_set_code(oscore_msg_protected_t *msg, uint8_t code)
 {
     uint8_t *payload;
     size_t payload_len;
-    oscore_msg_native_map_payload(msg->backend, &payload, &payload_len);
+    map_backend_payload(msg, &payload, &payload_len);
 
     assert(payload_len);
     payload[0] = code;
@@ -474,7 +918,7 @@ oscore_msgerr_protected_t oscore_msg_protected_append_option(
     oscore_msgerr_protected_t flusherr;
 
     enum option_behavior behavior = get_option_behaviour(option_number);
-    if (behavior == PRIMARILY_U || option_number == 6 /* Observe */) {
+    if (behavior == PRIMARILY_U || behavior == PRIMARILY_I || option_number == 6 /* Observe */) {
         flusherr = flush_autooptions_outer_until(msg, option_number);
         if (flusherr != OK) {
             return flusherr;
@@ -497,6 +941,7 @@ oscore_msgerr_protected_t oscore_msg_protected_append_option(
                 value,
                 value_len
         );
+        invalidate_mapped_payload(msg);
         return oscore_msgerr_native_is_error(err) ? NATIVE_ERROR : OK;
     } else if (behavior == ONLY_E || behavior == ONLY_E_IGNORE_OUTER) {
         flusherr = flush_autooptions_inner_until(msg, option_number);
@@ -511,6 +956,62 @@ oscore_msgerr_protected_t oscore_msg_protected_append_option(
     }
 }
 
+/** Whether @p option_number can go into a run of @ref append_inner_run without
+ * any processing in @ref oscore_msg_protected_append_option */
+static bool is_plain_inner(uint16_t option_number)
+{
+    enum option_behavior behavior = get_option_behaviour(option_number);
+    return (behavior == ONLY_E || behavior == ONLY_E_IGNORE_OUTER) &&
+        option_number != 6 /* Observe */;
+}
+
+oscore_msgerr_protected_t oscore_msg_protected_append_options(
+        oscore_msg_protected_t *msg,
+        const struct oscore_msg_protected_option *options,
+        size_t count
+        )
+{
+    oscore_msgerr_protected_t err;
+
+    size_t i = 0;
+    while (i < count) {
+        if (!is_plain_inner(options[i].option_number)) {
+            err = oscore_msg_protected_append_option(
+                    msg,
+                    options[i].option_number,
+                    options[i].value,
+                    options[i].value_len);
+            if (err != OK) {
+                return err;
+            }
+            i += 1;
+            continue;
+        }
+
+        err = flush_autooptions_inner_until(msg, options[i].option_number);
+        if (err != OK) {
+            return err;
+        }
+
+        // Extend the run as long as appending the options one by one would
+        // not have flushed anything in between
+        bool observe_pending = msg->flags & (OSCORE_MSG_PROTECTED_FLAG_PENDING_OBSERVE_0 | OSCORE_MSG_PROTECTED_FLAG_PENDING_OBSERVE_1);
+        size_t end = i + 1;
+        while (end < count && is_plain_inner(options[end].option_number) &&
+                !(observe_pending && options[end].option_number >= 9)) {
+            end += 1;
+        }
+
+        err = append_inner_run(msg, &options[i], end - i);
+        if (err != OK) {
+            return err;
+        }
+        i = end;
+    }
+
+    return OK;
+}
+
 // FIXME: This will only work if the options have been put in here by the
 // library (which is typically the case for being-sent messages that are the
 // ones being updated as well). That may not even need to be changed, just
@@ -524,7 +1025,7 @@ oscore_msgerr_protected_t oscore_msg_protected_update_option(
         )
 {
     enum option_behavior behavior = get_option_behaviour(option_number);
-    if (behavior == PRIMARILY_U) {
+    if (behavior == PRIMARILY_U || behavior == PRIMARILY_I) {
         oscore_msgerr_native_t err = oscore_msg_native_update_option(
                 msg->backend,
                 option_number,
@@ -532,6 +1033,7 @@ oscore_msgerr_protected_t oscore_msg_protected_update_option(
                 value,
                 value_len
         );
+        invalidate_mapped_payload(msg);
         return oscore_msgerr_native_is_error(err) ? NATIVE_ERROR : OK;
     } else if (behavior == ONLY_E || behavior == ONLY_E_IGNORE_OUTER) {
         // Actually we only need those values, consider making them into a
@@ -691,6 +1193,9 @@ bool oscore_msg_protected_optiter_next(
                 return optiter_abort(msg, iter, NOTIMPLEMENTED_ERROR);
             }
             break;
+        case UNKNOWN:
+            // Resolved by get_option_behaviour
+            abort();
         }
 
         if (!skip) {
@@ -744,6 +1249,118 @@ oscore_msgerr_protected_t oscore_msg_protected_optiter_finish(
     return iter->inner_peeked_value == NULL ? iter->inner_termination_reason : OK;
 }
 
+void oscore_msg_protected_optindex_init(
+        oscore_msg_protected_optindex_t *index,
+        struct oscore_msg_protected_optindex_entry *entries,
+        size_t capacity
+        )
+{
+    index->entries = entries;
+    index->capacity = capacity;
+    index->length = 0;
+    index->built = false;
+}
+
+/** Populate an index from a single iteration over the message */
+static void optindex_build(
+        oscore_msg_protected_t *msg,
+        oscore_msg_protected_optindex_t *index
+        )
+{
+    oscore_msg_protected_optiter_t iter;
+    uint16_t option_number;
+    const uint8_t *value;
+    size_t value_len;
+
+    index->complete = true;
+    oscore_msg_protected_optiter_init(msg, &iter);
+    while (oscore_msg_protected_optiter_next(msg, &iter, &option_number, &value, &value_len)) {
+        if (index->length == index->capacity) {
+            index->complete = false;
+            break;
+        }
+        struct oscore_msg_protected_optindex_entry *entry = &index->entries[index->length];
+        entry->option_number = option_number;
+        entry->value = value;
+        entry->value_len = value_len;
+        index->length += 1;
+    }
+    index->status = oscore_msg_protected_optiter_finish(msg, &iter);
+    index->built = true;
+}
+
+bool oscore_msg_protected_find_option(
+        oscore_msg_protected_t *msg,
+        oscore_msg_protected_optindex_t *index,
+        uint16_t option_number,
+        size_t occurrence,
+        const uint8_t **value,
+        size_t *value_len
+        )
+{
+    if (!index->built) {
+        optindex_build(msg, index);
+    }
+
+    // Options are reported ordered by number, so the entries are sorted.
+    size_t low = 0;
+    size_t high = index->length;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (index->entries[mid].option_number < option_number) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    size_t found = low + occurrence;
+    if (found < index->length && index->entries[found].option_number == option_number) {
+        *value = index->entries[found].value;
+        *value_len = index->entries[found].value_len;
+        return true;
+    }
+    if (found < index->length || index->complete) {
+        return false;
+    }
+
+    // The requested option may be beyond what fit in the index
+    oscore_msg_protected_optiter_t iter;
+    uint16_t iter_number;
+    const uint8_t *iter_value;
+    size_t iter_value_len;
+    bool result = false;
+    oscore_msg_protected_optiter_init(msg, &iter);
+    while (oscore_msg_protected_optiter_next(msg, &iter, &iter_number, &iter_value, &iter_value_len)) {
+        if (iter_number < option_number) {
+            continue;
+        }
+        if (iter_number > option_number) {
+            break;
+        }
+        if (occurrence == 0) {
+            *value = iter_value;
+            *value_len = iter_value_len;
+            result = true;
+            break;
+        }
+        occurrence -= 1;
+    }
+    (void)oscore_msg_protected_optiter_finish(msg, &iter);
+    return result;
+}
+
+oscore_msgerr_protected_t oscore_msg_protected_optindex_status(
+        oscore_msg_protected_t *msg,
+        oscore_msg_protected_optindex_t *index
+        )
+{
+    if (!index->built) {
+        optindex_build(msg, index);
+    }
+    return index->status;
+}
+
 oscore_msgerr_protected_t oscore_msg_protected_map_payload(
         oscore_msg_protected_t *msg,
         uint8_t **payload,
@@ -763,8 +1380,7 @@ oscore_msgerr_protected_t oscore_msg_protected_map_payload(
         }
     }
 
-    oscore_msgerr_native_t err = oscore_msg_native_map_payload(msg->backend, payload, payload_len);
-    if (oscore_msgerr_native_is_error(err)) {
+    if (!map_backend_payload(msg, payload, payload_len)) {
         return NATIVE_ERROR;
     }
 
@@ -853,6 +1469,236 @@ oscore_msgerr_protected_t oscore_msg_protected_trim_payload(
             payload_len +
             // tag
             msg->tag_length);
+    invalidate_mapped_payload(msg);
+
+    return oscore_msgerr_native_is_error(err) ? NATIVE_ERROR : OK;
+}
+
+/** Encoded size of an option with the given @p delta and @p value_len */
+static size_t option_encoded_length(uint16_t delta, size_t value_len)
+{
+    return 1 + _optpart_length(delta) + _optpart_length(value_len) + value_len;
+}
+
+oscore_msgerr_protected_t oscore_msg_protected_plan_payload(
+        oscore_msg_protected_t *msg,
+        const struct oscore_msg_protected_option *planned,
+        size_t planned_count,
+        size_t *payload_len
+        )
+{
+    if (!(msg->flags & OSCORE_MSG_PROTECTED_FLAG_WRITABLE)) {
+        return INVALID_ARG_ERROR;
+    }
+
+    uint8_t *payload;
+    size_t backend_len;
+    if (!map_backend_payload(msg, &payload, &backend_len)) {
+        return NATIVE_ERROR;
+    }
+
+    uint16_t last_outer = 0;
+    oscore_msg_native_optiter_t iter;
+    uint16_t number;
+    const uint8_t *value;
+    size_t value_len;
+    oscore_msg_native_optiter_init(msg->backend, &iter);
+    while (oscore_msg_native_optiter_next(msg->backend, &iter, &number, &value, &value_len)) {
+        last_outer = number;
+    }
+    if (oscore_msgerr_native_is_error(oscore_msg_native_optiter_finish(msg->backend, &iter))) {
+        return NATIVE_ERROR;
+    }
+
+    bool oscore_pending = msg->flags & OSCORE_MSG_PROTECTED_FLAG_PENDING_OSCORE;
+    bool request_hash_pending = msg->flags & OSCORE_MSG_PROTECTED_FLAG_PENDING_REQUEST_HASH;
+    bool observe_pending = msg->flags & (OSCORE_MSG_PROTECTED_FLAG_PENDING_OBSERVE_0 | OSCORE_MSG_PROTECTED_FLAG_PENDING_OBSERVE_1);
+    size_t observe_len = (msg->flags & OSCORE_MSG_PROTECTED_FLAG_PENDING_OBSERVE_1) ? 1 : 0;
+    uint16_t last_inner = msg->class_e.option_number;
+
+    uint8_t optionbuffer[OSCORE_OPTION_MAXLEN];
+    size_t oscore_len = oscore_pending ? build_oscore_option(msg, optionbuffer) : 0;
+
+    // Everything that goes into the backend's payload area, following the
+    // same sequence of flushes as appending the planned options would
+    size_t outer = 0;
+    size_t inner = 1 + msg->class_e.cursor;
+
+    for (size_t i = 0; i <= planned_count; ++i) {
+        // The final round only flushes what map_payload would flush
+        uint16_t option_number = i < planned_count ? planned[i].option_number : OPTNUM_MAX;
+        enum option_behavior behavior = get_option_behaviour(option_number);
+        bool is_outer = i == planned_count || behavior == PRIMARILY_U || behavior == PRIMARILY_I || option_number == 6;
+        bool is_inner = i == planned_count || behavior == ONLY_E || behavior == ONLY_E_IGNORE_OUTER;
+
+        if (!is_outer && !is_inner) {
+            return NOTIMPLEMENTED_ERROR;
+        }
+
+        if (is_outer && oscore_pending && option_number >= 9) {
+            outer += option_encoded_length(9 - last_outer, oscore_len);
+            last_outer = 9;
+            oscore_pending = false;
+        }
+        if (is_outer && request_hash_pending && option_number >= OSCORE_OPTNUM_REQUEST_HASH) {
+            outer += option_encoded_length(OSCORE_OPTNUM_REQUEST_HASH - last_outer, OSCORE_REQUEST_HASH_LEN);
+            last_outer = OSCORE_OPTNUM_REQUEST_HASH;
+            request_hash_pending = false;
+        }
+        if (is_inner && observe_pending && option_number >= 9) {
+            if (last_inner > 6) {
+                return OPTION_SEQUENCE;
+            }
+            inner += option_encoded_length(6 - last_inner, observe_len);
+            last_inner = 6;
+            observe_pending = false;
+        }
+
+        if (i == planned_count) {
+            break;
+        }
+
+        if (planned[i].value_len > UINT16_MAX) {
+            return OPTION_SIZE;
+        }
+
+        if (is_outer) {
+            if (option_number < last_outer) {
+                return OPTION_SEQUENCE;
+            }
+            outer += option_encoded_length(option_number - last_outer, planned[i].value_len);
+            last_outer = option_number;
+            if (option_number == 6) {
+                observe_pending = true;
+                observe_len = (planned[i].value_len != 0 && (msg->flags & OSCORE_MSG_PROTECTED_FLAG_REQUEST)) ? 1 : 0;
+            }
+        } else {
+            if (option_number < last_inner) {
+                return OPTION_SEQUENCE;
+            }
+            inner += option_encoded_length(option_number - last_inner, planned[i].value_len);
+            last_inner = option_number;
+        }
+    }
+
+    size_t used = outer + inner + msg->tag_length;
+    if (used > backend_len) {
+        return MESSAGESIZE;
+    }
+    *payload_len = backend_len - used;
+    if (*payload_len > 0) {
+        // Payload marker
+        *payload_len -= 1;
+    }
+    return OK;
+}
+
+uint8_t oscore_msg_protected_largest_szx(size_t payload_len)
+{
+    // SZX 7 is the BERT indicator, and not a block size in itself
+    for (uint8_t szx = 6; szx > 0; --szx) {
+        if (payload_len >= (size_t)16 << szx) {
+            return szx;
+        }
+    }
+    return 0;
+}
+
+oscore_msgerr_protected_t oscore_msg_protected_template_build(
+        oscore_msg_protected_template_t *tpl,
+        uint8_t code,
+        const struct oscore_msg_protected_option *options,
+        size_t count,
+        const uint8_t *payload,
+        size_t payload_len
+        )
+{
+    uint8_t *cursor = tpl->plaintext;
+    uint8_t *end = tpl->plaintext + OSCORE_MSG_PROTECTED_TEMPLATE_MAXLEN;
+
+    *cursor++ = code;
+
+    uint16_t last_number = 0;
+    tpl->observe = false;
+    for (size_t i = 0; i < count; ++i) {
+        if (options[i].option_number == 6 /* Observe */) {
+            tpl->observe = true;
+        } else if (!is_plain_inner(options[i].option_number)) {
+            return NOTIMPLEMENTED_ERROR;
+        }
+        if (options[i].option_number < last_number) {
+            return OPTION_SEQUENCE;
+        }
+        uint16_t delta = options[i].option_number - last_number;
+        size_t value_len = options[i].value_len;
+        if (value_len > UINT16_MAX ||
+                (size_t)(end - cursor) < 1 + _optpart_length(delta) + _optpart_length(value_len) + value_len) {
+            return MESSAGESIZE;
+        }
+        cursor += _optparts_encode(cursor, delta, value_len);
+        if (value_len != 0) {
+            memcpy(cursor, options[i].value, value_len);
+            cursor += value_len;
+        }
+        last_number = options[i].option_number;
+    }
+    tpl->options_end = cursor - tpl->plaintext;
+    tpl->last_option_number = last_number;
+
+    if (payload_len != 0) {
+        if ((size_t)(end - cursor) < 1 + payload_len) {
+            return MESSAGESIZE;
+        }
+        *cursor++ = 0xff;
+        memcpy(cursor, payload, payload_len);
+        cursor += payload_len;
+    }
+    tpl->length = cursor - tpl->plaintext;
+
+    return OK;
+}
+
+oscore_msgerr_protected_t oscore_msg_protected_apply_template(
+        oscore_msg_protected_t *msg,
+        const oscore_msg_protected_template_t *tpl
+        )
+{
+    assert(msg->flags & OSCORE_MSG_PROTECTED_FLAG_WRITABLE);
+    assert(msg->class_e.cursor == 0 && msg->payload_offset == 0);
+
+    uint8_t observe_flags = OSCORE_MSG_PROTECTED_FLAG_PENDING_OBSERVE_0 | OSCORE_MSG_PROTECTED_FLAG_PENDING_OBSERVE_1;
+    if ((msg->flags & observe_flags) && !tpl->observe) {
+        return INVALID_ARG_ERROR;
+    }
+    // The template's inner Observe option takes the place of the pending one
+    msg->flags &= ~observe_flags;
+
+    oscore_msgerr_protected_t flusherr = flush_autooptions_outer_until(msg, OPTNUM_MAX);
+    if (flusherr != OK) {
+        return flusherr;
+    }
+
+    uint8_t *payload;
+    size_t payload_len;
+    if (!map_backend_payload(msg, &payload, &payload_len)) {
+        return NATIVE_ERROR;
+    }
+    if (tpl->length + msg->tag_length > payload_len) {
+        return MESSAGESIZE;
+    }
+
+    memcpy(payload, tpl->plaintext, tpl->length);
+    msg->class_e.cursor = tpl->options_end - 1;
+    msg->class_e.option_number = tpl->last_option_number;
+    if (tpl->length > tpl->options_end) {
+        // Past the inner payload marker
+        msg->payload_offset = tpl->options_end + 1;
+    }
+
+    oscore_msgerr_native_t err = oscore_msg_native_trim_payload(msg->backend,
+            tpl->length + msg->tag_length);
+    invalidate_mapped_payload(msg);
+    msg->flags |= OSCORE_MSG_PROTECTED_FLAG_TEMPLATE_APPLIED;
 
     return oscore_msgerr_native_is_error(err) ? NATIVE_ERROR : OK;
 }
@@ -64,13 +64,13 @@ size_t cbor_intencode(size_t input, uint8_t buf[5], uint8_t type)
         buf[1] = input % 256;
     } else if (ret == 3) {
         buf[0] = 25 + type;
-        buf[1] = (input << 8) % 256;
+        buf[1] = (input >> 8) % 256;
         buf[2] = input % 256;
     } else {
         buf[0] = 26 + type;
-        buf[1] = (input << 24) % 256;
-        buf[2] = (input << 16) % 256;
-        buf[3] = (input << 8) % 256;
+        buf[1] = (input >> 24) % 256;
+        buf[2] = (input >> 16) % 256;
+        buf[3] = (input >> 8) % 256;
         buf[4] = input % 256;
     }
     return ret;
@@ -94,47 +94,70 @@ struct aad_sizes {
     size_t aad_length;
 };
 
-/** Determine the size of the complete encoded Encrypt0 objecet that
- * constitutes the AAD of a message.
+/** Encode the parts of the external AAD that are shared between a request and
+ * its responses
  *
+ * @param[out] request_aad Storage for the encoded algorithm, request_kid and request_piv
  * @param[in] secctx Security context from which to get a KID
  * @param[in] requester_role Role in @p secctx that created the request
  * @param[in] request The @ref oscore_requestid_t describing the request_piv
- * @param[in] class_i_source The outer message containing all class I options to be considered for this message
- *
- * @todo Actually use Class I options (currently, it is assumed that there are none)
+ * @param[in] aeadalg Algorithm of @p secctx
  */
-struct aad_sizes predict_aad_size(
+oscore_cryptoerr_t build_request_aad(
+        oscore_request_aad_t *request_aad,
         const oscore_context_t *secctx,
         enum oscore_context_role requester_role,
         oscore_requestid_t *request,
-        oscore_crypto_aeadalg_t aeadalg,
-        oscore_msg_native_t class_i_source
+        oscore_crypto_aeadalg_t aeadalg
         )
 {
-    const uint8_t *request_kid; // ignored, but get_kid still wants to write somewhere
+    uint8_t *cursor = request_aad->bytes;
+
+    // Used algorithm
+    int32_t numeric_identifier = 0;
+    oscore_cryptoerr_t err = oscore_crypto_aead_get_number(aeadalg, &numeric_identifier);
+    if (oscore_cryptoerr_is_error(err)) { return err; }
+    cursor += cbor_signedintencode(numeric_identifier, cursor); /* FIXME strings? */
+
+    // Request KID
+    const uint8_t *request_kid;
     size_t request_kid_len;
     oscore_context_get_kid(secctx, requester_role, &request_kid, &request_kid_len);
+    assert(request_kid_len <= OSCORE_KEYID_MAXLEN);
 
-    struct aad_sizes ret;
+    cursor += cbor_intencode(request_kid_len, cursor, 0x40);
+    memcpy(cursor, request_kid, request_kid_len);
+    cursor += request_kid_len;
 
-    // FIXME gather thsi from class_i_source
-    ret.class_i_length = 0;
-    (void) class_i_source;
+    // Request PIV
+    cursor += cbor_intencode(request->used_bytes, cursor, 0x40);
+    memcpy(cursor, &request->bytes[PIV_BYTES - request->used_bytes], request->used_bytes);
+    cursor += request->used_bytes;
 
-    int32_t numeric_identifier = 0;
-    // error handling to follow when there are string-based algorithms
-    // to test this with; until then, the estimate is infallible and errs when
-    // feeding.
-    oscore_crypto_aead_get_number(aeadalg, &numeric_identifier);
+    request_aad->length = cursor - request_aad->bytes;
+    return err;
+}
+
+/** Determine the size of the complete encoded Encrypt0 objecet that
+ * constitutes the AAD of a message.
+ *
+ * @param[in] request_aad The encoded request dependent part of the external AAD
+ * @param[in] class_i_source The outer message containing all class I options to be considered for this message
+ */
+struct aad_sizes predict_aad_size(
+        const oscore_request_aad_t *request_aad,
+        oscore_msg_native_t class_i_source
+        )
+{
+    struct aad_sizes ret;
+
+    ret.class_i_length = oscore_option_class_i_length(class_i_source);
 
     ret.external_aad_length = \
             1 /* array length 5 */ +
             1 /* oscore version 1 */ +
             1 /* 1-long array of of */ +
-                cbor_signedintsize(numeric_identifier) /* FIXME strings? */ +
-            cbor_intsize(request_kid_len) + request_kid_len + /* request_kid */
-            cbor_intsize(request->used_bytes) + request->used_bytes + /* request_piv */
+            request_aad->length /* algorithm, request_kid, request_piv */ +
             cbor_intsize(ret.class_i_length) + ret.class_i_length;
     ret.aad_length = \
             1 /* array length 3 */ +
@@ -150,9 +173,7 @@ struct aad_sizes predict_aad_size(
  * @param[inout] feeder Function with a signature of @ref oscore_crypto_aead_encrypt_feed_aad and @ref oscore_crypto_aead_decrypt_feed_aaj
  * @param[inout] state AEAD en-/decryption state
  * @param[in] aad_sizes Predetermined sizes of the various AAD components
- * @param[in] secctx Security context from which to pick the sender role KID
- * @param[in] requester_role Role in @p secctx that created the request
- * @param[in] request The @ref oscore_requestid_t describing the request_piv
+ * @param[in] request_aad The encoded request dependent part of the external AAD
  * @param[in] class_i_source The outer message containing all class I options to be considered for this message
  *
  */
@@ -160,10 +181,7 @@ oscore_cryptoerr_t feed_aad(
         oscore_cryptoerr_t (*feeder)(void *, const uint8_t *, size_t),
         void *state,
         struct aad_sizes aad_sizes,
-        const oscore_context_t *secctx,
-        enum oscore_context_role requester_role,
-        oscore_requestid_t *request,
-        oscore_crypto_aeadalg_t aeadalg,
+        const oscore_request_aad_t *request_aad,
         oscore_msg_native_t class_i_source
         )
 {
@@ -182,35 +200,16 @@ oscore_cryptoerr_t feed_aad(
     err = feeder(state, (uint8_t*) "\x85\x01\x81", 3);
     if (oscore_cryptoerr_is_error(err)) { return err; }
 
-    // Used algorithm
-    int32_t numeric_identifier = 0;
-    err = oscore_crypto_aead_get_number(aeadalg, &numeric_identifier);
-    if (oscore_cryptoerr_is_error(err)) { return err; }
-    err = feeder(state, intbuf, cbor_signedintencode(numeric_identifier, intbuf));
-    if (oscore_cryptoerr_is_error(err)) { return err; }
-
-    // Request KID
-    const uint8_t *request_kid;
-    size_t request_kid_len;
-    oscore_context_get_kid(secctx, requester_role, &request_kid, &request_kid_len);
-
-    err = feeder(state, intbuf, cbor_intencode(request_kid_len, intbuf, 0x40));
-    if (oscore_cryptoerr_is_error(err)) { return err; }
-    err = feeder(state, request_kid, request_kid_len);
-    if (oscore_cryptoerr_is_error(err)) { return err; }
-
-    // Request PIV
-    err = feeder(state, intbuf, cbor_intencode(request->used_bytes, intbuf, 0x40));
-    if (oscore_cryptoerr_is_error(err)) { return err; }
-    err = feeder(state, &request->bytes[PIV_BYTES - request->used_bytes], request->used_bytes);
+    // Used algorithm, request KID and request PIV
+    err = feeder(state, request_aad->bytes, request_aad->length);
     if (oscore_cryptoerr_is_error(err)) { return err; }
 
     // Class I options
-    assert(aad_sizes.class_i_length == 0);
-    // As long as that holds, the Class I source can be disregarded.
-    (void) class_i_source;
-    // 0 byte string
-    err = feeder(state, (uint8_t*) "\x40", 1);
+    err = feeder(state, intbuf, cbor_intencode(aad_sizes.class_i_length, intbuf, 0x40));
+    if (oscore_cryptoerr_is_error(err)) { return err; }
+    if (aad_sizes.class_i_length != 0) {
+        oscore_option_class_i_feed(class_i_source, feeder, state, &err);
+    }
 
     return err;
 }
@@ -322,14 +321,26 @@ void oscore_requestid_clone(oscore_requestid_t *dest, oscore_requestid_t *src)
 /** Do all the decryption preparation common to @ref oscore_prepare_response
  * and @ref oscore_prepare_request
  *
+ * If @p plaintext is NULL, decryption happens in place; otherwise, the
+ * plaintext is written to the @p plaintext_capacity bytes at @p plaintext.
+ *
+ * The request dependent part of the AAD is built into @p request_aad.
+ *
+ * The message is decrypted with @p key, which is the recipient key of @p
+ * secctx unless the message is part of a deterministic exchange.
+ *
  * This returns true if decryption was successful.
  */
 bool _decrypt(
         oscore_msg_native_t protected,
         oscore_msg_protected_t *unprotected,
         oscore_context_t *secctx,
+        const uint8_t *key,
         enum oscore_context_role piv_kid,
-        enum oscore_context_role request_kid
+        enum oscore_context_role request_kid,
+        uint8_t *plaintext,
+        size_t plaintext_capacity,
+        oscore_request_aad_t *request_aad
         )
 {
     oscore_crypto_aeadalg_t aeadalg = oscore_context_get_aeadalg(secctx);
@@ -344,13 +355,19 @@ bool _decrypt(
         return false;
     }
     size_t plaintext_length = ciphertext_length - tag_length; // >= 1
+    if (plaintext != NULL && plaintext_capacity < plaintext_length) {
+        return false;
+    }
 
-    struct aad_sizes aad_sizes = predict_aad_size(secctx, request_kid, &unprotected->request_id, aeadalg, protected);
+    oscore_cryptoerr_t err = build_request_aad(request_aad, secctx, request_kid, &unprotected->request_id, aeadalg);
+    if (oscore_cryptoerr_is_error(err)) {
+        return false;
+    }
+    struct aad_sizes aad_sizes = predict_aad_size(request_aad, protected);
 
     uint8_t iv[OSCORE_CRYPTO_AEAD_IV_MAXLEN];
     build_iv(iv, &unprotected->partial_iv, secctx, piv_kid);
 
-    oscore_cryptoerr_t err;
     oscore_crypto_aead_decryptstate_t dec;
     err = oscore_crypto_aead_decrypt_start(
             &dec,
@@ -358,16 +375,24 @@ bool _decrypt(
             aad_sizes.aad_length,
             plaintext_length,
             iv,
-            oscore_context_get_key(secctx, OSCORE_ROLE_RECIPIENT)
+            key
             );
     if (!oscore_cryptoerr_is_error(err)) {
-        err = feed_aad(oscore_crypto_aead_decrypt_feed_aad, &dec, aad_sizes, secctx, request_kid, &unprotected->request_id, aeadalg, protected);
+        err = feed_aad(oscore_crypto_aead_decrypt_feed_aad, &dec, aad_sizes, request_aad, protected);
     }
     if (!oscore_cryptoerr_is_error(err)) {
-        err = oscore_crypto_aead_decrypt_inplace(
-                &dec,
-                ciphertext,
-                ciphertext_length);
+        if (plaintext == NULL) {
+            err = oscore_crypto_aead_decrypt_inplace(
+                    &dec,
+                    ciphertext,
+                    ciphertext_length);
+        } else {
+            err = oscore_crypto_aead_decrypt_outofplace(
+                    &dec,
+                    ciphertext,
+                    ciphertext_length,
+                    plaintext);
+        }
     }
 
     if (oscore_cryptoerr_is_error(err)) {
@@ -376,19 +401,34 @@ bool _decrypt(
 
     // FIXME all of that needs to be initialized
     unprotected->backend = protected;
-    unprotected->flags = OSCORE_MSG_PROTECTED_FLAG_NONE;
-    unprotected->tag_length = tag_length;
     unprotected->payload_offset = 0;
+    if (plaintext == NULL) {
+        unprotected->flags = OSCORE_MSG_PROTECTED_FLAG_NONE;
+        unprotected->tag_length = tag_length;
+        // Decryption happened in place
+        unprotected->mapped_payload = ciphertext;
+        unprotected->mapped_payload_len = ciphertext_length;
+    } else {
+        unprotected->flags = OSCORE_MSG_PROTECTED_FLAG_DETACHED;
+        unprotected->tag_length = 0;
+        unprotected->mapped_payload = plaintext;
+        unprotected->mapped_payload_len = plaintext_length;
+    }
 
     return true;
 }
 
-enum oscore_unprotect_request_result oscore_unprotect_request(
+/** Common implementation of @ref oscore_unprotect_request and its variants,
+ * see @ref _decrypt for @p plaintext and @p request_aad */
+static enum oscore_unprotect_request_result _unprotect_request(
         oscore_msg_native_t protected,
         oscore_msg_protected_t *unprotected,
         const oscore_oscoreoption_t *header,
         oscore_context_t *secctx,
-        oscore_requestid_t *request_id
+        oscore_requestid_t *request_id,
+        uint8_t *plaintext,
+        size_t plaintext_len,
+        oscore_request_aad_t *request_aad
         )
 {
     /* Comparing to the equivalent aiocoap code:
@@ -422,7 +462,7 @@ enum oscore_unprotect_request_result oscore_unprotect_request(
     oscore_requestid_clone(&unprotected->request_id, request_id);
     oscore_requestid_clone(&unprotected->partial_iv, request_id);
 
-    bool success = _decrypt(protected, unprotected, secctx, OSCORE_ROLE_RECIPIENT, OSCORE_ROLE_RECIPIENT);
+    bool success = _decrypt(protected, unprotected, secctx, oscore_context_get_key(secctx, OSCORE_ROLE_RECIPIENT), OSCORE_ROLE_RECIPIENT, OSCORE_ROLE_RECIPIENT, plaintext, plaintext_len, request_aad);
 
     if (!success)
         return OSCORE_UNPROTECT_REQUEST_INVALID;
@@ -432,13 +472,206 @@ enum oscore_unprotect_request_result oscore_unprotect_request(
     return request_id->is_first_use ? OSCORE_UNPROTECT_REQUEST_OK : OSCORE_UNPROTECT_REQUEST_DUPLICATE;
 }
 
-enum oscore_unprotect_response_result oscore_unprotect_response(
+enum oscore_unprotect_request_result oscore_unprotect_request(
+        oscore_msg_native_t protected,
+        oscore_msg_protected_t *unprotected,
+        const oscore_oscoreoption_t *header,
+        oscore_context_t *secctx,
+        oscore_requestid_t *request_id
+        )
+{
+    oscore_request_aad_t request_aad;
+    return _unprotect_request(protected, unprotected, header, secctx, request_id, NULL, 0, &request_aad);
+}
+
+enum oscore_unprotect_request_result oscore_unprotect_request_outofplace(
         oscore_msg_native_t protected,
         oscore_msg_protected_t *unprotected,
         const oscore_oscoreoption_t *header,
         oscore_context_t *secctx,
+        oscore_requestid_t *request_id,
+        uint8_t *plaintext,
+        size_t plaintext_len
+        )
+{
+    oscore_request_aad_t request_aad;
+    return _unprotect_request(protected, unprotected, header, secctx, request_id, plaintext, plaintext_len, &request_aad);
+}
+
+enum oscore_unprotect_request_result oscore_unprotect_request_aad(
+        oscore_msg_native_t protected,
+        oscore_msg_protected_t *unprotected,
+        const oscore_oscoreoption_t *header,
+        oscore_context_t *secctx,
+        oscore_requestid_t *request_id,
+        oscore_request_aad_t *request_aad
+        )
+{
+    return _unprotect_request(protected, unprotected, header, secctx, request_id, NULL, 0, request_aad);
+}
+
+enum oscore_unprotect_request_result oscore_unprotect_request_trial(
+        oscore_msg_native_t protected,
+        oscore_msg_protected_t *unprotected,
+        const oscore_oscoreoption_t *header,
+        oscore_context_t *const *candidates,
+        size_t candidates_count,
+        size_t *matched,
+        oscore_requestid_t *request_id,
+        uint8_t *scratch,
+        size_t scratch_len
+        )
+{
+    bool has_request_id = extract_requestid(header, request_id);
+    if (!has_request_id) {
+        return OSCORE_UNPROTECT_REQUEST_INVALID;
+    }
+
+    for (size_t i = 0; i < candidates_count; ++i) {
+        oscore_context_t *secctx = candidates[i];
+
+        // Cheap to rule out before running the AEAD
+        if (header->kid != NULL) {
+            const uint8_t *kid;
+            size_t kid_len;
+            oscore_context_get_kid(secctx, OSCORE_ROLE_RECIPIENT, &kid, &kid_len);
+            if (kid_len != header->kid_len || memcmp(kid, header->kid, kid_len) != 0) {
+                continue;
+            }
+        }
+        if (header->kid_context != NULL) {
+            const uint8_t *kid_context = NULL;
+            size_t kid_context_len;
+            oscore_context_get_kidcontext(secctx, &kid_context, &kid_context_len);
+            if (kid_context_len != header->kid_context_len ||
+                    (kid_context_len != 0 && memcmp(kid_context, header->kid_context, kid_context_len) != 0)) {
+                continue;
+            }
+        }
+
+        oscore_requestid_clone(&unprotected->request_id, request_id);
+        oscore_requestid_clone(&unprotected->partial_iv, request_id);
+
+        // Decrypting out of place leaves the ciphertext intact for the next
+        // candidate if this one fails
+        oscore_request_aad_t request_aad;
+        bool success = _decrypt(protected, unprotected, secctx, oscore_context_get_key(secctx, OSCORE_ROLE_RECIPIENT), OSCORE_ROLE_RECIPIENT, OSCORE_ROLE_RECIPIENT, scratch, scratch_len, &request_aad);
+        if (!success) {
+            continue;
+        }
+
+        // Move the plaintext to where in-place decryption would have left it,
+        // so that the message does not depend on the scratch buffer
+        uint8_t *ciphertext;
+        size_t ciphertext_length;
+        oscore_msgerr_native_t err = oscore_msg_native_map_payload(protected, &ciphertext, &ciphertext_length);
+        if (oscore_msgerr_native_is_error(err) || ciphertext_length < unprotected->mapped_payload_len) {
+            return OSCORE_UNPROTECT_REQUEST_INVALID;
+        }
+        memcpy(ciphertext, scratch, unprotected->mapped_payload_len);
+        unprotected->flags = OSCORE_MSG_PROTECTED_FLAG_NONE;
+        unprotected->tag_length = ciphertext_length - unprotected->mapped_payload_len;
+        unprotected->mapped_payload = ciphertext;
+        unprotected->mapped_payload_len = ciphertext_length;
+
+        // Only the context that could decrypt the request sees it in its
+        // replay window
+        *matched = i;
+        oscore_context_strikeout_requestid(secctx, request_id);
+
+        return request_id->is_first_use ? OSCORE_UNPROTECT_REQUEST_OK : OSCORE_UNPROTECT_REQUEST_DUPLICATE;
+    }
+
+    return OSCORE_UNPROTECT_REQUEST_INVALID;
+}
+
+enum oscore_demux_result oscore_demux_request(
+        oscore_msg_native_t protected,
+        oscore_context_lookup_t lookup,
+        void *lookup_state,
+        oscore_demux_t *demux
+        )
+{
+    demux->secctx = NULL;
+
+    bool has_option = false;
+    bool well_formed = true;
+    oscore_msg_native_optiter_t iter;
+    uint16_t option_number;
+    const uint8_t *value;
+    size_t value_len;
+    oscore_msg_native_optiter_init(protected, &iter);
+    while (oscore_msg_native_optiter_next(protected, &iter, &option_number, &value, &value_len)) {
+        if (option_number < 9) {
+            continue;
+        }
+        if (option_number > 9) {
+            break;
+        }
+        if (has_option) {
+            well_formed = false;
+            break;
+        }
+        has_option = true;
+        well_formed = oscore_oscoreoption_parse(&demux->header, value, value_len);
+        if (!well_formed) {
+            break;
+        }
+    }
+    if (oscore_msgerr_native_is_error(oscore_msg_native_optiter_finish(protected, &iter))) {
+        return OSCORE_DEMUX_MALFORMED;
+    }
+    if (!has_option) {
+        return OSCORE_DEMUX_NOT_OSCORE;
+    }
+
+    oscore_requestid_t request_id;
+    if (!well_formed || !extract_requestid(&demux->header, &request_id)) {
+        return OSCORE_DEMUX_MALFORMED;
+    }
+
+    demux->secctx = lookup(
+            lookup_state,
+            demux->header.kid,
+            demux->header.kid != NULL ? demux->header.kid_len : 0,
+            demux->header.kid_context,
+            demux->header.kid_context != NULL ? demux->header.kid_context_len : 0
+            );
+    if (demux->secctx == NULL) {
+        return OSCORE_DEMUX_UNKNOWN_KID;
+    }
+
+    if (oscore_context_is_replay(demux->secctx, &request_id)) {
+        return OSCORE_DEMUX_REPLAY;
+    }
+
+    return OSCORE_DEMUX_OK;
+}
+
+enum oscore_unprotect_request_result oscore_unprotect_demuxed(
+        oscore_msg_native_t protected,
+        oscore_msg_protected_t *unprotected,
+        const oscore_demux_t *demux,
         oscore_requestid_t *request_id
         )
+{
+    assert(demux->secctx != NULL);
+
+    return oscore_unprotect_request(protected, unprotected, &demux->header, demux->secctx, request_id);
+}
+
+/** Common implementation of @ref oscore_unprotect_response and its variants,
+ * see @ref _decrypt for @p key and @p plaintext */
+static enum oscore_unprotect_response_result _unprotect_response(
+        oscore_msg_native_t protected,
+        oscore_msg_protected_t *unprotected,
+        const oscore_oscoreoption_t *header,
+        oscore_context_t *secctx,
+        oscore_requestid_t *request_id,
+        const uint8_t *key,
+        uint8_t *plaintext,
+        size_t plaintext_len
+        )
 {
     bool has_piv = extract_requestid(header, &unprotected->partial_iv);
     enum oscore_context_role piv_kid;
@@ -456,7 +689,8 @@ enum oscore_unprotect_response_result oscore_unprotect_response(
     }
     oscore_requestid_clone(&unprotected->request_id, request_id);
 
-    bool success = _decrypt(protected, unprotected, secctx, piv_kid, OSCORE_ROLE_SENDER);
+    oscore_request_aad_t request_aad;
+    bool success = _decrypt(protected, unprotected, secctx, key, piv_kid, OSCORE_ROLE_SENDER, plaintext, plaintext_len, &request_aad);
 
     if (!success)
         return OSCORE_UNPROTECT_RESPONSE_INVALID;
@@ -464,6 +698,30 @@ enum oscore_unprotect_response_result oscore_unprotect_response(
     return OSCORE_UNPROTECT_RESPONSE_OK;
 }
 
+enum oscore_unprotect_response_result oscore_unprotect_response(
+        oscore_msg_native_t protected,
+        oscore_msg_protected_t *unprotected,
+        const oscore_oscoreoption_t *header,
+        oscore_context_t *secctx,
+        oscore_requestid_t *request_id
+        )
+{
+    return _unprotect_response(protected, unprotected, header, secctx, request_id, oscore_context_get_key(secctx, OSCORE_ROLE_RECIPIENT), NULL, 0);
+}
+
+enum oscore_unprotect_response_result oscore_unprotect_response_outofplace(
+        oscore_msg_native_t protected,
+        oscore_msg_protected_t *unprotected,
+        const oscore_oscoreoption_t *header,
+        oscore_context_t *secctx,
+        oscore_requestid_t *request_id,
+        uint8_t *plaintext,
+        size_t plaintext_len
+        )
+{
+    return _unprotect_response(protected, unprotected, header, secctx, request_id, oscore_context_get_key(secctx, OSCORE_ROLE_RECIPIENT), plaintext, plaintext_len);
+}
+
 oscore_msg_native_t oscore_release_unprotected(
         oscore_msg_protected_t *unprotected
         )
@@ -502,9 +760,11 @@ enum oscore_prepare_result _prepare_encrypt(
     unprotected->flags = OSCORE_MSG_PROTECTED_FLAG_WRITABLE | OSCORE_MSG_PROTECTED_FLAG_PENDING_OSCORE;
     unprotected->tag_length = tag_length;
     unprotected->payload_offset = 0;
+    unprotected->mapped_payload = NULL;
     unprotected->secctx = secctx;
     unprotected->class_e.cursor = 0;
     unprotected->class_e.option_number = 0;
+    unprotected->request_aad = NULL;
 
     return OSCORE_PREPARE_OK;
 }
@@ -542,6 +802,21 @@ enum oscore_prepare_result oscore_prepare_response(
     // Leaving the FLAG_REQUEST at 0 as it is
 }
 
+enum oscore_prepare_result oscore_prepare_response_aad(
+        oscore_msg_native_t protected,
+        oscore_msg_protected_t *unprotected,
+        oscore_context_t *secctx,
+        oscore_requestid_t *request_id,
+        const oscore_request_aad_t *request_aad
+        )
+{
+    enum oscore_prepare_result result = oscore_prepare_response(protected, unprotected, secctx, request_id);
+
+    unprotected->request_aad = request_aad;
+
+    return result;
+}
+
 enum oscore_prepare_result oscore_prepare_request(
         oscore_msg_native_t protected,
         oscore_msg_protected_t *unprotected,
@@ -608,20 +883,36 @@ enum oscore_finish_result oscore_encrypt_message(
     }
     size_t plaintext_length = ciphertext_length - tag_length; // >= 1
 
-    // FIXME optimize this to happen while the message is being built
-    struct aad_sizes aad_sizes = predict_aad_size(secctx, requester_role, &unprotected->request_id, aeadalg, unprotected->backend);
+    // The AAD can only be fed now: the AEAD backends process all of it
+    // together with the plaintext in a single operation whose plaintext
+    // length must be known up front, and the Class I options it covers may
+    // change until now.
+    oscore_cryptoerr_t err;
+    oscore_request_aad_t built_request_aad;
+    bool deterministic = unprotected->flags & OSCORE_MSG_PROTECTED_FLAG_DETERMINISTIC;
+    const oscore_request_aad_t *request_aad = deterministic ? NULL : unprotected->request_aad;
+    if (request_aad == NULL) {
+        err = build_request_aad(&built_request_aad, secctx, requester_role, &unprotected->request_id, aeadalg);
+        if (oscore_cryptoerr_is_error(err)) {
+            return OSCORE_FINISH_ERROR_CRYPTO;
+        }
+        request_aad = &built_request_aad;
+    }
+    struct aad_sizes aad_sizes = predict_aad_size(request_aad, unprotected->backend);
 
     uint8_t encrypt_iv[OSCORE_CRYPTO_AEAD_IV_MAXLEN];
     build_iv(encrypt_iv, &unprotected->partial_iv, secctx, nonceprovider_role);
 
     oscore_crypto_aead_encryptstate_t enc;
-    oscore_cryptoerr_t err = oscore_crypto_aead_encrypt_start(
+    err = oscore_crypto_aead_encrypt_start(
             &enc,
             oscore_context_get_aeadalg(secctx),
             aad_sizes.aad_length,
             plaintext_length,
             encrypt_iv,
-            oscore_context_get_key(secctx, OSCORE_ROLE_SENDER)
+            deterministic ?
+                    unprotected->deterministic->key :
+                    oscore_context_get_key(secctx, OSCORE_ROLE_SENDER)
             );
 
     if (!oscore_cryptoerr_is_error(err)) {
@@ -629,10 +920,7 @@ enum oscore_finish_result oscore_encrypt_message(
                 oscore_crypto_aead_encrypt_feed_aad,
                 &enc,
                 aad_sizes,
-                secctx,
-                requester_role,
-                &unprotected->request_id,
-                aeadalg,
+                request_aad,
                 unprotected->backend
                 );
     }
@@ -649,3 +937,279 @@ enum oscore_finish_result oscore_encrypt_message(
 
     return OSCORE_FINISH_OK;
 }
+
+/** Whether @p code is GET or FETCH, the only methods a deterministic request
+ * may have */
+static bool is_safe_method(uint8_t code)
+{
+    return code == 0x01 || code == 0x05;
+}
+
+/** Derive the request hash of a deterministic request
+ *
+ * This is the library's own scheme described at @ref
+ * oscore_prepare_request_deterministic, not the draft's hash.
+ */
+static oscore_cryptoerr_t derive_request_hash(
+        uint8_t hash[OSCORE_REQUEST_HASH_LEN],
+        oscore_crypto_hkdfalg_t hkdfalg,
+        const uint8_t *client_key,
+        size_t key_len,
+        const oscore_request_aad_t *request_aad,
+        const uint8_t *plaintext,
+        size_t plaintext_len
+        )
+{
+    return oscore_crypto_hkdf_derive(
+            hkdfalg,
+            client_key, key_len,
+            plaintext, plaintext_len,
+            request_aad->bytes, request_aad->length,
+            hash, OSCORE_REQUEST_HASH_LEN
+            );
+}
+
+/** Derive the key of a deterministic exchange from the request hash in @p
+ * deterministic */
+static oscore_cryptoerr_t derive_request_key(
+        oscore_deterministic_t *deterministic,
+        oscore_crypto_hkdfalg_t hkdfalg,
+        const uint8_t *client_key,
+        size_t key_len
+        )
+{
+    return oscore_crypto_hkdf_derive(
+            hkdfalg,
+            client_key, key_len,
+            deterministic->hash, OSCORE_REQUEST_HASH_LEN,
+            (const uint8_t *)"Key", 3,
+            deterministic->key, key_len
+            );
+}
+
+enum oscore_prepare_result oscore_prepare_request_deterministic(
+        oscore_msg_native_t protected,
+        oscore_msg_protected_t *unprotected,
+        oscore_context_t *secctx,
+        oscore_requestid_t *request_id,
+        const oscore_msg_protected_template_t *tpl,
+        oscore_crypto_hkdfalg_t hkdfalg,
+        oscore_deterministic_t *deterministic
+        )
+{
+    // Without replay protection, only safe methods may be sent
+    if (tpl->length == 0 || !is_safe_method(tpl->plaintext[0])) {
+        return OSCORE_PREPARE_ERROR_METHOD;
+    }
+
+    // A deterministic client always sends sequence number 0; the nonce is
+    // only ever used once with each request's key.
+    memset(&unprotected->request_id, 0, sizeof(oscore_requestid_t));
+    unprotected->request_id.used_bytes = 1;
+
+    oscore_requestid_clone(request_id, &unprotected->request_id);
+
+    oscore_requestid_clone(&unprotected->partial_iv, &unprotected->request_id);
+    // OK because it has special semantics in a oscore_msg_protected_t.partial_iv
+    unprotected->partial_iv.is_first_use = true;
+
+    oscore_crypto_aeadalg_t aeadalg = oscore_context_get_aeadalg(secctx);
+    size_t key_len = oscore_crypto_aead_get_keylength(aeadalg);
+    const uint8_t *client_key = oscore_context_get_key(secctx, OSCORE_ROLE_SENDER);
+
+    oscore_request_aad_t request_aad;
+    oscore_cryptoerr_t err = build_request_aad(&request_aad, secctx, OSCORE_ROLE_SENDER, &unprotected->request_id, aeadalg);
+    if (!oscore_cryptoerr_is_error(err)) {
+        err = derive_request_hash(deterministic->hash, hkdfalg, client_key, key_len, &request_aad, tpl->plaintext, tpl->length);
+    }
+    if (!oscore_cryptoerr_is_error(err)) {
+        err = derive_request_key(deterministic, hkdfalg, client_key, key_len);
+    }
+    if (oscore_cryptoerr_is_error(err)) {
+        return OSCORE_PREPARE_ERROR_CRYPTO;
+    }
+
+    // Unlike POST, FETCH requests can be cached by proxies
+    oscore_msg_native_set_code(protected, 0x5); // FETCH
+
+    enum oscore_prepare_result result = _prepare_encrypt(protected, unprotected, secctx);
+
+    unprotected->flags |= OSCORE_MSG_PROTECTED_FLAG_REQUEST | OSCORE_MSG_PROTECTED_FLAG_PENDING_REQUEST_HASH | OSCORE_MSG_PROTECTED_FLAG_DETERMINISTIC;
+    unprotected->deterministic = deterministic;
+
+    return result;
+}
+
+enum oscore_unprotect_request_result oscore_unprotect_request_deterministic(
+        oscore_msg_native_t protected,
+        oscore_msg_protected_t *unprotected,
+        const oscore_oscoreoption_t *header,
+        oscore_context_t *secctx,
+        oscore_requestid_t *request_id,
+        oscore_crypto_hkdfalg_t hkdfalg,
+        oscore_deterministic_t *deterministic
+        )
+{
+    bool has_hash = false;
+    oscore_msg_native_optiter_t iter;
+    uint16_t option_number;
+    const uint8_t *value;
+    size_t value_len;
+    oscore_msg_native_optiter_init(protected, &iter);
+    while (oscore_msg_native_optiter_next(protected, &iter, &option_number, &value, &value_len)) {
+        if (option_number == OSCORE_OPTNUM_REQUEST_HASH && value_len == OSCORE_REQUEST_HASH_LEN) {
+            memcpy(deterministic->hash, value, OSCORE_REQUEST_HASH_LEN);
+            has_hash = true;
+            break;
+        }
+    }
+    if (oscore_msgerr_native_is_error(oscore_msg_native_optiter_finish(protected, &iter)) || !has_hash) {
+        return OSCORE_UNPROTECT_REQUEST_INVALID;
+    }
+
+    bool has_request_id = extract_requestid(header, request_id);
+    if (!has_request_id || request_id->used_bytes != 1 || request_id->bytes[PIV_BYTES - 1] != 0) {
+        return OSCORE_UNPROTECT_REQUEST_INVALID;
+    }
+    // Deterministic requests are repeated by design, and are not checked
+    // against the replay window. Not having a first use of the request ID
+    // also makes every response carry a Partial IV of its own.
+    request_id->is_first_use = false;
+
+    oscore_requestid_clone(&unprotected->request_id, request_id);
+    oscore_requestid_clone(&unprotected->partial_iv, request_id);
+
+    size_t key_len = oscore_crypto_aead_get_keylength(oscore_context_get_aeadalg(secctx));
+    const uint8_t *client_key = oscore_context_get_key(secctx, OSCORE_ROLE_RECIPIENT);
+
+    oscore_cryptoerr_t err = derive_request_key(deterministic, hkdfalg, client_key, key_len);
+    if (oscore_cryptoerr_is_error(err)) {
+        return OSCORE_UNPROTECT_REQUEST_INVALID;
+    }
+
+    oscore_request_aad_t request_aad;
+    bool success = _decrypt(protected, unprotected, secctx, deterministic->key, OSCORE_ROLE_RECIPIENT, OSCORE_ROLE_RECIPIENT, NULL, 0, &request_aad);
+    if (!success) {
+        return OSCORE_UNPROTECT_REQUEST_INVALID;
+    }
+
+    // Deterministic requests are never checked for replays, so a request with
+    // side effects must not be processed even if it was protected correctly
+    if (!is_safe_method(oscore_msg_protected_get_code(unprotected))) {
+        return OSCORE_UNPROTECT_REQUEST_INVALID;
+    }
+
+    // Successful decryption shows that the sender knew the hash; only
+    // checking it shows that the hash belongs to this very request.
+    uint8_t hash[OSCORE_REQUEST_HASH_LEN];
+    err = derive_request_hash(
+            hash,
+            hkdfalg,
+            client_key,
+            key_len,
+            &request_aad,
+            unprotected->mapped_payload,
+            unprotected->mapped_payload_len - unprotected->tag_length
+            );
+    uint8_t difference = 0;
+    for (size_t i = 0; i < OSCORE_REQUEST_HASH_LEN; ++i) {
+        difference |= hash[i] ^ deterministic->hash[i];
+    }
+    if (oscore_cryptoerr_is_error(err) || difference != 0) {
+        return OSCORE_UNPROTECT_REQUEST_INVALID;
+    }
+
+    return OSCORE_UNPROTECT_REQUEST_OK;
+}
+
+enum oscore_prepare_result oscore_prepare_response_deterministic(
+        oscore_msg_native_t protected,
+        oscore_msg_protected_t *unprotected,
+        oscore_context_t *secctx,
+        oscore_requestid_t *request_id,
+        const oscore_deterministic_t *deterministic
+        )
+{
+    enum oscore_prepare_result result = oscore_prepare_response(protected, unprotected, secctx, request_id);
+
+    unprotected->flags |= OSCORE_MSG_PROTECTED_FLAG_DETERMINISTIC;
+    unprotected->deterministic = deterministic;
+
+    return result;
+}
+
+enum oscore_unprotect_response_result oscore_unprotect_response_deterministic(
+        oscore_msg_native_t protected,
+        oscore_msg_protected_t *unprotected,
+        const oscore_oscoreoption_t *header,
+        oscore_context_t *secctx,
+        oscore_requestid_t *request_id,
+        const oscore_deterministic_t *deterministic
+        )
+{
+    // All clients of a deterministic context share the request's nonce and
+    // key, so a response without a Partial IV of its own would reuse them.
+    oscore_requestid_t response_piv;
+    if (!extract_requestid(header, &response_piv)) {
+        return OSCORE_UNPROTECT_RESPONSE_INVALID;
+    }
+
+    return _unprotect_response(protected, unprotected, header, secctx, request_id, deterministic->key, NULL, 0);
+}
+
+/** Build the response of a single target of @ref oscore_protect_fanout */
+static enum oscore_fanout_result fanout_one(
+        const oscore_msg_protected_template_t *tpl,
+        const uint8_t *outer_observe,
+        size_t outer_observe_len,
+        struct oscore_fanout_target *target
+        )
+{
+    oscore_msg_protected_t unprotected;
+    enum oscore_prepare_result prepared;
+    if (target->request_aad != NULL) {
+        prepared = oscore_prepare_response_aad(target->message, &unprotected, target->secctx, target->request_id, target->request_aad);
+    } else {
+        prepared = oscore_prepare_response(target->message, &unprotected, target->secctx, target->request_id);
+    }
+    if (prepared != OSCORE_PREPARE_OK) {
+        return OSCORE_FANOUT_SECCTX_UNAVAILABLE;
+    }
+
+    oscore_msgerr_protected_t err;
+    if (outer_observe != NULL) {
+        err = oscore_msg_protected_append_option(&unprotected, 6 /* Observe */, outer_observe, outer_observe_len);
+        if (oscore_msgerr_protected_is_error(err)) {
+            return OSCORE_FANOUT_ERROR_MESSAGE;
+        }
+    }
+
+    err = oscore_msg_protected_apply_template(&unprotected, tpl);
+    if (oscore_msgerr_protected_is_error(err)) {
+        return OSCORE_FANOUT_ERROR_MESSAGE;
+    }
+
+    oscore_msg_native_t protected;
+    enum oscore_finish_result finished = oscore_encrypt_message(&unprotected, &protected);
+    if (finished != OSCORE_FINISH_OK) {
+        return OSCORE_FANOUT_ERROR_CRYPTO;
+    }
+
+    return OSCORE_FANOUT_OK;
+}
+
+size_t oscore_protect_fanout(
+        const oscore_msg_protected_template_t *tpl,
+        const uint8_t *outer_observe,
+        size_t outer_observe_len,
+        struct oscore_fanout_target *targets,
+        size_t count
+        )
+{
+    size_t succeeded = 0;
+    for (size_t i = 0; i < count; ++i) {
+        targets[i].result = fanout_one(tpl, outer_observe, outer_observe_len, &targets[i]);
+        succeeded += targets[i].result == OSCORE_FANOUT_OK;
+    }
+    return succeeded;
+}
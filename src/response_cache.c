@@ -0,0 +1,166 @@
+#include <oscore/response_cache.h>
+#include <oscore_native/platform.h>
+
+/* An entry's data holds the response code, followed by each option as its
+ * big-endian 16-bit number and length and its value, followed by the
+ * payload. */
+
+/** Number of bytes in front of each option's value in an entry's data */
+#define OPTION_HEADER_LEN 4
+
+void oscore_response_cache_init(
+        struct oscore_response_cache *cache,
+        struct oscore_response_cache_entry *entries,
+        size_t capacity
+        )
+{
+    assert(capacity >= 1);
+
+    cache->entries = entries;
+    cache->capacity = capacity;
+    cache->next = 0;
+    for (size_t i = 0; i < capacity; ++i) {
+        entries[i].secctx.data = NULL;
+    }
+}
+
+/** Whether @p entry holds the response to the request of @p request_id on
+ * @p secctx */
+static bool entry_matches(
+        const struct oscore_response_cache_entry *entry,
+        const oscore_context_t *secctx,
+        const oscore_requestid_t *request_id
+        )
+{
+    return entry->secctx.data != NULL &&
+        entry->secctx.type == secctx->type &&
+        entry->secctx.data == secctx->data &&
+        entry->request_piv_len == request_id->used_bytes &&
+        memcmp(entry->request_piv, request_id->bytes, PIV_BYTES) == 0;
+}
+
+bool oscore_response_cache_store(
+        struct oscore_response_cache *cache,
+        const oscore_context_t *secctx,
+        const oscore_requestid_t *request_id,
+        oscore_msg_native_t response
+        )
+{
+    struct oscore_response_cache_entry *entry = NULL;
+    bool replaces_oldest = false;
+    for (size_t i = 0; i < cache->capacity; ++i) {
+        if (entry_matches(&cache->entries[i], secctx, request_id)) {
+            entry = &cache->entries[i];
+            break;
+        }
+    }
+    if (entry == NULL) {
+        entry = &cache->entries[cache->next];
+        replaces_oldest = true;
+    }
+
+    // Invalid until completely written
+    entry->secctx.data = NULL;
+
+    uint8_t *cursor = entry->data;
+    uint8_t *end = entry->data + OSCORE_RESPONSE_CACHE_MAXLEN;
+
+    *cursor++ = oscore_msg_native_get_code(response);
+
+    oscore_msg_native_optiter_t iter;
+    uint16_t option_number;
+    const uint8_t *value;
+    size_t value_len;
+    bool fits = true;
+    oscore_msg_native_optiter_init(response, &iter);
+    while (oscore_msg_native_optiter_next(response, &iter, &option_number, &value, &value_len)) {
+        if ((size_t)(end - cursor) < OPTION_HEADER_LEN + value_len) {
+            fits = false;
+            break;
+        }
+        *cursor++ = option_number >> 8;
+        *cursor++ = option_number & 0xff;
+        *cursor++ = value_len >> 8;
+        *cursor++ = value_len & 0xff;
+        if (value_len != 0) {
+            memcpy(cursor, value, value_len);
+            cursor += value_len;
+        }
+    }
+    oscore_msgerr_native_t err = oscore_msg_native_optiter_finish(response, &iter);
+    if (!fits || oscore_msgerr_native_is_error(err)) {
+        return false;
+    }
+    entry->payload_offset = cursor - entry->data;
+
+    uint8_t *payload;
+    size_t payload_len;
+    err = oscore_msg_native_map_payload(response, &payload, &payload_len);
+    if (oscore_msgerr_native_is_error(err) || (size_t)(end - cursor) < payload_len) {
+        return false;
+    }
+    memcpy(cursor, payload, payload_len);
+    cursor += payload_len;
+
+    entry->length = cursor - entry->data;
+    entry->request_piv_len = request_id->used_bytes;
+    memcpy(entry->request_piv, request_id->bytes, PIV_BYTES);
+    entry->secctx = *secctx;
+    if (replaces_oldest) {
+        cache->next = (cache->next + 1) % cache->capacity;
+    }
+    return true;
+}
+
+enum oscore_response_cache_result oscore_response_cache_replay(
+        const struct oscore_response_cache *cache,
+        const oscore_context_t *secctx,
+        const oscore_requestid_t *request_id,
+        oscore_msg_native_t response
+        )
+{
+    const struct oscore_response_cache_entry *entry = NULL;
+    for (size_t i = 0; i < cache->capacity; ++i) {
+        if (entry_matches(&cache->entries[i], secctx, request_id)) {
+            entry = &cache->entries[i];
+            break;
+        }
+    }
+    if (entry == NULL) {
+        return OSCORE_RESPONSE_CACHE_MISS;
+    }
+
+    oscore_msg_native_set_code(response, entry->data[0]);
+
+    const uint8_t *cursor = &entry->data[1];
+    const uint8_t *options_end = entry->data + entry->payload_offset;
+    while (cursor < options_end) {
+        uint16_t option_number = (cursor[0] << 8) | cursor[1];
+        size_t value_len = (cursor[2] << 8) | cursor[3];
+        cursor += OPTION_HEADER_LEN;
+        oscore_msgerr_native_t err = oscore_msg_native_append_option(
+                response,
+                option_number,
+                cursor,
+                value_len);
+        if (oscore_msgerr_native_is_error(err)) {
+            return OSCORE_RESPONSE_CACHE_ERROR;
+        }
+        cursor += value_len;
+    }
+
+    size_t cached_payload_len = entry->length - entry->payload_offset;
+    uint8_t *payload;
+    size_t payload_len;
+    oscore_msgerr_native_t err = oscore_msg_native_map_payload(response, &payload, &payload_len);
+    if (oscore_msgerr_native_is_error(err) || payload_len < cached_payload_len) {
+        return OSCORE_RESPONSE_CACHE_ERROR;
+    }
+    memcpy(payload, options_end, cached_payload_len);
+    err = oscore_msg_native_trim_payload(response, cached_payload_len);
+    if (oscore_msgerr_native_is_error(err)) {
+        return OSCORE_RESPONSE_CACHE_ERROR;
+    }
+
+    return OSCORE_RESPONSE_CACHE_HIT;
+}
@@ -121,6 +121,43 @@ static int test_with(struct testdata *data, int introduce_error)
 
     assert(memcmp(message, arena, sizeof(message)) == 0);
 
+    // Same again, but out of place
+
+    uint8_t ciphertext[sizeof(message) + max_tag_length];
+    err = oscore_crypto_aead_encrypt_start(
+            &encstate,
+            alg,
+            sizeof(aad),
+            sizeof(message),
+            data->nonce,
+            data->key
+            );
+    if (oscore_cryptoerr_is_error(err)) return 50;
+    err = oscore_crypto_aead_encrypt_feed_aad(&encstate, aad, sizeof(aad));
+    if (oscore_cryptoerr_is_error(err)) return 51;
+    err = oscore_crypto_aead_encrypt_outofplace(&encstate, (const uint8_t *)message, ciphertext, sizeof(message) + tag_length);
+    if (oscore_cryptoerr_is_error(err)) return 52;
+
+    assert(memcmp(ciphertext, data->expected_ciphertext, sizeof(message) + tag_length) == 0);
+
+    uint8_t plaintext[sizeof(message)];
+    err = oscore_crypto_aead_decrypt_start(
+            &decstate,
+            alg,
+            sizeof(aad),
+            sizeof(message),
+            data->nonce,
+            data->key
+            );
+    if (oscore_cryptoerr_is_error(err)) return 60;
+    err = oscore_crypto_aead_decrypt_feed_aad(&decstate, aad, sizeof(aad));
+    if (oscore_cryptoerr_is_error(err)) return 61;
+    err = oscore_crypto_aead_decrypt_outofplace(&decstate, ciphertext, sizeof(message) + tag_length, plaintext);
+    if (oscore_cryptoerr_is_error(err)) return 62;
+
+    assert(memcmp(message, plaintext, sizeof(message)) == 0);
+    assert(memcmp(ciphertext, data->expected_ciphertext, sizeof(message) + tag_length) == 0);
+
     return 0;
 }
 
@@ -0,0 +1,148 @@
+#include <stdio.h>
+#include <oscore_native/platform.h>
+#include <oscore_native/message.h>
+#include <oscore_native/test.h>
+#include <oscore/protection.h>
+#include <oscore/context_impl/primitive.h>
+
+#define returning_assert(cond) if(!(cond)) { return 1; }
+
+/* Inner and outer options, and the Observe option that is both */
+static const struct oscore_msg_protected_option options[] = {
+    { .option_number = 3, .value = (const uint8_t *)"host", .value_len = 4 },
+    { .option_number = 4, .value = (const uint8_t *)"etag", .value_len = 4 },
+    { .option_number = 6, .value = (const uint8_t *)"", .value_len = 0 },
+    { .option_number = 11, .value = (const uint8_t *)"a", .value_len = 1 },
+    { .option_number = 11, .value = (const uint8_t *)"bb", .value_len = 2 },
+    { .option_number = 12, .value = (const uint8_t *)"\x2a", .value_len = 1 },
+    { .option_number = 23, .value = (const uint8_t *)"\x06", .value_len = 1 },
+    { .option_number = 39, .value = (const uint8_t *)"coap", .value_len = 4 },
+    { .option_number = 300, .value = (const uint8_t *)"long", .value_len = 4 },
+};
+#define OPTION_COUNT (sizeof(options) / sizeof(options[0]))
+
+/* Compare two native messages through the generic message API */
+static bool same_message(oscore_msg_native_t a, oscore_msg_native_t b)
+{
+    if (oscore_msg_native_get_code(a) != oscore_msg_native_get_code(b)) {
+        return false;
+    }
+
+    oscore_msg_native_optiter_t iter_a, iter_b;
+    uint16_t number_a, number_b;
+    const uint8_t *value_a, *value_b;
+    size_t len_a, len_b;
+    bool same = true;
+    oscore_msg_native_optiter_init(a, &iter_a);
+    oscore_msg_native_optiter_init(b, &iter_b);
+    while (same) {
+        bool more_a = oscore_msg_native_optiter_next(a, &iter_a, &number_a, &value_a, &len_a);
+        bool more_b = oscore_msg_native_optiter_next(b, &iter_b, &number_b, &value_b, &len_b);
+        if (!more_a || !more_b) {
+            same = more_a == more_b;
+            break;
+        }
+        same = number_a == number_b && len_a == len_b && memcmp(value_a, value_b, len_a) == 0;
+    }
+    oscore_msg_native_optiter_finish(a, &iter_a);
+    oscore_msg_native_optiter_finish(b, &iter_b);
+    if (!same) {
+        return false;
+    }
+
+    uint8_t *payload_a, *payload_b;
+    oscore_msg_native_map_payload(a, &payload_a, &len_a);
+    oscore_msg_native_map_payload(b, &payload_b, &len_b);
+    return len_a == len_b && memcmp(payload_a, payload_b, len_a) == 0;
+}
+
+static bool finish(oscore_msg_protected_t *plaintext)
+{
+    oscore_msg_native_t written;
+    return !oscore_msgerr_protected_is_error(oscore_msg_protected_trim_payload(plaintext, 0)) &&
+            oscore_encrypt_message(plaintext, &written) == OSCORE_FINISH_OK;
+}
+
+int testmain(int introduce_error)
+{
+    struct oscore_context_primitive_immutables key = {
+        .sender_id_len = 1,
+        .sender_id = { 0x01 },
+        .common_iv = "d\xf0\xbd" "1MK\xe0<'\x0c+\x1c",
+        .sender_key = "\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11",
+        .recipient_key = "\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22",
+    };
+    returning_assert(!oscore_cryptoerr_is_error(oscore_crypto_aead_from_number(&key.aeadalg, 24)));
+
+    // Two clients in the same state produce the same Partial IV
+    struct oscore_context_primitive primitive[2];
+    oscore_context_t client[2];
+    for (size_t i = 0; i < 2; ++i) {
+        primitive[i] = (struct oscore_context_primitive) { .immutables = &key };
+        client[i] = (oscore_context_t) {
+            .type = OSCORE_CONTEXT_PRIMITIVE,
+            .data = (void*)(&primitive[i]),
+        };
+    }
+
+    oscore_msg_native_t msg[2];
+    oscore_msg_protected_t plaintext;
+    oscore_requestid_t request_id;
+
+    // Appending any prefix of the options at once is equivalent to appending
+    // them one by one
+    for (size_t count = 0; count <= OPTION_COUNT; ++count) {
+        msg[0] = oscore_test_msg_create();
+        returning_assert(oscore_prepare_request(msg[0], &plaintext, &client[0], &request_id) == OSCORE_PREPARE_OK);
+        oscore_msg_protected_set_code(&plaintext, 1);
+        for (size_t i = 0; i < count; ++i) {
+            returning_assert(oscore_msg_protected_append_option(&plaintext,
+                        options[i].option_number, options[i].value, options[i].value_len) == OK);
+        }
+        returning_assert(finish(&plaintext));
+
+        msg[1] = oscore_test_msg_create();
+        returning_assert(oscore_prepare_request(msg[1], &plaintext, &client[1], &request_id) == OSCORE_PREPARE_OK);
+        oscore_msg_protected_set_code(&plaintext, 1);
+        returning_assert(oscore_msg_protected_append_options(&plaintext, options,
+                    introduce_error && count == OPTION_COUNT ? count - 1 : count) == OK);
+        returning_assert(finish(&plaintext));
+
+        returning_assert(same_message(msg[0], msg[1]));
+        for (size_t i = 0; i < 2; ++i) {
+            oscore_test_msg_destroy(msg[i]);
+        }
+    }
+
+    // A failing run of inner options is not appended at all
+    static uint8_t large[2000];
+    const struct oscore_msg_protected_option unsorted[] = {
+        { .option_number = 12, .value = (const uint8_t *)"", .value_len = 0 },
+        { .option_number = 11, .value = (const uint8_t *)"", .value_len = 0 },
+    };
+    const struct oscore_msg_protected_option oversized[] = {
+        { .option_number = 11, .value = (const uint8_t *)"", .value_len = 0 },
+        { .option_number = 60, .value = large, .value_len = sizeof(large) },
+    };
+
+    msg[0] = oscore_test_msg_create();
+    returning_assert(oscore_prepare_request(msg[0], &plaintext, &client[0], &request_id) == OSCORE_PREPARE_OK);
+    oscore_msg_protected_set_code(&plaintext, 1);
+    returning_assert(oscore_msg_protected_append_option(&plaintext, 4, (const uint8_t *)"etag", 4) == OK);
+    returning_assert(finish(&plaintext));
+
+    msg[1] = oscore_test_msg_create();
+    returning_assert(oscore_prepare_request(msg[1], &plaintext, &client[1], &request_id) == OSCORE_PREPARE_OK);
+    oscore_msg_protected_set_code(&plaintext, 1);
+    returning_assert(oscore_msg_protected_append_options(&plaintext, unsorted, 2) == OPTION_SEQUENCE);
+    returning_assert(oscore_msg_protected_append_options(&plaintext, oversized, 2) == OPTION_SIZE);
+    returning_assert(oscore_msg_protected_append_option(&plaintext, 4, (const uint8_t *)"etag", 4) == OK);
+    returning_assert(finish(&plaintext));
+
+    returning_assert(same_message(msg[0], msg[1]));
+    for (size_t i = 0; i < 2; ++i) {
+        oscore_test_msg_destroy(msg[i]);
+    }
+
+    return 0;
+}
@@ -0,0 +1,200 @@
+#include <stdio.h>
+#include <oscore_native/platform.h>
+#include <oscore_native/message.h>
+#include <oscore_native/test.h>
+#include <oscore/protection.h>
+#include <oscore/contextpair.h>
+#include <oscore/context_impl/primitive.h>
+#include <oscore/context_impl/b1.h>
+
+#define returning_assert(cond) if(!(cond)) { return 1; }
+
+static uint32_t fake_now(void *arg)
+{
+    return *(uint32_t*)arg;
+}
+
+static bool find_oscoreoption(oscore_msg_native_t msg, oscore_oscoreoption_t *header)
+{
+    oscore_msg_native_optiter_t iter;
+    uint16_t number;
+    const uint8_t *value;
+    size_t value_len;
+    bool found = false;
+    oscore_msg_native_optiter_init(msg, &iter);
+    while (oscore_msg_native_optiter_next(msg, &iter, &number, &value, &value_len)) {
+        if (number == 9) {
+            found = oscore_oscoreoption_parse(header, value, value_len);
+            break;
+        }
+    }
+    oscore_msg_native_optiter_finish(msg, &iter);
+    return found;
+}
+
+/* Build a GET request from the client, optionally with an Echo option */
+static bool build_request(
+        oscore_msg_native_t msg,
+        oscore_context_t *client,
+        const uint8_t *echo,
+        size_t echo_len
+        )
+{
+    oscore_msg_protected_t plaintext;
+    oscore_requestid_t request_id;
+    oscore_msg_native_t written;
+
+    if (oscore_prepare_request(msg, &plaintext, client, &request_id) != OSCORE_PREPARE_OK) {
+        return false;
+    }
+    oscore_msg_protected_set_code(&plaintext, 1);
+    if (echo_len != 0 && oscore_msgerr_protected_is_error(
+                oscore_msg_protected_append_option(&plaintext, 252, echo, echo_len))) {
+        return false;
+    }
+    if (oscore_msgerr_protected_is_error(oscore_msg_protected_trim_payload(&plaintext, 0))) {
+        return false;
+    }
+    return oscore_encrypt_message(&plaintext, &written) == OSCORE_FINISH_OK;
+}
+
+/* Let the server process the request; returns the result of
+ * oscore_context_b1_process_request, and the final unprotect result */
+static bool receive_request(
+        oscore_msg_native_t msg,
+        oscore_context_t *server,
+        enum oscore_unprotect_request_result *result,
+        oscore_requestid_t *request_id
+        )
+{
+    oscore_oscoreoption_t header;
+    oscore_msg_protected_t unprotected;
+
+    if (!find_oscoreoption(msg, &header)) {
+        *result = OSCORE_UNPROTECT_REQUEST_INVALID;
+        return false;
+    }
+    *result = oscore_unprotect_request(msg, &unprotected, &header, server, request_id);
+    if (*result == OSCORE_UNPROTECT_REQUEST_INVALID) {
+        return false;
+    }
+    return oscore_context_b1_process_request(server, &unprotected, result, request_id);
+}
+
+int testmain(int introduce_error)
+{
+    struct oscore_context_primitive_immutables client_key = {
+        .recipient_id_len = 1,
+        .recipient_id = { 0x01 },
+        .common_iv = "d\xf0\xbd" "1MK\xe0<'\x0c+\x1c",
+        .sender_key = "\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11",
+        .recipient_key = "\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22",
+    };
+    struct oscore_context_primitive_immutables server_key = {
+        .sender_id_len = 1,
+        .sender_id = { 0x01 },
+        .common_iv = "d\xf0\xbd" "1MK\xe0<'\x0c+\x1c",
+        .sender_key = "\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22",
+        .recipient_key = "\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11",
+    };
+    returning_assert(!oscore_cryptoerr_is_error(oscore_crypto_aead_from_number(&client_key.aeadalg, 24)));
+    server_key.aeadalg = client_key.aeadalg;
+
+    struct oscore_context_primitive client_primitive = {
+        .immutables = &client_key,
+    };
+    oscore_context_t client = {
+        .type = OSCORE_CONTEXT_PRIMITIVE,
+        .data = (void*)(&client_primitive),
+    };
+
+    struct oscore_context_b1 server_b1;
+    oscore_context_t server = {
+        .type = OSCORE_CONTEXT_B1,
+        .data = (void*)(&server_b1),
+    };
+    oscore_context_b1_initialize(&server_b1, &server_key, 0, NULL);
+    oscore_context_b1_allow_high(&server_b1, 100);
+
+    uint32_t now = 1000;
+    struct oscore_context_b1_echo_config echo_config = {
+        .key = (const uint8_t *)"per-boot random key material...",
+        .now = fake_now,
+        .now_arg = &now,
+        .lifetime = 10,
+    };
+    returning_assert(!oscore_cryptoerr_is_error(oscore_crypto_aead_from_number(&echo_config.aeadalg, 24)));
+    // HKDF SHA-256
+    returning_assert(!oscore_cryptoerr_is_error(oscore_crypto_hkdf_from_number(&echo_config.hkdfalg, 5)));
+    oscore_context_b1_set_echo_config(&server_b1, &echo_config);
+
+    enum oscore_unprotect_request_result result;
+    oscore_requestid_t request_id;
+
+    // First request: not fresh, the server asks for an Echo
+    oscore_msg_native_t msg = oscore_test_msg_create();
+    returning_assert(build_request(msg, &client, NULL, 0));
+    returning_assert(receive_request(msg, &server, &result, &request_id));
+    returning_assert(result == OSCORE_UNPROTECT_REQUEST_DUPLICATE);
+    oscore_test_msg_destroy(msg);
+
+    oscore_msg_native_t response = oscore_test_msg_create();
+    returning_assert(oscore_context_b1_build_401echo(response, &server, &request_id));
+    oscore_test_msg_destroy(response);
+
+    // Only the response took a sequence number
+    returning_assert(server_b1.primitive.sender_sequence_number == 1);
+
+    uint8_t echo[OSCORE_CONTEXT_B1_ECHO_MAXLEN];
+    size_t echo_len;
+    oscore_context_b1_build_echo(&server, echo, &echo_len);
+    returning_assert(echo_len == 4 + 16);
+
+    // A forged Echo value is not accepted
+    uint8_t forged[OSCORE_CONTEXT_B1_ECHO_MAXLEN];
+    memcpy(forged, echo, echo_len);
+    forged[echo_len - 1] ^= 0x01;
+    msg = oscore_test_msg_create();
+    returning_assert(build_request(msg, &client, forged, echo_len));
+    returning_assert(receive_request(msg, &server, &result, &request_id));
+    returning_assert(result == OSCORE_UNPROTECT_REQUEST_DUPLICATE);
+    oscore_test_msg_destroy(msg);
+
+    // An outdated one is not accepted either
+    now += 11;
+    msg = oscore_test_msg_create();
+    returning_assert(build_request(msg, &client, echo, echo_len));
+    returning_assert(receive_request(msg, &server, &result, &request_id));
+    returning_assert(result == OSCORE_UNPROTECT_REQUEST_DUPLICATE);
+    oscore_test_msg_destroy(msg);
+
+    // A current value recovers the replay window
+    now -= introduce_error ? 0 : 11;
+    msg = oscore_test_msg_create();
+    returning_assert(build_request(msg, &client, echo, echo_len));
+    returning_assert(!receive_request(msg, &server, &result, &request_id));
+    returning_assert(result == OSCORE_UNPROTECT_REQUEST_OK);
+    returning_assert(request_id.is_first_use);
+    oscore_test_msg_destroy(msg);
+
+    // Further requests are processed as usual
+    msg = oscore_test_msg_create();
+    returning_assert(build_request(msg, &client, NULL, 0));
+    returning_assert(!receive_request(msg, &server, &result, &request_id));
+    returning_assert(result == OSCORE_UNPROTECT_REQUEST_OK);
+    oscore_test_msg_destroy(msg);
+
+    // Initializing the context again resets the configuration
+    oscore_context_b1_initialize(&server_b1, &server_key, 100, NULL);
+    oscore_context_b1_allow_high(&server_b1, 200);
+    oscore_context_b1_build_echo(&server, echo, &echo_len);
+    returning_assert(echo_len != 0 && echo_len != 4 + 16);
+    oscore_context_b1_set_echo_config(&server_b1, &echo_config);
+    oscore_context_b1_build_echo(&server, echo, &echo_len);
+    returning_assert(echo_len == 4 + 16);
+    oscore_context_b1_clear_echo_config(&server_b1);
+    oscore_context_b1_build_echo(&server, echo, &echo_len);
+    returning_assert(echo_len != 0 && echo_len != 4 + 16);
+
+    return 0;
+}
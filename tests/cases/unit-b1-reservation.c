@@ -0,0 +1,158 @@
+#include <stdbool.h>
+#include <oscore_native/platform.h>
+
+#include <oscore/contextpair.h>
+#include <oscore/context_impl/b1.h>
+
+// OK is provided by oscore/message.h through b1.h
+const int ERR = 1;
+
+static int take_n(oscore_context_t *secctx, size_t n)
+{
+    oscore_requestid_t id;
+    for (size_t i = 0; i < n; ++i) {
+        if (!oscore_context_take_seqno(secctx, &id)) {
+            return ERR;
+        }
+    }
+    return OK;
+}
+
+/* A single context whose reservations are persisted behind its back */
+static int test_single(int introduce_error)
+{
+    struct oscore_context_primitive_immutables immutables = { 0 };
+    struct oscore_context_b1 b1;
+    oscore_context_t secctx = {
+        .type = OSCORE_CONTEXT_B1,
+        .data = (void*)(&b1),
+    };
+    uint64_t seqno, second;
+    oscore_requestid_t id;
+
+    oscore_context_b1_initialize(&b1, &immutables, 1000, NULL);
+
+    if (oscore_context_take_seqno(&secctx, &id)) {
+        return ERR;
+    }
+
+    if (!oscore_context_b1_reservation_begin(&b1, &seqno)) {
+        return ERR;
+    }
+    // Only one reservation is in flight at any time
+    if (oscore_context_b1_reservation_begin(&b1, &second)) {
+        return ERR;
+    }
+    // Nothing may be used before it is durable
+    if (oscore_context_take_seqno(&secctx, &id)) {
+        return ERR;
+    }
+
+    oscore_context_b1_reservation_durable(&b1, seqno);
+
+    // Fresh reservation: nothing to do until half of it is used up
+    if (oscore_context_b1_reservation_begin(&b1, &second)) {
+        return ERR;
+    }
+    if (take_n(&secctx, (seqno - 1000) / 2 + (introduce_error ? 0 : 1)) != OK) {
+        return ERR;
+    }
+    if (!oscore_context_b1_reservation_begin(&b1, &second) || second <= seqno) {
+        return ERR;
+    }
+
+    // The remainder of the old reservation stays usable while the write is
+    // pending, but not more
+    if (take_n(&secctx, seqno - b1.primitive.sender_sequence_number) != OK) {
+        return ERR;
+    }
+    if (oscore_context_take_seqno(&secctx, &id)) {
+        return ERR;
+    }
+
+    // A failed write can be retried
+    oscore_context_b1_reservation_abandon(&b1);
+    if (oscore_context_take_seqno(&secctx, &id)) {
+        return ERR;
+    }
+    if (!oscore_context_b1_reservation_begin(&b1, &second)) {
+        return ERR;
+    }
+    oscore_context_b1_reservation_durable(&b1, second);
+    if (!oscore_context_take_seqno(&secctx, &id)) {
+        return ERR;
+    }
+
+    return OK;
+}
+
+/* Several contexts persisted in a single write */
+static int test_batch(void)
+{
+    struct oscore_context_primitive_immutables immutables = { 0 };
+    struct oscore_context_b1 b1[3];
+    struct oscore_context_b1_reservation entries[2];
+    struct oscore_context_b1_batch batch;
+    const struct oscore_context_b1_reservation *collected;
+
+    for (size_t i = 0; i < 3; ++i) {
+        oscore_context_b1_initialize(&b1[i], &immutables, 10 * i, NULL);
+    }
+
+    oscore_context_b1_batch_init(&batch, entries, 2);
+    if (!oscore_context_b1_batch_collect(&batch, &b1[0]) ||
+            !oscore_context_b1_batch_collect(&batch, &b1[1])) {
+        return ERR;
+    }
+    // Full
+    if (oscore_context_b1_batch_collect(&batch, &b1[2])) {
+        return ERR;
+    }
+
+    if (oscore_context_b1_batch_get(&batch, &collected) != 2 ||
+            collected[0].secctx != &b1[0] ||
+            collected[1].secctx != &b1[1]) {
+        return ERR;
+    }
+
+    oscore_context_b1_batch_durable(&batch);
+
+    if (oscore_context_b1_batch_get(&batch, &collected) != 0) {
+        return ERR;
+    }
+    if (b1[0].high_sequence_number <= 0 || b1[1].high_sequence_number <= 10) {
+        return ERR;
+    }
+
+    // Contexts that are well provisioned are skipped
+    if (!oscore_context_b1_batch_collect(&batch, &b1[0]) ||
+            !oscore_context_b1_batch_collect(&batch, &b1[2])) {
+        return ERR;
+    }
+    if (oscore_context_b1_batch_get(&batch, &collected) != 1 ||
+            collected[0].secctx != &b1[2]) {
+        return ERR;
+    }
+
+    oscore_context_b1_batch_abandon(&batch);
+    if (b1[2].high_sequence_number != 20) {
+        return ERR;
+    }
+    // ... and can be collected again after an abandoned write
+    if (!oscore_context_b1_batch_collect(&batch, &b1[2]) ||
+            oscore_context_b1_batch_get(&batch, &collected) != 1) {
+        return ERR;
+    }
+
+    return OK;
+}
+
+int testmain(int introduce_error)
+{
+    int result = OK;
+
+    result |= test_single(introduce_error) << 0;
+    result |= test_batch() << 1;
+
+    return result;
+}
@@ -0,0 +1,122 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <oscore_native/platform.h>
+
+#include <oscore/context_impl/b1_ringlog.h>
+
+const int OK = 0;
+const int ERR = 1;
+
+#define PAGE_SIZE 64
+#define PAGE_COUNT 3
+
+/* Flash emulation backed by a file, behaving like NOR flash in that writes
+ * can only clear bits */
+struct flashfile {
+    FILE *file;
+    size_t erase_count;
+};
+
+static bool flashfile_read(void *arg, size_t offset, void *buf, size_t len)
+{
+    struct flashfile *ff = arg;
+    return fseek(ff->file, offset, SEEK_SET) == 0 && fread(buf, 1, len, ff->file) == len;
+}
+
+static bool flashfile_write(void *arg, size_t offset, const void *buf, size_t len)
+{
+    struct flashfile *ff = arg;
+    uint8_t old[PAGE_SIZE];
+    assert(len <= sizeof(old));
+    if (!flashfile_read(arg, offset, old, len)) {
+        return false;
+    }
+    for (size_t i = 0; i < len; ++i) {
+        old[i] &= ((const uint8_t *)buf)[i];
+    }
+    return fseek(ff->file, offset, SEEK_SET) == 0 && fwrite(old, 1, len, ff->file) == len;
+}
+
+static bool flashfile_erase(void *arg, size_t page)
+{
+    struct flashfile *ff = arg;
+    uint8_t erased[PAGE_SIZE];
+    memset(erased, 0xff, sizeof(erased));
+    ff->erase_count += 1;
+    return fseek(ff->file, page * PAGE_SIZE, SEEK_SET) == 0 && fwrite(erased, 1, PAGE_SIZE, ff->file) == PAGE_SIZE;
+}
+
+int testmain(int introduce_error)
+{
+    struct flashfile ff = { .file = tmpfile() };
+    if (ff.file == NULL) {
+        return ERR;
+    }
+    // Fresh from the factory
+    for (size_t page = 0; page < PAGE_COUNT; ++page) {
+        flashfile_erase(&ff, page);
+    }
+    ff.erase_count = 0;
+
+    struct oscore_context_b1_flash flash = {
+        .page_size = PAGE_SIZE,
+        .page_count = PAGE_COUNT,
+        .read = flashfile_read,
+        .write = flashfile_write,
+        .erase = flashfile_erase,
+        .arg = &ff,
+    };
+    struct oscore_context_b1_ringlog log;
+    uint64_t value;
+
+    if (!oscore_context_b1_ringlog_open(&log, &flash) ||
+            oscore_context_b1_ringlog_latest(&log, &value)) {
+        return ERR;
+    }
+
+    // 4 records per page; this wraps around the ring twice
+    uint64_t last = 0;
+    for (int i = 1; i <= 30; ++i) {
+        last = i * 100;
+        if (!oscore_context_b1_ringlog_append(&log, last)) {
+            return ERR;
+        }
+    }
+    if (ff.erase_count != 8) {
+        return ERR;
+    }
+    if (oscore_context_b1_ringlog_append(&log, introduce_error ? last + 1 : last)) {
+        return ERR;
+    }
+
+    if (!oscore_context_b1_ringlog_open(&log, &flash) ||
+            !oscore_context_b1_ringlog_latest(&log, &value) ||
+            value != last) {
+        return ERR;
+    }
+
+    // A torn write in the next slot is ignored, and skipped over
+    uint8_t torn[4] = { 0x12, 0x34, 0x56, 0x78 };
+    flashfile_write(&ff, log.page * PAGE_SIZE + log.slot * OSCORE_CONTEXT_B1_RINGLOG_RECORD_SIZE, torn, sizeof(torn));
+
+    if (!oscore_context_b1_ringlog_open(&log, &flash) ||
+            !oscore_context_b1_ringlog_latest(&log, &value) ||
+            value != last) {
+        return ERR;
+    }
+    for (int i = 0; i < 4; ++i) {
+        last += 1;
+        if (!oscore_context_b1_ringlog_append(&log, last)) {
+            return ERR;
+        }
+    }
+    if (!oscore_context_b1_ringlog_open(&log, &flash) ||
+            !oscore_context_b1_ringlog_latest(&log, &value) ||
+            value != last) {
+        return ERR;
+    }
+
+    fclose(ff.file);
+
+    return OK;
+}
@@ -0,0 +1,299 @@
+#include <stdbool.h>
+#include <oscore_native/platform.h>
+
+#include <oscore/contextpair.h>
+#include <oscore/context_impl/b1_store.h>
+
+// OK is provided by oscore/message.h through b1.h
+const int ERR = 1;
+
+#define RECORDS 4
+
+// Declared as uint64_t to get the alignment of a memory mapped area
+static uint64_t memory[OSCORE_CONTEXT_B1_STORE_SIZE(RECORDS) / sizeof(uint64_t) + 1];
+
+static const struct oscore_context_primitive_immutables immutables = { 0 };
+
+static bool is_first_use(struct oscore_context_b1 *b1, uint8_t seqno)
+{
+    oscore_context_t secctx = {
+        .type = OSCORE_CONTEXT_B1,
+        .data = (void*)b1,
+    };
+    oscore_requestid_t id = {
+        .used_bytes = 1,
+        .bytes = {0, 0, 0, 0, seqno},
+    };
+    oscore_context_strikeout_requestid(&secctx, &id);
+    return id.is_first_use;
+}
+
+/* Periodic checkpoints only write contexts that were active */
+static int test_checkpoint(void)
+{
+    static uint64_t cp_memory[OSCORE_CONTEXT_B1_STORE_SIZE(RECORDS) / sizeof(uint64_t) + 1];
+    struct oscore_context_b1_store store;
+    struct oscore_context_b1 b1[2];
+    size_t offset, length;
+
+    oscore_context_b1_store_format(&store, cp_memory, OSCORE_CONTEXT_B1_STORE_SIZE(RECORDS));
+    for (size_t i = 0; i < 2; ++i) {
+        oscore_context_b1_store_set_high(&store, i, 100);
+        oscore_context_b1_store_restore(&store, i, &b1[i], &immutables);
+        b1[i].primitive.replay_window_left_edge = 0;
+        b1[i].primitive.replay_window = 0;
+    }
+
+    if (!oscore_context_b1_store_checkpoint(&store, 0, &b1[0]) ||
+            !oscore_context_b1_store_checkpoint(&store, 1, &b1[1])) {
+        return ERR;
+    }
+    oscore_context_b1_store_take_dirty(&store, &offset, &length);
+
+    if (!is_first_use(&b1[1], 3)) {
+        return ERR;
+    }
+    if (oscore_context_b1_store_checkpoint(&store, 0, &b1[0]) ||
+            !oscore_context_b1_store_checkpoint(&store, 1, &b1[1])) {
+        return ERR;
+    }
+    if (!oscore_context_b1_store_take_dirty(&store, &offset, &length) ||
+            offset != OSCORE_CONTEXT_B1_STORE_SIZE(1) ||
+            length != OSCORE_CONTEXT_B1_STORE_SIZE(1) - OSCORE_CONTEXT_B1_STORE_SIZE(0)) {
+        return ERR;
+    }
+
+    // A request that is not new changes nothing
+    if (is_first_use(&b1[1], 3)) {
+        return ERR;
+    }
+    if (oscore_context_b1_store_checkpoint(&store, 1, &b1[1])) {
+        return ERR;
+    }
+
+    oscore_context_b1_store_seal(&store);
+
+    if (oscore_context_b1_store_open(&store, cp_memory, OSCORE_CONTEXT_B1_STORE_SIZE(RECORDS)) != OSCORE_CONTEXT_B1_STORE_OPEN_OK) {
+        return ERR;
+    }
+    if (!oscore_context_b1_store_restore(&store, 1, &b1[1], &immutables) ||
+            is_first_use(&b1[1], 3) || !is_first_use(&b1[1], 4)) {
+        return ERR;
+    }
+
+    // Restoring the same record again in this run must not bring back the
+    // window from before request 4 was received
+    if (!oscore_context_b1_store_restore(&store, 1, &b1[1], &immutables) ||
+            b1[1].primitive.replay_window_left_edge != OSCORE_SEQNO_MAX ||
+            is_first_use(&b1[1], 4)) {
+        return ERR;
+    }
+
+    // After a crash, the checkpoints of the previous run are not used, and
+    // are rewritten at the next checkpoint
+    if (oscore_context_b1_store_open(&store, cp_memory, OSCORE_CONTEXT_B1_STORE_SIZE(RECORDS)) != OSCORE_CONTEXT_B1_STORE_OPEN_OK) {
+        return ERR;
+    }
+    if (!oscore_context_b1_store_restore(&store, 1, &b1[1], &immutables) ||
+            b1[1].primitive.replay_window_left_edge != OSCORE_SEQNO_MAX) {
+        return ERR;
+    }
+    if (!oscore_context_b1_store_checkpoint(&store, 1, &b1[1])) {
+        return ERR;
+    }
+
+    return OK;
+}
+
+/* Damaged stores are left alone, and stores can grow but not shrink */
+static int test_open(void)
+{
+    static uint64_t open_memory[OSCORE_CONTEXT_B1_STORE_SIZE(RECORDS) / sizeof(uint64_t) + 1];
+    struct oscore_context_b1_store store;
+    struct oscore_context_b1 b1;
+
+    oscore_context_b1_store_format(&store, open_memory, OSCORE_CONTEXT_B1_STORE_SIZE(2));
+    oscore_context_b1_store_set_high(&store, 1, 500);
+
+    ((uint8_t*)open_memory)[4] ^= 0x01;
+    if (oscore_context_b1_store_open(&store, open_memory, OSCORE_CONTEXT_B1_STORE_SIZE(2)) != OSCORE_CONTEXT_B1_STORE_OPEN_INVALID) {
+        return ERR;
+    }
+    ((uint8_t*)open_memory)[4] ^= 0x01;
+
+    if (oscore_context_b1_store_open(&store, open_memory, OSCORE_CONTEXT_B1_STORE_SIZE(1)) != OSCORE_CONTEXT_B1_STORE_OPEN_TRUNCATED) {
+        return ERR;
+    }
+
+    // Garbage after the old end of the store is not taken for records
+    memset((uint8_t*)open_memory + OSCORE_CONTEXT_B1_STORE_SIZE(2), 0xff,
+            OSCORE_CONTEXT_B1_STORE_SIZE(RECORDS) - OSCORE_CONTEXT_B1_STORE_SIZE(2));
+    if (oscore_context_b1_store_open(&store, open_memory, OSCORE_CONTEXT_B1_STORE_SIZE(RECORDS)) != OSCORE_CONTEXT_B1_STORE_OPEN_OK ||
+            oscore_context_b1_store_capacity(&store) != RECORDS) {
+        return ERR;
+    }
+    if (!oscore_context_b1_store_restore(&store, 1, &b1, &immutables) ||
+            b1.high_sequence_number != 500) {
+        return ERR;
+    }
+    if (oscore_context_b1_store_restore(&store, 3, &b1, &immutables)) {
+        return ERR;
+    }
+
+    // The grown store opens as it is
+    if (oscore_context_b1_store_open(&store, open_memory, OSCORE_CONTEXT_B1_STORE_SIZE(RECORDS)) != OSCORE_CONTEXT_B1_STORE_OPEN_OK ||
+            oscore_context_b1_store_capacity(&store) != RECORDS) {
+        return ERR;
+    }
+
+    return OK;
+}
+
+#define MANY_RECORDS 12
+
+/* Separate changes are reported separately, up to the number of tracked
+ * ranges, beyond which the closest ones are joined */
+static int test_dirty(void)
+{
+    static uint64_t dirty_memory[OSCORE_CONTEXT_B1_STORE_SIZE(MANY_RECORDS) / sizeof(uint64_t) + 1];
+    struct oscore_context_b1_store store;
+    size_t offset, length;
+    const size_t record = OSCORE_CONTEXT_B1_STORE_SIZE(1) - OSCORE_CONTEXT_B1_STORE_SIZE(0);
+
+    oscore_context_b1_store_format(&store, dirty_memory, OSCORE_CONTEXT_B1_STORE_SIZE(MANY_RECORDS));
+    while (oscore_context_b1_store_take_dirty(&store, &offset, &length));
+
+    oscore_context_b1_store_set_high(&store, 5, 100);
+    oscore_context_b1_store_set_high(&store, 1, 100);
+    oscore_context_b1_store_set_high(&store, 5, 200);
+    oscore_context_b1_store_set_high(&store, 6, 100);
+    if (!oscore_context_b1_store_take_dirty(&store, &offset, &length) ||
+            offset != OSCORE_CONTEXT_B1_STORE_SIZE(1) || length != record) {
+        return ERR;
+    }
+    if (!oscore_context_b1_store_take_dirty(&store, &offset, &length) ||
+            offset != OSCORE_CONTEXT_B1_STORE_SIZE(5) || length != 2 * record) {
+        return ERR;
+    }
+    if (oscore_context_b1_store_take_dirty(&store, &offset, &length)) {
+        return ERR;
+    }
+
+#if OSCORE_CONTEXT_B1_STORE_DIRTY_RANGES == 4
+    // Records 3 and 5 are closer to each other than any other pair
+    const size_t changed[] = {0, 3, 5, 8, 11};
+    for (size_t i = 0; i < sizeof(changed) / sizeof(changed[0]); ++i) {
+        oscore_context_b1_store_set_high(&store, changed[i], 100);
+    }
+    const size_t expected[4][2] = {{0, 1}, {3, 6}, {8, 9}, {11, 12}};
+    for (size_t i = 0; i < 4; ++i) {
+        if (!oscore_context_b1_store_take_dirty(&store, &offset, &length) ||
+                offset != OSCORE_CONTEXT_B1_STORE_SIZE(expected[i][0]) ||
+                offset + length != OSCORE_CONTEXT_B1_STORE_SIZE(expected[i][1])) {
+            return ERR;
+        }
+    }
+    if (oscore_context_b1_store_take_dirty(&store, &offset, &length)) {
+        return ERR;
+    }
+#endif
+
+    return OK;
+}
+
+int testmain(int introduce_error)
+{
+    if (test_checkpoint() != OK) {
+        return ERR;
+    }
+    if (test_open() != OK) {
+        return ERR;
+    }
+    if (test_dirty() != OK) {
+        return ERR;
+    }
+
+    struct oscore_context_b1_store store;
+    struct oscore_context_b1 b1;
+    size_t offset, length;
+
+    if (oscore_context_b1_store_open(&store, memory, OSCORE_CONTEXT_B1_STORE_SIZE(RECORDS)) != OSCORE_CONTEXT_B1_STORE_OPEN_EMPTY) {
+        return ERR;
+    }
+    oscore_context_b1_store_format(&store, memory, OSCORE_CONTEXT_B1_STORE_SIZE(RECORDS));
+    if (oscore_context_b1_store_capacity(&store) != RECORDS) {
+        return ERR;
+    }
+    // A fresh store needs to be written out completely
+    if (!oscore_context_b1_store_take_dirty(&store, &offset, &length) ||
+            offset != 0 || length != OSCORE_CONTEXT_B1_STORE_SIZE(RECORDS)) {
+        return ERR;
+    }
+    if (oscore_context_b1_store_take_dirty(&store, &offset, &length)) {
+        return ERR;
+    }
+
+    oscore_context_b1_store_set_high(&store, 2, 1000);
+    if (!oscore_context_b1_store_take_dirty(&store, &offset, &length) ||
+            offset != OSCORE_CONTEXT_B1_STORE_SIZE(2) ||
+            length != OSCORE_CONTEXT_B1_STORE_SIZE(1) - OSCORE_CONTEXT_B1_STORE_SIZE(0)) {
+        return ERR;
+    }
+
+    if (oscore_context_b1_store_restore(&store, 1, &b1, &immutables)) {
+        return ERR;
+    }
+    if (!oscore_context_b1_store_restore(&store, 2, &b1, &immutables) ||
+            b1.high_sequence_number != 1000 ||
+            b1.primitive.sender_sequence_number != 1000) {
+        return ERR;
+    }
+
+    // Receive some requests, and shut down cleanly
+    b1.primitive.replay_window_left_edge = 0;
+    b1.primitive.replay_window = 0;
+    if (!is_first_use(&b1, 5)) {
+        return ERR;
+    }
+    oscore_context_b1_store_save_replay(&store, 2, &b1);
+    oscore_context_b1_store_seal(&store);
+
+    // Start up from the sealed store
+    if (oscore_context_b1_store_open(&store, memory, OSCORE_CONTEXT_B1_STORE_SIZE(RECORDS)) != OSCORE_CONTEXT_B1_STORE_OPEN_OK) {
+        return ERR;
+    }
+    // Unsealing needs to be persisted
+    if (!oscore_context_b1_store_take_dirty(&store, &offset, &length) || offset != 0) {
+        return ERR;
+    }
+    if (!oscore_context_b1_store_restore(&store, 2, &b1, &immutables)) {
+        return ERR;
+    }
+    if (is_first_use(&b1, 5) || !is_first_use(&b1, 6)) {
+        return ERR;
+    }
+
+    // Crash without sealing: no replay data is available any more
+    if (oscore_context_b1_store_open(&store, memory, OSCORE_CONTEXT_B1_STORE_SIZE(RECORDS)) != OSCORE_CONTEXT_B1_STORE_OPEN_OK) {
+        return ERR;
+    }
+    if (!oscore_context_b1_store_restore(&store, 2, &b1, &immutables) ||
+            b1.primitive.replay_window_left_edge != OSCORE_SEQNO_MAX) {
+        return ERR;
+    }
+
+    // Damaged records are not restored
+    if (!introduce_error) {
+        ((uint8_t*)memory)[OSCORE_CONTEXT_B1_STORE_SIZE(2) + 8] ^= 0x01;
+    }
+    if (oscore_context_b1_store_restore(&store, 2, &b1, &immutables)) {
+        return ERR;
+    }
+
+    oscore_context_b1_store_clear(&store, 2);
+    if (oscore_context_b1_store_restore(&store, 2, &b1, &immutables)) {
+        return ERR;
+    }
+
+    return OK;
+}
@@ -0,0 +1,223 @@
+#include <stdio.h>
+#include <oscore_native/platform.h>
+#include <oscore_native/message.h>
+#include <oscore_native/test.h>
+#include <oscore/protection.h>
+#include <oscore/blockwise.h>
+#include <oscore/context_impl/primitive.h>
+
+#define returning_assert(cond) if(!(cond)) { return 1; }
+
+static uint8_t representation[3000];
+
+static bool read_representation(void *state, size_t offset, uint8_t *buffer, size_t buffer_len)
+{
+    (void)state;
+    if (offset + buffer_len > sizeof(representation)) {
+        return false;
+    }
+    memcpy(buffer, &representation[offset], buffer_len);
+    return true;
+}
+
+static bool find_oscoreoption(oscore_msg_native_t msg, oscore_oscoreoption_t *header)
+{
+    oscore_msg_native_optiter_t iter;
+    uint16_t number;
+    const uint8_t *value;
+    size_t value_len;
+    bool found = false;
+    oscore_msg_native_optiter_init(msg, &iter);
+    while (oscore_msg_native_optiter_next(msg, &iter, &number, &value, &value_len)) {
+        if (number == 9) {
+            found = oscore_oscoreoption_parse(header, value, value_len);
+            break;
+        }
+    }
+    oscore_msg_native_optiter_finish(msg, &iter);
+    return found;
+}
+
+struct exchange {
+    oscore_context_t *client;
+    oscore_context_t *server;
+};
+
+/* Block that the client expects in the response */
+struct expected {
+    enum oscore_block2_result result;
+    uint32_t num;
+    uint8_t szx;
+    bool more;
+    size_t payload_len;
+};
+
+/* Request a block of a representation of the given length, and check the
+ * response */
+static bool exchange(
+        const struct exchange *peers,
+        size_t length,
+        uint32_t num,
+        uint8_t szx,
+        const struct expected *expected
+        )
+{
+    oscore_msg_native_t request = oscore_test_msg_create();
+    oscore_msg_native_t response = oscore_test_msg_create();
+    oscore_msg_protected_t plaintext;
+    oscore_requestid_t client_request_id;
+    oscore_msg_native_t written;
+    bool success = false;
+
+    if (oscore_prepare_request(request, &plaintext, peers->client, &client_request_id) != OSCORE_PREPARE_OK) {
+        goto out;
+    }
+    oscore_msg_protected_set_code(&plaintext, 1);
+    uint32_t numeric = (num << 4) | szx;
+    uint8_t block2[2] = { numeric >> 8, numeric & 0xff };
+    size_t block2_len = numeric > 0xff ? 2 : numeric != 0 ? 1 : 0;
+    if (oscore_msgerr_protected_is_error(oscore_msg_protected_append_option(&plaintext, 23, &block2[2 - block2_len], block2_len)) ||
+            oscore_msgerr_protected_is_error(oscore_msg_protected_trim_payload(&plaintext, 0)) ||
+            oscore_encrypt_message(&plaintext, &written) != OSCORE_FINISH_OK) {
+        goto out;
+    }
+
+    oscore_oscoreoption_t header;
+    oscore_msg_protected_t unprotected;
+    oscore_requestid_t server_request_id;
+    oscore_request_aad_t request_aad;
+    if (!find_oscoreoption(request, &header) ||
+            oscore_unprotect_request_aad(request, &unprotected, &header, peers->server,
+                &server_request_id, &request_aad) != OSCORE_UNPROTECT_REQUEST_OK) {
+        goto out;
+    }
+    struct oscore_block2_request block;
+    bool parsed = oscore_block2_parse(&unprotected, &block) == OK;
+    oscore_release_unprotected(&unprotected);
+    if (!parsed || block.num != num || block.szx != szx) {
+        goto out;
+    }
+
+    if (oscore_prepare_response_aad(response, &plaintext, peers->server, &server_request_id, &request_aad) != OSCORE_PREPARE_OK) {
+        goto out;
+    }
+    oscore_msg_protected_set_code(&plaintext, 0x45);
+    // Content-Format: text/plain
+    if (oscore_msgerr_protected_is_error(oscore_msg_protected_append_option(&plaintext, 12, (const uint8_t *)"", 0))) {
+        goto out;
+    }
+    struct oscore_block2_source source = {
+        .read = read_representation,
+        .length = length,
+    };
+    if (oscore_block2_write(&plaintext, &source, &block) != expected->result) {
+        goto out;
+    }
+    if (expected->result != OSCORE_BLOCK2_OK) {
+        success = true;
+        goto out;
+    }
+    if (oscore_encrypt_message(&plaintext, &written) != OSCORE_FINISH_OK ||
+            !find_oscoreoption(response, &header) ||
+            oscore_unprotect_response(response, &unprotected, &header, peers->client,
+                &client_request_id) != OSCORE_UNPROTECT_RESPONSE_OK) {
+        goto out;
+    }
+
+    oscore_msg_protected_optiter_t iter;
+    uint16_t number;
+    const uint8_t *value;
+    size_t value_len;
+    bool found = false;
+    oscore_msg_protected_optiter_init(&unprotected, &iter);
+    while (oscore_msg_protected_optiter_next(&unprotected, &iter, &number, &value, &value_len)) {
+        if (number != 23) {
+            continue;
+        }
+        numeric = 0;
+        for (size_t i = 0; i < value_len; ++i) {
+            numeric = (numeric << 8) | value[i];
+        }
+        found = (numeric >> 4) == expected->num &&
+                (numeric & 0x7) == expected->szx &&
+                ((numeric & 0x8) != 0) == expected->more;
+    }
+    uint8_t *payload;
+    size_t payload_len;
+    success = !oscore_msgerr_protected_is_error(oscore_msg_protected_optiter_finish(&unprotected, &iter)) &&
+            found &&
+            oscore_msg_protected_map_payload(&unprotected, &payload, &payload_len) == OK &&
+            payload_len == expected->payload_len &&
+            (payload_len == 0 ||
+             memcmp(payload, &representation[expected->num << (expected->szx + 4)], payload_len) == 0);
+    oscore_release_unprotected(&unprotected);
+
+out:
+    oscore_test_msg_destroy(request);
+    oscore_test_msg_destroy(response);
+    return success;
+}
+
+int testmain(int introduce_error)
+{
+    struct oscore_context_primitive_immutables client_key = {
+        .sender_id_len = 1,
+        .sender_id = { 0x01 },
+        .common_iv = "d\xf0\xbd" "1MK\xe0<'\x0c+\x1c",
+        .sender_key = "\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11",
+        .recipient_key = "\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22",
+    };
+    struct oscore_context_primitive_immutables server_key = {
+        .recipient_id_len = 1,
+        .recipient_id = { 0x01 },
+        .common_iv = "d\xf0\xbd" "1MK\xe0<'\x0c+\x1c",
+        .sender_key = "\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22",
+        .recipient_key = "\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11",
+    };
+    returning_assert(!oscore_cryptoerr_is_error(oscore_crypto_aead_from_number(&client_key.aeadalg, 24)));
+    server_key.aeadalg = client_key.aeadalg;
+
+    struct oscore_context_primitive client_primitive = {
+        .immutables = &client_key,
+    };
+    oscore_context_t client = {
+        .type = OSCORE_CONTEXT_PRIMITIVE,
+        .data = (void*)(&client_primitive),
+    };
+    struct oscore_context_primitive server_primitive = {
+        .immutables = &server_key,
+    };
+    oscore_context_t server = {
+        .type = OSCORE_CONTEXT_PRIMITIVE,
+        .data = (void*)(&server_primitive),
+    };
+    struct exchange peers = { &client, &server };
+
+    for (size_t i = 0; i < sizeof(representation); ++i) {
+        representation[i] = i * 7;
+    }
+
+    // 1024 byte blocks do not fit into the test backend's messages, so the
+    // block size is reduced, and the number scaled up to the same offset
+    returning_assert(exchange(&peers, 1300, 0, 6, &(struct expected) { OSCORE_BLOCK2_OK, 0, 5, true, 512 }));
+    returning_assert(exchange(&peers, 3000, 1, 6, &(struct expected) { OSCORE_BLOCK2_OK, 2, 5, true, 512 }));
+
+    // Only the last block has the M bit unset
+    returning_assert(exchange(&peers, 1300, 1, 5, &(struct expected) { OSCORE_BLOCK2_OK, 1, 5, true, 512 }));
+    returning_assert(exchange(&peers, 1300, 2, 5, &(struct expected) { OSCORE_BLOCK2_OK, 2, 5, introduce_error, 276 }));
+    returning_assert(exchange(&peers, 1024, 1, 5, &(struct expected) { OSCORE_BLOCK2_OK, 1, 5, false, 512 }));
+    returning_assert(exchange(&peers, 1300, 81, 0, &(struct expected) { OSCORE_BLOCK2_OK, 81, 0, false, 4 }));
+
+    // A short last block fits even at a block size that would not
+    returning_assert(exchange(&peers, 1300, 1, 6, &(struct expected) { OSCORE_BLOCK2_OK, 1, 6, false, 276 }));
+
+    // Blocks past the end
+    returning_assert(exchange(&peers, 1300, 3, 5, &(struct expected) { OSCORE_BLOCK2_OUT_OF_RANGE }));
+    returning_assert(exchange(&peers, 1024, 2, 5, &(struct expected) { OSCORE_BLOCK2_OUT_OF_RANGE }));
+
+    // The empty representation is a single empty block
+    returning_assert(exchange(&peers, 0, 0, 6, &(struct expected) { OSCORE_BLOCK2_OK, 0, 6, false, 0 }));
+    returning_assert(exchange(&peers, 0, 1, 6, &(struct expected) { OSCORE_BLOCK2_OUT_OF_RANGE }));
+
+    return 0;
+}
@@ -0,0 +1,178 @@
+#include <stdio.h>
+#include <oscore_native/platform.h>
+#include <oscore_native/message.h>
+#include <oscore_native/crypto.h>
+#include <oscore_native/test.h>
+#include <oscore/protection.h>
+#include <oscore/context_impl/primitive.h>
+
+#define returning_assert(cond) if(!(cond)) { return 1; }
+
+// Elective options registered as Class I for this test
+#define OPTNUM_LARGE 65000
+#define OPTNUM_SMALL 65004
+#define LARGE_LEN 300
+
+#define MAX_TAG_LENGTH 16
+
+// AAD of the request below, built by hand following RFC8613 Section 5.4;
+// the large option's value sits between head and tail.
+static const uint8_t aad_head[] = {
+    // Encrypt0 array of 3: "Encrypt0", h'', and a 319 byte external AAD
+    0x83, 0x68, 'E', 'n', 'c', 'r', 'y', 'p', 't', '0', 0x40, 0x59, 0x01, 0x3f,
+    // external AAD array of 5: version 1, [ChaCha20/Poly1305], h'01', h'00'
+    0x85, 0x01, 0x81, 0x18, 0x18, 0x41, 0x01, 0x41, 0x00,
+    // 307 bytes of Class I options, starting with delta 65000 and length 300
+    0x59, 0x01, 0x33, 0xee, 0xfc, 0xdb, 0x00, 0x1f,
+};
+static const uint8_t aad_tail[] = {
+    // delta 4 from the previous Class I option, length 1
+    0x41, 'x',
+};
+// Code GET, Uri-Path "a", payload "hi"
+static const uint8_t plaintext[] = { 0x01, 0xb1, 'a', 0xff, 'h', 'i' };
+// Sender ID 01 and Partial IV 0, to be XORed onto the common IV
+static const uint8_t nonce_input[] = { 0x01, 0, 0, 0, 0, 0, 0x01, 0, 0, 0, 0, 0 };
+
+static bool find_oscoreoption(oscore_msg_native_t msg, oscore_oscoreoption_t *header)
+{
+    oscore_msg_native_optiter_t iter;
+    uint16_t number;
+    const uint8_t *value;
+    size_t value_len;
+    bool found = false;
+    oscore_msg_native_optiter_init(msg, &iter);
+    while (oscore_msg_native_optiter_next(msg, &iter, &number, &value, &value_len)) {
+        if (number == 9) {
+            found = oscore_oscoreoption_parse(header, value, value_len);
+            break;
+        }
+    }
+    oscore_msg_native_optiter_finish(msg, &iter);
+    return found;
+}
+
+static bool build_request(oscore_msg_native_t msg, oscore_context_t *client, const uint8_t *large)
+{
+    oscore_msg_protected_t plaintext;
+    oscore_requestid_t request_id;
+    oscore_msg_native_t written;
+
+    if (oscore_prepare_request(msg, &plaintext, client, &request_id) != OSCORE_PREPARE_OK) {
+        return false;
+    }
+    oscore_msg_protected_set_code(&plaintext, 1);
+    if (oscore_msgerr_protected_is_error(oscore_msg_protected_append_option(&plaintext, 11, (const uint8_t *)"a", 1)) ||
+            oscore_msgerr_protected_is_error(oscore_msg_protected_append_option(&plaintext, OPTNUM_LARGE, large, LARGE_LEN)) ||
+            oscore_msgerr_protected_is_error(oscore_msg_protected_append_option(&plaintext, OPTNUM_SMALL, (const uint8_t *)"x", 1))) {
+        return false;
+    }
+    uint8_t *payload;
+    size_t payload_len;
+    if (oscore_msgerr_protected_is_error(oscore_msg_protected_map_payload(&plaintext, &payload, &payload_len)) ||
+            payload_len < 2) {
+        return false;
+    }
+    memcpy(payload, "hi", 2);
+    if (oscore_msgerr_protected_is_error(oscore_msg_protected_trim_payload(&plaintext, 2))) {
+        return false;
+    }
+    return oscore_encrypt_message(&plaintext, &written) == OSCORE_FINISH_OK;
+}
+
+int testmain(int introduce_error)
+{
+    struct oscore_context_primitive_immutables client_key = {
+        .sender_id_len = 1,
+        .sender_id = { 0x01 },
+        .common_iv = "d\xf0\xbd" "1MK\xe0<'\x0c+\x1c",
+        .sender_key = "\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11",
+        .recipient_key = "\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22",
+    };
+    struct oscore_context_primitive_immutables server_key = {
+        .recipient_id_len = 1,
+        .recipient_id = { 0x01 },
+        .common_iv = "d\xf0\xbd" "1MK\xe0<'\x0c+\x1c",
+        .sender_key = "\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22",
+        .recipient_key = "\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11",
+    };
+    returning_assert(!oscore_cryptoerr_is_error(oscore_crypto_aead_from_number(&client_key.aeadalg, 24)));
+    server_key.aeadalg = client_key.aeadalg;
+
+    struct oscore_context_primitive client_primitive = {
+        .immutables = &client_key,
+    };
+    oscore_context_t client = {
+        .type = OSCORE_CONTEXT_PRIMITIVE,
+        .data = (void*)(&client_primitive),
+    };
+    struct oscore_context_primitive server_primitive = {
+        .immutables = &server_key,
+    };
+    oscore_context_t server = {
+        .type = OSCORE_CONTEXT_PRIMITIVE,
+        .data = (void*)(&server_primitive),
+    };
+
+    returning_assert(oscore_option_register_class(OPTNUM_LARGE, OSCORE_OPTION_CLASS_I));
+    returning_assert(oscore_option_register_class(OPTNUM_SMALL, OSCORE_OPTION_CLASS_I));
+
+    uint8_t large[LARGE_LEN];
+    memset(large, 'v', sizeof(large));
+
+    oscore_msg_native_t msg = oscore_test_msg_create();
+    returning_assert(build_request(msg, &client, large));
+    returning_assert(oscore_option_class_i_length(msg) == 5 + LARGE_LEN + 2);
+
+    // Encrypt the same plaintext with the hand-built AAD
+    uint8_t aad[sizeof(aad_head) + LARGE_LEN + sizeof(aad_tail)];
+    memcpy(aad, aad_head, sizeof(aad_head));
+    memset(&aad[sizeof(aad_head)], 'v', LARGE_LEN);
+    memcpy(&aad[sizeof(aad_head) + LARGE_LEN], aad_tail, sizeof(aad_tail));
+    if (introduce_error) {
+        aad[sizeof(aad) - 1] ^= 0x01;
+    }
+
+    uint8_t nonce[sizeof(nonce_input)];
+    returning_assert(oscore_crypto_aead_get_ivlength(client_key.aeadalg) == sizeof(nonce));
+    for (size_t i = 0; i < sizeof(nonce); ++i) {
+        nonce[i] = nonce_input[i] ^ client_key.common_iv[i];
+    }
+
+    size_t tag_length = oscore_crypto_aead_get_taglength(client_key.aeadalg);
+    returning_assert(tag_length <= MAX_TAG_LENGTH);
+    uint8_t expected[sizeof(plaintext) + MAX_TAG_LENGTH];
+    memcpy(expected, plaintext, sizeof(plaintext));
+    oscore_crypto_aead_encryptstate_t state;
+    returning_assert(!oscore_cryptoerr_is_error(oscore_crypto_aead_encrypt_start(&state,
+                client_key.aeadalg, sizeof(aad), sizeof(plaintext), nonce, client_key.sender_key)));
+    returning_assert(!oscore_cryptoerr_is_error(oscore_crypto_aead_encrypt_feed_aad(&state, aad, sizeof(aad))));
+    returning_assert(!oscore_cryptoerr_is_error(oscore_crypto_aead_encrypt_inplace(&state, expected, sizeof(plaintext) + tag_length)));
+
+    uint8_t *ciphertext;
+    size_t ciphertext_len;
+    oscore_msg_native_map_payload(msg, &ciphertext, &ciphertext_len);
+    returning_assert(ciphertext_len == sizeof(plaintext) + tag_length);
+    returning_assert(memcmp(ciphertext, expected, ciphertext_len) == 0);
+
+    // The server reads the Class I options from the outer message
+    oscore_oscoreoption_t header;
+    oscore_msg_protected_t unprotected;
+    oscore_requestid_t request_id;
+    returning_assert(find_oscoreoption(msg, &header));
+    returning_assert(oscore_unprotect_request(msg, &unprotected, &header, &server, &request_id) == OSCORE_UNPROTECT_REQUEST_OK);
+    oscore_release_unprotected(&unprotected);
+    oscore_test_msg_destroy(msg);
+
+    // An intermediary can not alter them
+    client_primitive.sender_sequence_number = 1;
+    msg = oscore_test_msg_create();
+    returning_assert(build_request(msg, &client, large));
+    large[0] = 'w';
+    returning_assert(!oscore_msgerr_native_is_error(oscore_msg_native_update_option(msg, OPTNUM_LARGE, 0, large, LARGE_LEN)));
+    returning_assert(find_oscoreoption(msg, &header));
+    returning_assert(oscore_unprotect_request(msg, &unprotected, &header, &server, &request_id) == OSCORE_UNPROTECT_REQUEST_INVALID);
+    oscore_test_msg_destroy(msg);
+
+    return 0;
+}
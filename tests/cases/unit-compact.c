@@ -0,0 +1,138 @@
+#include <stdio.h>
+#include <oscore_native/platform.h>
+#include <oscore_native/message.h>
+#include <oscore_native/test.h>
+#include <oscore/protection.h>
+#include <oscore/context_impl/primitive.h>
+
+#define returning_assert(cond) if(!(cond)) { return 1; }
+
+static const uint8_t body[] = "compact";
+#define BODY_LEN (sizeof(body) - 1)
+
+static bool find_oscoreoption(oscore_msg_native_t msg, oscore_oscoreoption_t *header)
+{
+    oscore_msg_native_optiter_t iter;
+    uint16_t number;
+    const uint8_t *value;
+    size_t value_len;
+    bool found = false;
+    oscore_msg_native_optiter_init(msg, &iter);
+    while (oscore_msg_native_optiter_next(msg, &iter, &number, &value, &value_len)) {
+        if (number == 9) {
+            found = oscore_oscoreoption_parse(header, value, value_len);
+            break;
+        }
+    }
+    oscore_msg_native_optiter_finish(msg, &iter);
+    return found;
+}
+
+/* Check that a received message has the content sent by the test */
+static bool check_request(oscore_msg_protected_t *msg, bool introduce_error)
+{
+    if (oscore_msg_protected_get_code(msg) != 1) {
+        return false;
+    }
+
+    const uint16_t expected[] = { 11, 12 };
+    oscore_msg_protected_optiter_t iter;
+    uint16_t number;
+    const uint8_t *value;
+    size_t value_len;
+    size_t count = 0;
+    bool good = true;
+    oscore_msg_protected_optiter_init(msg, &iter);
+    while (oscore_msg_protected_optiter_next(msg, &iter, &number, &value, &value_len)) {
+        good = good && count < sizeof(expected) / sizeof(expected[0]) && number == expected[count];
+        count += 1;
+    }
+    if (oscore_msgerr_protected_is_error(oscore_msg_protected_optiter_finish(msg, &iter)) ||
+            !good || count != sizeof(expected) / sizeof(expected[0])) {
+        return false;
+    }
+
+    uint8_t *payload;
+    size_t payload_len;
+    return oscore_msg_protected_map_payload(msg, &payload, &payload_len) == OK &&
+            payload_len == BODY_LEN - introduce_error &&
+            memcmp(payload, body, payload_len) == 0;
+}
+
+int testmain(int introduce_error)
+{
+    struct oscore_context_primitive_immutables client_key = {
+        .sender_id_len = 1,
+        .sender_id = { 0x01 },
+        .common_iv = "d\xf0\xbd" "1MK\xe0<'\x0c+\x1c",
+        .sender_key = "\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11",
+        .recipient_key = "\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22",
+    };
+    struct oscore_context_primitive_immutables server_key = {
+        .recipient_id_len = 1,
+        .recipient_id = { 0x01 },
+        .common_iv = "d\xf0\xbd" "1MK\xe0<'\x0c+\x1c",
+        .sender_key = "\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22",
+        .recipient_key = "\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11",
+    };
+    returning_assert(!oscore_cryptoerr_is_error(oscore_crypto_aead_from_number(&client_key.aeadalg, 24)));
+    server_key.aeadalg = client_key.aeadalg;
+
+    struct oscore_context_primitive client_primitive = {
+        .immutables = &client_key,
+    };
+    oscore_context_t client = {
+        .type = OSCORE_CONTEXT_PRIMITIVE,
+        .data = (void*)(&client_primitive),
+    };
+    struct oscore_context_primitive server_primitive = {
+        .immutables = &server_key,
+    };
+    oscore_context_t server = {
+        .type = OSCORE_CONTEXT_PRIMITIVE,
+        .data = (void*)(&server_primitive),
+    };
+
+    oscore_msg_native_t msg = oscore_test_msg_create();
+    oscore_msg_protected_t plaintext;
+    oscore_requestid_t request_id;
+    returning_assert(oscore_prepare_request(msg, &plaintext, &client, &request_id) == OSCORE_PREPARE_OK);
+    oscore_msg_protected_set_code(&plaintext, 1);
+    returning_assert(oscore_msg_protected_append_option(&plaintext, 11, (const uint8_t *)"a", 1) == OK);
+    returning_assert(oscore_msg_protected_append_option(&plaintext, 12, (const uint8_t *)"\x2a", 1) == OK);
+    uint8_t *payload;
+    size_t payload_len;
+    returning_assert(oscore_msg_protected_map_payload(&plaintext, &payload, &payload_len) == OK);
+    returning_assert(payload_len >= BODY_LEN);
+    memcpy(payload, body, BODY_LEN);
+    returning_assert(oscore_msg_protected_trim_payload(&plaintext, BODY_LEN) == OK);
+    oscore_msg_native_t written;
+    returning_assert(oscore_encrypt_message(&plaintext, &written) == OSCORE_FINISH_OK);
+
+    oscore_oscoreoption_t header;
+    oscore_msg_protected_t unprotected;
+    returning_assert(find_oscoreoption(msg, &header));
+    returning_assert(oscore_unprotect_request(msg, &unprotected, &header, &server, &request_id) == OSCORE_UNPROTECT_REQUEST_OK);
+
+    returning_assert(sizeof(oscore_msg_protected_compact_t) < sizeof(oscore_msg_protected_t));
+
+    // Stored before anything was read, and expanded into garbage
+    oscore_msg_protected_compact_t compact;
+    oscore_msg_protected_compact(&compact, &unprotected);
+    memset(&unprotected, 0xaa, sizeof(unprotected));
+    oscore_msg_protected_expand(&unprotected, &compact);
+    returning_assert(check_request(&unprotected, false));
+
+    // Stored after the payload position was found, and expanded twice
+    oscore_msg_protected_compact(&compact, &unprotected);
+    for (size_t i = 0; i < 2; ++i) {
+        memset(&unprotected, 0xaa, sizeof(unprotected));
+        oscore_msg_protected_expand(&unprotected, &compact);
+        returning_assert(check_request(&unprotected, introduce_error && i == 1));
+    }
+
+    oscore_release_unprotected(&unprotected);
+    oscore_test_msg_destroy(msg);
+
+    return 0;
+}
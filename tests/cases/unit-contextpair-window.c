@@ -32,6 +32,11 @@ static int test_sequence(
 
     for (; numbers->terminator == false; ++numbers) {
         oscore_requestid_t id = requestid_from_u64(numbers->seqno);
+        // The check without side effects needs to agree with the actual
+        // processing, especially at the edges of the window
+        if (oscore_context_is_replay(ctx, &id) == numbers->expect_success) {
+            return ERR;
+        }
         oscore_context_strikeout_requestid(ctx, &id);
         if (id.is_first_use != numbers->expect_success) {
             return ERR;
@@ -109,9 +114,11 @@ int testmain(int introduce_error)
         { high - 10, false },
         // Just below the limit
         { high - 33, false },
+        // At the left edge
         { high - 32, true },
         { high - 32, false },
         { high + 10, true },
+        // At the right end of the window
         { high + 10, false },
         // Freshly below the limit
         { high - 30, false },
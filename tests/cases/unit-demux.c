@@ -0,0 +1,128 @@
+#include <stdio.h>
+#include <oscore_native/platform.h>
+#include <oscore_native/message.h>
+#include <oscore_native/test.h>
+#include <oscore/protection.h>
+#include <oscore/context_impl/primitive.h>
+
+#define returning_assert(cond) if(!(cond)) { return 1; }
+
+static int lookups;
+
+/* Find the server context for the only client, whose KID is 0x05 */
+static oscore_context_t *lookup(void *state, const uint8_t *kid, size_t kid_len, const uint8_t *kid_context, size_t kid_context_len)
+{
+    (void)kid_context;
+    (void)kid_context_len;
+    lookups += 1;
+    if (kid != NULL && kid_len == 1 && kid[0] == 0x05) {
+        return state;
+    }
+    return NULL;
+}
+
+static oscore_msg_native_t build_request(oscore_context_t *client)
+{
+    oscore_msg_native_t msg = oscore_test_msg_create();
+    oscore_msg_protected_t plaintext;
+    oscore_requestid_t request_id;
+    oscore_msg_native_t written;
+
+    if (oscore_prepare_request(msg, &plaintext, client, &request_id) != OSCORE_PREPARE_OK) {
+        return msg;
+    }
+    oscore_msg_protected_set_code(&plaintext, 1);
+    oscore_msg_protected_trim_payload(&plaintext, 0);
+    oscore_encrypt_message(&plaintext, &written);
+    return msg;
+}
+
+/* Build a message with nothing but the given OSCORE option value */
+static oscore_msg_native_t build_raw(const uint8_t *value, size_t value_len)
+{
+    oscore_msg_native_t msg = oscore_test_msg_create();
+    oscore_msg_native_append_option(msg, 9, value, value_len);
+    return msg;
+}
+
+int testmain(int introduce_error)
+{
+    struct oscore_context_primitive_immutables client_key = {
+        .sender_id_len = 1,
+        .sender_id = { 0x05 },
+        .common_iv = "d\xf0\xbd" "1MK\xe0<'\x0c+\x1c",
+        .sender_key = "\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11",
+        .recipient_key = "\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22",
+    };
+    struct oscore_context_primitive_immutables server_key = {
+        .recipient_id_len = 1,
+        .recipient_id = { 0x05 },
+        .common_iv = "d\xf0\xbd" "1MK\xe0<'\x0c+\x1c",
+        .sender_key = "\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22",
+        .recipient_key = "\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11",
+    };
+    returning_assert(!oscore_cryptoerr_is_error(oscore_crypto_aead_from_number(&client_key.aeadalg, 24)));
+    server_key.aeadalg = client_key.aeadalg;
+
+    struct oscore_context_primitive client_primitive = {
+        .immutables = &client_key,
+    };
+    oscore_context_t client = {
+        .type = OSCORE_CONTEXT_PRIMITIVE,
+        .data = (void*)(&client_primitive),
+    };
+    struct oscore_context_primitive server_primitive = {
+        .immutables = &server_key,
+    };
+    oscore_context_t server = {
+        .type = OSCORE_CONTEXT_PRIMITIVE,
+        .data = (void*)(&server_primitive),
+    };
+
+    oscore_demux_t demux;
+    oscore_msg_protected_t unprotected;
+    oscore_requestid_t request_id;
+    oscore_msg_native_t msg;
+
+    // Rejections that need neither a lookup nor any cryptography
+    msg = oscore_test_msg_create();
+    oscore_msg_native_append_option(msg, 11, (const uint8_t *)"a", 1);
+    returning_assert(oscore_demux_request(msg, lookup, &server, &demux) == OSCORE_DEMUX_NOT_OSCORE);
+    oscore_test_msg_destroy(msg);
+
+    msg = build_raw((const uint8_t *)"\xff", 1);
+    returning_assert(oscore_demux_request(msg, lookup, &server, &demux) == OSCORE_DEMUX_MALFORMED);
+    oscore_test_msg_destroy(msg);
+
+    // A request without a Partial IV
+    msg = build_raw((const uint8_t *)"", 0);
+    returning_assert(oscore_demux_request(msg, lookup, &server, &demux) == OSCORE_DEMUX_MALFORMED);
+    oscore_test_msg_destroy(msg);
+    returning_assert(lookups == 0);
+
+    // Partial IV 0, KID 0x07
+    msg = build_raw((const uint8_t *)"\x09\x00\x07", 3);
+    returning_assert(oscore_demux_request(msg, lookup, &server, &demux) == OSCORE_DEMUX_UNKNOWN_KID);
+    oscore_test_msg_destroy(msg);
+
+    msg = build_request(&client);
+    returning_assert(oscore_demux_request(msg, lookup, &server, &demux) == OSCORE_DEMUX_OK);
+    returning_assert(demux.secctx == &server);
+    // Demultiplexing alone does not take the sequence number
+    returning_assert(oscore_demux_request(msg, lookup, &server, &demux) == OSCORE_DEMUX_OK);
+    returning_assert(oscore_unprotect_demuxed(msg, &unprotected, &demux, &request_id) == OSCORE_UNPROTECT_REQUEST_OK);
+    returning_assert(oscore_msg_protected_get_code(&unprotected) == 1);
+    oscore_release_unprotected(&unprotected);
+    oscore_test_msg_destroy(msg);
+
+    // A replay is recognized before decryption, but can still be decrypted
+    client_primitive.sender_sequence_number = introduce_error ? 1 : 0;
+    msg = build_request(&client);
+    returning_assert(oscore_demux_request(msg, lookup, &server, &demux) == OSCORE_DEMUX_REPLAY);
+    returning_assert(demux.secctx == &server);
+    returning_assert(oscore_unprotect_demuxed(msg, &unprotected, &demux, &request_id) == OSCORE_UNPROTECT_REQUEST_DUPLICATE);
+    oscore_release_unprotected(&unprotected);
+    oscore_test_msg_destroy(msg);
+
+    return 0;
+}
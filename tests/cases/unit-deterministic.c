@@ -0,0 +1,291 @@
+#include <stdio.h>
+#include <oscore_native/platform.h>
+#include <oscore_native/message.h>
+#include <oscore_native/test.h>
+#include <oscore/protection.h>
+#include <oscore/context_impl/primitive.h>
+
+#define returning_assert(cond) if(!(cond)) { return 1; }
+
+static bool find_oscoreoption(oscore_msg_native_t msg, oscore_oscoreoption_t *header)
+{
+    oscore_msg_native_optiter_t iter;
+    uint16_t number;
+    const uint8_t *value;
+    size_t value_len;
+    bool found = false;
+    oscore_msg_native_optiter_init(msg, &iter);
+    while (oscore_msg_native_optiter_next(msg, &iter, &number, &value, &value_len)) {
+        if (number == 9) {
+            found = oscore_oscoreoption_parse(header, value, value_len);
+            break;
+        }
+    }
+    oscore_msg_native_optiter_finish(msg, &iter);
+    return found;
+}
+
+/* Compare two native messages through the generic message API */
+static bool same_message(oscore_msg_native_t a, oscore_msg_native_t b)
+{
+    if (oscore_msg_native_get_code(a) != oscore_msg_native_get_code(b)) {
+        return false;
+    }
+
+    oscore_msg_native_optiter_t iter_a, iter_b;
+    uint16_t number_a, number_b;
+    const uint8_t *value_a, *value_b;
+    size_t len_a, len_b;
+    bool same = true;
+    oscore_msg_native_optiter_init(a, &iter_a);
+    oscore_msg_native_optiter_init(b, &iter_b);
+    while (same) {
+        bool more_a = oscore_msg_native_optiter_next(a, &iter_a, &number_a, &value_a, &len_a);
+        bool more_b = oscore_msg_native_optiter_next(b, &iter_b, &number_b, &value_b, &len_b);
+        if (!more_a || !more_b) {
+            same = more_a == more_b;
+            break;
+        }
+        same = number_a == number_b && len_a == len_b && memcmp(value_a, value_b, len_a) == 0;
+    }
+    oscore_msg_native_optiter_finish(a, &iter_a);
+    oscore_msg_native_optiter_finish(b, &iter_b);
+    if (!same) {
+        return false;
+    }
+
+    uint8_t *payload_a, *payload_b;
+    oscore_msg_native_map_payload(a, &payload_a, &len_a);
+    oscore_msg_native_map_payload(b, &payload_b, &len_b);
+    return len_a == len_b && memcmp(payload_a, payload_b, len_a) == 0;
+}
+
+/* Build a deterministic request through a proxy */
+static bool build_request(
+        oscore_msg_native_t msg,
+        oscore_context_t *client,
+        const oscore_msg_protected_template_t *tpl,
+        oscore_crypto_hkdfalg_t hkdfalg,
+        oscore_requestid_t *request_id,
+        oscore_deterministic_t *deterministic
+        )
+{
+    oscore_msg_protected_t plaintext;
+    oscore_msg_native_t written;
+
+    if (oscore_prepare_request_deterministic(msg, &plaintext, client, request_id, tpl, hkdfalg, deterministic) != OSCORE_PREPARE_OK) {
+        return false;
+    }
+    if (oscore_msgerr_protected_is_error(oscore_msg_protected_append_option(&plaintext, 3, (const uint8_t *)"proxy", 5))) {
+        return false;
+    }
+    // The inner options are covered by the request hash, and can only come
+    // from the template
+    if (oscore_msg_protected_append_option(&plaintext, 14, NULL, 0) != INVALID_ARG_ERROR) {
+        return false;
+    }
+    if (oscore_msgerr_protected_is_error(oscore_msg_protected_apply_template(&plaintext, tpl))) {
+        return false;
+    }
+    return oscore_encrypt_message(&plaintext, &written) == OSCORE_FINISH_OK;
+}
+
+static bool build_response(
+        oscore_msg_native_t msg,
+        oscore_context_t *server,
+        oscore_requestid_t *request_id,
+        const oscore_deterministic_t *deterministic
+        )
+{
+    oscore_msg_protected_t plaintext;
+    oscore_msg_native_t written;
+    uint8_t *payload;
+    size_t payload_len;
+
+    if (oscore_prepare_response_deterministic(msg, &plaintext, server, request_id, deterministic) != OSCORE_PREPARE_OK) {
+        return false;
+    }
+    if (oscore_msgerr_protected_is_error(oscore_msg_protected_map_payload(&plaintext, &payload, &payload_len)) ||
+            payload_len < 3) {
+        return false;
+    }
+    memcpy(payload, "v=1", 3);
+    if (oscore_msgerr_protected_is_error(oscore_msg_protected_trim_payload(&plaintext, 3))) {
+        return false;
+    }
+    return oscore_encrypt_message(&plaintext, &written) == OSCORE_FINISH_OK;
+}
+
+int testmain(int introduce_error)
+{
+    // Two clients share the deterministic client's context
+    struct oscore_context_primitive_immutables client_key = {
+        .sender_id_len = 1,
+        .sender_id = { 0xdc },
+        .common_iv = "d\xf0\xbd" "1MK\xe0<'\x0c+\x1c",
+        .sender_key = "\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11",
+        .recipient_key = "\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22",
+    };
+    struct oscore_context_primitive_immutables server_key = {
+        .recipient_id_len = 1,
+        .recipient_id = { 0xdc },
+        .common_iv = "d\xf0\xbd" "1MK\xe0<'\x0c+\x1c",
+        .sender_key = "\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22",
+        .recipient_key = "\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11",
+    };
+    returning_assert(!oscore_cryptoerr_is_error(oscore_crypto_aead_from_number(&client_key.aeadalg, 24)));
+    server_key.aeadalg = client_key.aeadalg;
+    oscore_crypto_hkdfalg_t hkdfalg;
+    // HKDF SHA-256
+    returning_assert(!oscore_cryptoerr_is_error(oscore_crypto_hkdf_from_number(&hkdfalg, 5)));
+
+    struct oscore_context_primitive client_primitive[2] = {
+        { .immutables = &client_key },
+        { .immutables = &client_key, .sender_sequence_number = 100 },
+    };
+    oscore_context_t client[2] = {
+        { .type = OSCORE_CONTEXT_PRIMITIVE, .data = (void*)(&client_primitive[0]) },
+        { .type = OSCORE_CONTEXT_PRIMITIVE, .data = (void*)(&client_primitive[1]) },
+    };
+    struct oscore_context_primitive server_primitive = {
+        .immutables = &server_key,
+    };
+    oscore_context_t server = {
+        .type = OSCORE_CONTEXT_PRIMITIVE,
+        .data = (void*)(&server_primitive),
+    };
+
+    struct oscore_msg_protected_option options[] = {
+        { .option_number = 11, .value = (const uint8_t *)"config", .value_len = 6 },
+    };
+    oscore_msg_protected_template_t tpl;
+    returning_assert(oscore_msg_protected_template_build(&tpl, 1, options, 1, NULL, 0) == OK);
+
+    oscore_msg_native_t request[2];
+    oscore_requestid_t client_request_id[2];
+    oscore_deterministic_t client_deterministic[2];
+    for (size_t i = 0; i < 2; ++i) {
+        request[i] = oscore_test_msg_create();
+        returning_assert(build_request(request[i], &client[i], &tpl, hkdfalg, &client_request_id[i], &client_deterministic[i]));
+    }
+
+    // Independent of the clients' sequence numbers, the requests are the same
+    returning_assert(same_message(request[0], request[1]));
+    returning_assert(oscore_msg_native_get_code(request[0]) == 5);
+
+    oscore_oscoreoption_t header;
+    oscore_msg_protected_t unprotected;
+    oscore_requestid_t server_request_id;
+    oscore_deterministic_t server_deterministic;
+
+    returning_assert(find_oscoreoption(request[0], &header));
+    returning_assert(oscore_unprotect_request_deterministic(request[0], &unprotected, &header,
+                &server, &server_request_id, hkdfalg, &server_deterministic) == OSCORE_UNPROTECT_REQUEST_OK);
+    returning_assert(oscore_msg_protected_get_code(&unprotected) == 1);
+    returning_assert(memcmp(server_deterministic.hash, client_deterministic[0].hash, OSCORE_REQUEST_HASH_LEN) == 0);
+    oscore_release_unprotected(&unprotected);
+
+    // The response is protected with the request's key, which both clients
+    // have; decryption is in place, so each gets a response of its own
+    oscore_msg_native_t response;
+    uint8_t *payload;
+    size_t payload_len;
+    for (size_t i = 0; i < 2; ++i) {
+        response = oscore_test_msg_create();
+        returning_assert(build_response(response, &server, &server_request_id, &server_deterministic));
+        returning_assert(find_oscoreoption(response, &header));
+        returning_assert(header.partial_iv_len != 0);
+        returning_assert(oscore_unprotect_response_deterministic(response, &unprotected, &header,
+                    &client[i], &client_request_id[i], &client_deterministic[i]) == OSCORE_UNPROTECT_RESPONSE_OK);
+        returning_assert(oscore_msg_protected_map_payload(&unprotected, &payload, &payload_len) == OK);
+        returning_assert(payload_len == 3 && memcmp(payload, "v=1", 3) == 0);
+        oscore_release_unprotected(&unprotected);
+        oscore_test_msg_destroy(response);
+    }
+
+    // A response without a Partial IV would reuse the request's nonce
+    response = oscore_test_msg_create();
+    oscore_msg_native_set_code(response, 0x44);
+    oscore_msg_native_append_option(response, 9, (const uint8_t *)"", 0);
+    returning_assert(find_oscoreoption(response, &header));
+    returning_assert(oscore_unprotect_response_deterministic(response, &unprotected, &header,
+                &client[0], &client_request_id[0], &client_deterministic[0]) == OSCORE_UNPROTECT_RESPONSE_INVALID);
+    oscore_test_msg_destroy(response);
+
+    // A request whose hash does not match its content is rejected
+    uint8_t tampered[OSCORE_REQUEST_HASH_LEN];
+    memcpy(tampered, client_deterministic[1].hash, sizeof(tampered));
+    tampered[0] ^= introduce_error ? 0x00 : 0x01;
+    returning_assert(!oscore_msgerr_native_is_error(oscore_msg_native_update_option(request[1], OSCORE_OPTNUM_REQUEST_HASH, 0, tampered, sizeof(tampered))));
+    returning_assert(find_oscoreoption(request[1], &header));
+    returning_assert(oscore_unprotect_request_deterministic(request[1], &unprotected, &header,
+                &server, &server_request_id, hkdfalg, &server_deterministic) == OSCORE_UNPROTECT_REQUEST_INVALID);
+
+    for (size_t i = 0; i < 2; ++i) {
+        oscore_test_msg_destroy(request[i]);
+    }
+
+    // Without replay protection, requests with side effects are refused
+    oscore_msg_protected_template_t unsafe_tpl;
+    returning_assert(oscore_msg_protected_template_build(&unsafe_tpl, 2, options, 1, NULL, 0) == OK);
+    request[0] = oscore_test_msg_create();
+    returning_assert(oscore_prepare_request_deterministic(request[0], &unprotected, &client[0],
+                &client_request_id[0], &unsafe_tpl, hkdfalg, &client_deterministic[0]) == OSCORE_PREPARE_ERROR_METHOD);
+    oscore_test_msg_destroy(request[0]);
+
+    // A client can still derive hash and key of such a request on its own.
+    // The request dependent part of the AAD is that of any request with
+    // Partial IV 0 from the deterministic client.
+    struct oscore_context_primitive plain_primitive = { .immutables = &client_key };
+    oscore_context_t plain = { .type = OSCORE_CONTEXT_PRIMITIVE, .data = (void*)(&plain_primitive) };
+    oscore_msg_native_t written;
+    oscore_request_aad_t request_aad;
+    request[0] = oscore_test_msg_create();
+    returning_assert(oscore_prepare_request(request[0], &unprotected, &plain, &client_request_id[0]) == OSCORE_PREPARE_OK);
+    oscore_msg_protected_set_code(&unprotected, 1);
+    returning_assert(oscore_msg_protected_trim_payload(&unprotected, 0) == OK);
+    returning_assert(oscore_encrypt_message(&unprotected, &written) == OSCORE_FINISH_OK);
+    returning_assert(find_oscoreoption(request[0], &header));
+    returning_assert(oscore_unprotect_request_aad(request[0], &unprotected, &header,
+                &server, &server_request_id, &request_aad) == OSCORE_UNPROTECT_REQUEST_OK);
+    oscore_release_unprotected(&unprotected);
+    oscore_test_msg_destroy(request[0]);
+
+    // Forging a GET request shows that the derivation matches; the same with
+    // POST is rejected
+    const oscore_msg_protected_template_t *forged_tpl[2] = { &tpl, &unsafe_tpl };
+    for (size_t i = 0; i < 2; ++i) {
+        size_t key_len = oscore_crypto_aead_get_keylength(client_key.aeadalg);
+        oscore_deterministic_t forged;
+        returning_assert(!oscore_cryptoerr_is_error(oscore_crypto_hkdf_derive(hkdfalg,
+                        client_key.sender_key, key_len,
+                        forged_tpl[i]->plaintext, forged_tpl[i]->length,
+                        request_aad.bytes, request_aad.length,
+                        forged.hash, OSCORE_REQUEST_HASH_LEN)));
+        returning_assert(!oscore_cryptoerr_is_error(oscore_crypto_hkdf_derive(hkdfalg,
+                        client_key.sender_key, key_len,
+                        forged.hash, OSCORE_REQUEST_HASH_LEN,
+                        (const uint8_t *)"Key", 3,
+                        forged.key, key_len)));
+
+        struct oscore_context_primitive_immutables forger_key = client_key;
+        memcpy(forger_key.sender_key, forged.key, key_len);
+        struct oscore_context_primitive forger_primitive = { .immutables = &forger_key };
+        oscore_context_t forger = { .type = OSCORE_CONTEXT_PRIMITIVE, .data = (void*)(&forger_primitive) };
+
+        request[0] = oscore_test_msg_create();
+        returning_assert(oscore_prepare_request(request[0], &unprotected, &forger, &client_request_id[0]) == OSCORE_PREPARE_OK);
+        returning_assert(oscore_msg_protected_append_option(&unprotected, OSCORE_OPTNUM_REQUEST_HASH, forged.hash, OSCORE_REQUEST_HASH_LEN) == OK);
+        returning_assert(oscore_msg_protected_apply_template(&unprotected, forged_tpl[i]) == OK);
+        returning_assert(oscore_encrypt_message(&unprotected, &written) == OSCORE_FINISH_OK);
+
+        returning_assert(find_oscoreoption(request[0], &header));
+        enum oscore_unprotect_request_result expected = i == 0 ?
+            OSCORE_UNPROTECT_REQUEST_OK : OSCORE_UNPROTECT_REQUEST_INVALID;
+        returning_assert(oscore_unprotect_request_deterministic(request[0], &unprotected, &header,
+                    &server, &server_request_id, hkdfalg, &server_deterministic) == expected);
+        oscore_test_msg_destroy(request[0]);
+    }
+
+    return 0;
+}
@@ -0,0 +1,207 @@
+#include <stdio.h>
+#include <oscore_native/platform.h>
+#include <oscore_native/message.h>
+#include <oscore_native/test.h>
+#include <oscore/protection.h>
+#include <oscore/context_impl/primitive.h>
+
+#define returning_assert(cond) if(!(cond)) { return 1; }
+
+#define OBSERVERS 3
+
+static const uint8_t temperature[] = "23.5";
+
+static bool find_oscoreoption(oscore_msg_native_t msg, oscore_oscoreoption_t *header)
+{
+    oscore_msg_native_optiter_t iter;
+    uint16_t number;
+    const uint8_t *value;
+    size_t value_len;
+    bool found = false;
+    oscore_msg_native_optiter_init(msg, &iter);
+    while (oscore_msg_native_optiter_next(msg, &iter, &number, &value, &value_len)) {
+        if (number == 9) {
+            found = oscore_oscoreoption_parse(header, value, value_len);
+            break;
+        }
+    }
+    oscore_msg_native_optiter_finish(msg, &iter);
+    return found;
+}
+
+/* Send an Observe registration and receive it at the server */
+static bool register_observer(
+        oscore_context_t *client,
+        oscore_context_t *server,
+        oscore_requestid_t *client_request_id,
+        oscore_requestid_t *server_request_id,
+        oscore_request_aad_t *request_aad
+        )
+{
+    oscore_msg_native_t msg = oscore_test_msg_create();
+    oscore_msg_protected_t plaintext;
+    oscore_msg_native_t written;
+    oscore_oscoreoption_t header;
+    bool success = false;
+
+    if (oscore_prepare_request(msg, &plaintext, client, client_request_id) != OSCORE_PREPARE_OK) {
+        goto out;
+    }
+    oscore_msg_protected_set_code(&plaintext, 1);
+    if (oscore_msgerr_protected_is_error(oscore_msg_protected_append_option(&plaintext, 6, (const uint8_t *)"", 0)) ||
+            oscore_msgerr_protected_is_error(oscore_msg_protected_trim_payload(&plaintext, 0)) ||
+            oscore_encrypt_message(&plaintext, &written) != OSCORE_FINISH_OK) {
+        goto out;
+    }
+    if (!find_oscoreoption(msg, &header) ||
+            oscore_unprotect_request_aad(msg, &plaintext, &header, server, server_request_id, request_aad) != OSCORE_UNPROTECT_REQUEST_OK) {
+        goto out;
+    }
+    oscore_release_unprotected(&plaintext);
+    success = true;
+
+out:
+    oscore_test_msg_destroy(msg);
+    return success;
+}
+
+/* Check that a notification carries the template's content */
+static bool check_notification(oscore_msg_protected_t *msg)
+{
+    if (oscore_msg_protected_get_code(msg) != 0x45) {
+        return false;
+    }
+
+    oscore_msg_protected_optiter_t iter;
+    uint16_t number;
+    const uint8_t *value;
+    size_t value_len;
+    const uint16_t expected[] = { 6, 12 };
+    size_t count = 0;
+    bool good = true;
+    oscore_msg_protected_optiter_init(msg, &iter);
+    while (oscore_msg_protected_optiter_next(msg, &iter, &number, &value, &value_len)) {
+        good = good && count < sizeof(expected) / sizeof(expected[0]) && number == expected[count];
+        count += 1;
+    }
+    if (oscore_msgerr_protected_is_error(oscore_msg_protected_optiter_finish(msg, &iter)) ||
+            !good || count != sizeof(expected) / sizeof(expected[0])) {
+        return false;
+    }
+
+    uint8_t *payload;
+    size_t payload_len;
+    return oscore_msg_protected_map_payload(msg, &payload, &payload_len) == OK &&
+            payload_len == sizeof(temperature) - 1 &&
+            memcmp(payload, temperature, payload_len) == 0;
+}
+
+int testmain(int introduce_error)
+{
+    // Each observer has a security context of its own, with keys of its own
+    struct oscore_context_primitive_immutables client_key[OBSERVERS], server_key[OBSERVERS];
+    struct oscore_context_primitive client_primitive[OBSERVERS], server_primitive[OBSERVERS];
+    oscore_context_t client[OBSERVERS], server[OBSERVERS];
+    for (size_t i = 0; i < OBSERVERS; ++i) {
+        client_key[i] = (struct oscore_context_primitive_immutables) {
+            .sender_id_len = 1,
+            .sender_id = { i + 1 },
+            .common_iv = "d\xf0\xbd" "1MK\xe0<'\x0c+\x1c",
+        };
+        memset(client_key[i].sender_key, 0x10 + i, sizeof(client_key[i].sender_key));
+        memset(client_key[i].recipient_key, 0x20 + i, sizeof(client_key[i].recipient_key));
+        returning_assert(!oscore_cryptoerr_is_error(oscore_crypto_aead_from_number(&client_key[i].aeadalg, 24)));
+
+        server_key[i] = (struct oscore_context_primitive_immutables) {
+            .recipient_id_len = 1,
+            .recipient_id = { i + 1 },
+            .common_iv = "d\xf0\xbd" "1MK\xe0<'\x0c+\x1c",
+            .aeadalg = client_key[i].aeadalg,
+        };
+        memcpy(server_key[i].sender_key, client_key[i].recipient_key, sizeof(server_key[i].sender_key));
+        memcpy(server_key[i].recipient_key, client_key[i].sender_key, sizeof(server_key[i].recipient_key));
+
+        // The server's contexts are at different sequence numbers
+        client_primitive[i] = (struct oscore_context_primitive) { .immutables = &client_key[i] };
+        server_primitive[i] = (struct oscore_context_primitive) {
+            .immutables = &server_key[i],
+            .sender_sequence_number = 10 * i,
+        };
+        client[i] = (oscore_context_t) {
+            .type = OSCORE_CONTEXT_PRIMITIVE,
+            .data = (void*)(&client_primitive[i]),
+        };
+        server[i] = (oscore_context_t) {
+            .type = OSCORE_CONTEXT_PRIMITIVE,
+            .data = (void*)(&server_primitive[i]),
+        };
+    }
+
+    oscore_requestid_t client_request_id[OBSERVERS], server_request_id[OBSERVERS], notification_id[OBSERVERS];
+    oscore_request_aad_t request_aad[OBSERVERS];
+    for (size_t i = 0; i < OBSERVERS; ++i) {
+        returning_assert(register_observer(&client[i], &server[i], &client_request_id[i], &server_request_id[i], &request_aad[i]));
+    }
+
+    // Observe, Content-Format: text/plain
+    struct oscore_msg_protected_option options[] = {
+        { .option_number = 6, .value = (const uint8_t *)"", .value_len = 0 },
+        { .option_number = 12, .value = (const uint8_t *)"", .value_len = 0 },
+    };
+    oscore_msg_protected_template_t tpl;
+    returning_assert(oscore_msg_protected_template_build(&tpl, 0x45, options, 2, temperature, sizeof(temperature) - 1) == OK);
+
+    // One of the targets has its request's AAD built again
+    struct oscore_fanout_target targets[OBSERVERS];
+    for (size_t i = 0; i < OBSERVERS; ++i) {
+        oscore_requestid_clone(&notification_id[i], &server_request_id[i]);
+        targets[i] = (struct oscore_fanout_target) {
+            .message = oscore_test_msg_create(),
+            .secctx = introduce_error && i == 2 ? &server[1] : &server[i],
+            .request_id = &notification_id[i],
+            .request_aad = i == 1 ? NULL : &request_aad[i],
+        };
+    }
+    returning_assert(oscore_protect_fanout(&tpl, (const uint8_t *)"\x07", 1, targets, OBSERVERS) == OBSERVERS);
+
+    for (size_t i = 0; i < OBSERVERS; ++i) {
+        returning_assert(targets[i].result == OSCORE_FANOUT_OK);
+
+        oscore_msg_native_optiter_t iter;
+        uint16_t number;
+        const uint8_t *value;
+        size_t value_len;
+        bool observe = false;
+        oscore_msg_native_optiter_init(targets[i].message, &iter);
+        while (oscore_msg_native_optiter_next(targets[i].message, &iter, &number, &value, &value_len)) {
+            observe = observe || (number == 6 && value_len == 1 && value[0] == 7);
+        }
+        oscore_msg_native_optiter_finish(targets[i].message, &iter);
+        returning_assert(observe);
+
+        oscore_oscoreoption_t header;
+        oscore_msg_protected_t unprotected;
+        returning_assert(find_oscoreoption(targets[i].message, &header));
+        returning_assert(oscore_unprotect_response(targets[i].message, &unprotected, &header,
+                    &client[i], &client_request_id[i]) == OSCORE_UNPROTECT_RESPONSE_OK);
+        returning_assert(check_notification(&unprotected));
+        oscore_release_unprotected(&unprotected);
+        oscore_test_msg_destroy(targets[i].message);
+    }
+
+    // Each notification took a sequence number of its own target's context
+    for (size_t i = 0; i < OBSERVERS; ++i) {
+        returning_assert(server_primitive[i].sender_sequence_number == 10 * i + 1);
+    }
+
+    // A template without the inner Observe option can not go with an outer one
+    returning_assert(oscore_msg_protected_template_build(&tpl, 0x45, &options[1], 1, NULL, 0) == OK);
+    oscore_requestid_clone(&notification_id[0], &server_request_id[0]);
+    targets[0].message = oscore_test_msg_create();
+    targets[0].secctx = &server[0];
+    returning_assert(oscore_protect_fanout(&tpl, (const uint8_t *)"\x08", 1, targets, 1) == 0);
+    returning_assert(targets[0].result == OSCORE_FANOUT_ERROR_MESSAGE);
+    oscore_test_msg_destroy(targets[0].message);
+
+    return 0;
+}
@@ -0,0 +1,132 @@
+#include <stdio.h>
+#include <oscore_native/platform.h>
+#include <oscore_native/message.h>
+#include <oscore_native/test.h>
+#include <oscore/protection.h>
+#include <oscore/context_impl/primitive.h>
+
+#define returning_assert(cond) if(!(cond)) { return 1; }
+
+static const uint8_t body[] = "interleaved";
+#define BODY_LEN (sizeof(body) - 1)
+
+/* Outer and inner options alternate, so that backends which store options in
+ * front of the payload move it between the inner options being written */
+static const struct {
+    uint16_t option_number;
+    const uint8_t *value;
+    size_t value_len;
+} options[] = {
+    { .option_number = 3, .value = (const uint8_t *)"host", .value_len = 4 },
+    { .option_number = 4, .value = (const uint8_t *)"etag", .value_len = 4 },
+    { .option_number = 7, .value = (const uint8_t *)"\x16\x33", .value_len = 2 },
+    { .option_number = 11, .value = (const uint8_t *)"a", .value_len = 1 },
+    { .option_number = 11, .value = (const uint8_t *)"bb", .value_len = 2 },
+    { .option_number = 12, .value = (const uint8_t *)"\x2a", .value_len = 1 },
+    { .option_number = 39, .value = (const uint8_t *)"coap", .value_len = 4 },
+    { .option_number = 60, .value = (const uint8_t *)"\x01\x02", .value_len = 2 },
+};
+#define OPTION_COUNT (sizeof(options) / sizeof(options[0]))
+
+static bool find_oscoreoption(oscore_msg_native_t msg, oscore_oscoreoption_t *header)
+{
+    oscore_msg_native_optiter_t iter;
+    uint16_t number;
+    const uint8_t *value;
+    size_t value_len;
+    bool found = false;
+    oscore_msg_native_optiter_init(msg, &iter);
+    while (oscore_msg_native_optiter_next(msg, &iter, &number, &value, &value_len)) {
+        if (number == 9) {
+            found = oscore_oscoreoption_parse(header, value, value_len);
+            break;
+        }
+    }
+    oscore_msg_native_optiter_finish(msg, &iter);
+    return found;
+}
+
+int testmain(int introduce_error)
+{
+    struct oscore_context_primitive_immutables client_key = {
+        .sender_id_len = 1,
+        .sender_id = { 0x01 },
+        .common_iv = "d\xf0\xbd" "1MK\xe0<'\x0c+\x1c",
+        .sender_key = "\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11",
+        .recipient_key = "\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22",
+    };
+    struct oscore_context_primitive_immutables server_key = {
+        .recipient_id_len = 1,
+        .recipient_id = { 0x01 },
+        .common_iv = "d\xf0\xbd" "1MK\xe0<'\x0c+\x1c",
+        .sender_key = "\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22",
+        .recipient_key = "\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11",
+    };
+    returning_assert(!oscore_cryptoerr_is_error(oscore_crypto_aead_from_number(&client_key.aeadalg, 24)));
+    server_key.aeadalg = client_key.aeadalg;
+
+    struct oscore_context_primitive client_primitive = {
+        .immutables = &client_key,
+    };
+    oscore_context_t client = {
+        .type = OSCORE_CONTEXT_PRIMITIVE,
+        .data = (void*)(&client_primitive),
+    };
+    struct oscore_context_primitive server_primitive = {
+        .immutables = &server_key,
+    };
+    oscore_context_t server = {
+        .type = OSCORE_CONTEXT_PRIMITIVE,
+        .data = (void*)(&server_primitive),
+    };
+
+    oscore_msg_native_t msg = oscore_test_msg_create();
+    oscore_msg_protected_t plaintext;
+    oscore_requestid_t request_id;
+    returning_assert(oscore_prepare_request(msg, &plaintext, &client, &request_id) == OSCORE_PREPARE_OK);
+    oscore_msg_protected_set_code(&plaintext, 1);
+    for (size_t i = 0; i < OPTION_COUNT; ++i) {
+        returning_assert(oscore_msg_protected_append_option(&plaintext,
+                    options[i].option_number, options[i].value, options[i].value_len) == OK);
+    }
+
+    uint8_t *payload;
+    size_t payload_len;
+    returning_assert(oscore_msg_protected_map_payload(&plaintext, &payload, &payload_len) == OK);
+    returning_assert(payload_len >= BODY_LEN);
+    memcpy(payload, body, BODY_LEN);
+    returning_assert(oscore_msg_protected_trim_payload(&plaintext, BODY_LEN) == OK);
+    oscore_msg_native_t written;
+    returning_assert(oscore_encrypt_message(&plaintext, &written) == OSCORE_FINISH_OK);
+
+    // The server sees all options in sequence, the outer ones among them
+    oscore_oscoreoption_t header;
+    oscore_msg_protected_t unprotected;
+    returning_assert(find_oscoreoption(msg, &header));
+    returning_assert(oscore_unprotect_request(msg, &unprotected, &header, &server, &request_id) == OSCORE_UNPROTECT_REQUEST_OK);
+
+    oscore_msg_protected_optiter_t iter;
+    uint16_t number;
+    const uint8_t *value;
+    size_t value_len;
+    size_t count = 0;
+    bool good = true;
+    oscore_msg_protected_optiter_init(&unprotected, &iter);
+    while (oscore_msg_protected_optiter_next(&unprotected, &iter, &number, &value, &value_len)) {
+        good = good && count < OPTION_COUNT - introduce_error &&
+                number == options[count].option_number &&
+                value_len == options[count].value_len &&
+                memcmp(value, options[count].value, value_len) == 0;
+        count += 1;
+    }
+    returning_assert(oscore_msg_protected_optiter_finish(&unprotected, &iter) == OK);
+    returning_assert(good && count == OPTION_COUNT);
+
+    returning_assert(oscore_msg_protected_map_payload(&unprotected, &payload, &payload_len) == OK);
+    returning_assert(payload_len == BODY_LEN && memcmp(payload, body, BODY_LEN) == 0);
+
+    oscore_release_unprotected(&unprotected);
+    oscore_test_msg_destroy(msg);
+
+    return 0;
+}
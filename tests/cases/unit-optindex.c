@@ -0,0 +1,123 @@
+#include <stdio.h>
+#include <oscore_native/platform.h>
+#include <oscore_native/message.h>
+#include <oscore_native/test.h>
+#include <oscore/protection.h>
+#include <oscore/context_impl/primitive.h>
+
+#define returning_assert(cond) if(!(cond)) { return 1; }
+
+#define MAX_CAPACITY 6
+
+static bool find_oscoreoption(oscore_msg_native_t msg, oscore_oscoreoption_t *header)
+{
+    oscore_msg_native_optiter_t iter;
+    uint16_t number;
+    const uint8_t *value;
+    size_t value_len;
+    bool found = false;
+    oscore_msg_native_optiter_init(msg, &iter);
+    while (oscore_msg_native_optiter_next(msg, &iter, &number, &value, &value_len)) {
+        if (number == 9) {
+            found = oscore_oscoreoption_parse(header, value, value_len);
+            break;
+        }
+    }
+    oscore_msg_native_optiter_finish(msg, &iter);
+    return found;
+}
+
+/* Build a request with an outer Uri-Host, two Uri-Path options and an unknown
+ * elective option */
+static bool build_request(oscore_msg_native_t msg, oscore_context_t *client)
+{
+    oscore_msg_protected_t plaintext;
+    oscore_requestid_t request_id;
+    oscore_msg_native_t written;
+
+    if (oscore_prepare_request(msg, &plaintext, client, &request_id) != OSCORE_PREPARE_OK) {
+        return false;
+    }
+    oscore_msg_protected_set_code(&plaintext, 1);
+    if (oscore_msgerr_protected_is_error(oscore_msg_protected_append_option(&plaintext, 3, (const uint8_t *)"host", 4)) ||
+            oscore_msgerr_protected_is_error(oscore_msg_protected_append_option(&plaintext, 11, (const uint8_t *)"a", 1)) ||
+            oscore_msgerr_protected_is_error(oscore_msg_protected_append_option(&plaintext, 11, (const uint8_t *)"bb", 2)) ||
+            oscore_msgerr_protected_is_error(oscore_msg_protected_append_option(&plaintext, 252, (const uint8_t *)"eee", 3)) ||
+            oscore_msgerr_protected_is_error(oscore_msg_protected_trim_payload(&plaintext, 0))) {
+        return false;
+    }
+    return oscore_encrypt_message(&plaintext, &written) == OSCORE_FINISH_OK;
+}
+
+int testmain(int introduce_error)
+{
+    struct oscore_context_primitive_immutables client_key = {
+        .sender_id_len = 1,
+        .sender_id = { 0x01 },
+        .common_iv = "d\xf0\xbd" "1MK\xe0<'\x0c+\x1c",
+        .sender_key = "\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11",
+        .recipient_key = "\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22",
+    };
+    struct oscore_context_primitive_immutables server_key = {
+        .recipient_id_len = 1,
+        .recipient_id = { 0x01 },
+        .common_iv = "d\xf0\xbd" "1MK\xe0<'\x0c+\x1c",
+        .sender_key = "\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22",
+        .recipient_key = "\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11",
+    };
+    returning_assert(!oscore_cryptoerr_is_error(oscore_crypto_aead_from_number(&client_key.aeadalg, 24)));
+    server_key.aeadalg = client_key.aeadalg;
+
+    struct oscore_context_primitive client_primitive = {
+        .immutables = &client_key,
+    };
+    oscore_context_t client = {
+        .type = OSCORE_CONTEXT_PRIMITIVE,
+        .data = (void*)(&client_primitive),
+    };
+    struct oscore_context_primitive server_primitive = {
+        .immutables = &server_key,
+    };
+    oscore_context_t server = {
+        .type = OSCORE_CONTEXT_PRIMITIVE,
+        .data = (void*)(&server_primitive),
+    };
+
+    // Indices too small for all of the message's options fall back to
+    // iterating, and give the same results
+    for (size_t capacity = 0; capacity <= MAX_CAPACITY; ++capacity) {
+        oscore_msg_native_t msg = oscore_test_msg_create();
+        returning_assert(build_request(msg, &client));
+
+        oscore_oscoreoption_t header;
+        oscore_msg_protected_t unprotected;
+        oscore_requestid_t request_id;
+        returning_assert(find_oscoreoption(msg, &header));
+        returning_assert(oscore_unprotect_request(msg, &unprotected, &header, &server, &request_id) == OSCORE_UNPROTECT_REQUEST_OK);
+
+        struct oscore_msg_protected_optindex_entry entries[MAX_CAPACITY];
+        oscore_msg_protected_optindex_t index;
+        oscore_msg_protected_optindex_init(&index, entries, capacity);
+
+        const uint8_t *value;
+        size_t value_len;
+        returning_assert(oscore_msg_protected_find_option(&unprotected, &index, 11, introduce_error ? 0 : 1, &value, &value_len));
+        returning_assert(value_len == 2 && memcmp(value, "bb", 2) == 0);
+        returning_assert(oscore_msg_protected_find_option(&unprotected, &index, 11, 0, &value, &value_len));
+        returning_assert(value_len == 1 && memcmp(value, "a", 1) == 0);
+        returning_assert(!oscore_msg_protected_find_option(&unprotected, &index, 11, 2, &value, &value_len));
+        // Outer options are found as well
+        returning_assert(oscore_msg_protected_find_option(&unprotected, &index, 3, 0, &value, &value_len));
+        returning_assert(value_len == 4 && memcmp(value, "host", 4) == 0);
+        returning_assert(oscore_msg_protected_find_option(&unprotected, &index, 252, 0, &value, &value_len));
+        returning_assert(value_len == 3 && memcmp(value, "eee", 3) == 0);
+        returning_assert(!oscore_msg_protected_find_option(&unprotected, &index, 12, 0, &value, &value_len));
+        returning_assert(!oscore_msg_protected_find_option(&unprotected, &index, 1000, 0, &value, &value_len));
+        returning_assert(oscore_msg_protected_optindex_status(&unprotected, &index) == OK);
+
+        oscore_release_unprotected(&unprotected);
+        oscore_test_msg_destroy(msg);
+    }
+
+    return 0;
+}
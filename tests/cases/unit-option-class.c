@@ -0,0 +1,159 @@
+#include <stdio.h>
+#include <oscore_native/platform.h>
+#include <oscore_native/message.h>
+#include <oscore_native/test.h>
+#include <oscore/protection.h>
+#include <oscore/context_impl/primitive.h>
+
+#define returning_assert(cond) if(!(cond)) { return 1; }
+
+// An unassigned elective option the application treats as Class U
+#define OPTNUM_REGISTERED 2052
+
+static bool find_oscoreoption(oscore_msg_native_t msg, oscore_oscoreoption_t *header)
+{
+    oscore_msg_native_optiter_t iter;
+    uint16_t number;
+    const uint8_t *value;
+    size_t value_len;
+    bool found = false;
+    oscore_msg_native_optiter_init(msg, &iter);
+    while (oscore_msg_native_optiter_next(msg, &iter, &number, &value, &value_len)) {
+        if (number == 9) {
+            found = oscore_oscoreoption_parse(header, value, value_len);
+            break;
+        }
+    }
+    oscore_msg_native_optiter_finish(msg, &iter);
+    return found;
+}
+
+static bool has_outer_option(oscore_msg_native_t msg, uint16_t option_number)
+{
+    oscore_msg_native_optiter_t iter;
+    uint16_t number;
+    const uint8_t *value;
+    size_t value_len;
+    bool found = false;
+    oscore_msg_native_optiter_init(msg, &iter);
+    while (oscore_msg_native_optiter_next(msg, &iter, &number, &value, &value_len)) {
+        found = found || number == option_number;
+    }
+    oscore_msg_native_optiter_finish(msg, &iter);
+    return found;
+}
+
+/* Build a request with a built-in, a registered and an unknown option */
+static bool build_request(oscore_msg_native_t msg, oscore_context_t *client)
+{
+    oscore_msg_protected_t plaintext;
+    oscore_requestid_t request_id;
+    oscore_msg_native_t written;
+
+    if (oscore_prepare_request(msg, &plaintext, client, &request_id) != OSCORE_PREPARE_OK) {
+        return false;
+    }
+    oscore_msg_protected_set_code(&plaintext, 1);
+    if (oscore_msgerr_protected_is_error(oscore_msg_protected_append_option(&plaintext, 11, (const uint8_t *)"a", 1)) ||
+            oscore_msgerr_protected_is_error(oscore_msg_protected_append_option(&plaintext, OPTNUM_REGISTERED, (const uint8_t *)"uu", 2)) ||
+            oscore_msgerr_protected_is_error(oscore_msg_protected_append_option(&plaintext, 65001, (const uint8_t *)"x", 1)) ||
+            oscore_msgerr_protected_is_error(oscore_msg_protected_trim_payload(&plaintext, 0))) {
+        return false;
+    }
+    return oscore_encrypt_message(&plaintext, &written) == OSCORE_FINISH_OK;
+}
+
+/* Iterate over the options of a received request, expecting those from
+ * build_request */
+static oscore_msgerr_protected_t read_request(oscore_msg_native_t msg, oscore_context_t *server, bool *complete)
+{
+    oscore_oscoreoption_t header;
+    oscore_msg_protected_t unprotected;
+    oscore_requestid_t request_id;
+
+    *complete = false;
+    if (!find_oscoreoption(msg, &header) ||
+            oscore_unprotect_request(msg, &unprotected, &header, server, &request_id) != OSCORE_UNPROTECT_REQUEST_OK) {
+        return NATIVE_ERROR;
+    }
+
+    const uint16_t expected[] = { 11, OPTNUM_REGISTERED, 65001 };
+    oscore_msg_protected_optiter_t iter;
+    uint16_t number;
+    const uint8_t *value;
+    size_t value_len;
+    size_t count = 0;
+    bool good = true;
+    oscore_msg_protected_optiter_init(&unprotected, &iter);
+    while (oscore_msg_protected_optiter_next(&unprotected, &iter, &number, &value, &value_len)) {
+        good = good && count < sizeof(expected) / sizeof(expected[0]) && number == expected[count];
+        count += 1;
+    }
+    oscore_msgerr_protected_t err = oscore_msg_protected_optiter_finish(&unprotected, &iter);
+    *complete = good && count == sizeof(expected) / sizeof(expected[0]);
+    oscore_release_unprotected(&unprotected);
+    return err;
+}
+
+int testmain(int introduce_error)
+{
+    struct oscore_context_primitive_immutables client_key = {
+        .sender_id_len = 1,
+        .sender_id = { 0x01 },
+        .common_iv = "d\xf0\xbd" "1MK\xe0<'\x0c+\x1c",
+        .sender_key = "\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11",
+        .recipient_key = "\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22",
+    };
+    struct oscore_context_primitive_immutables server_key = {
+        .recipient_id_len = 1,
+        .recipient_id = { 0x01 },
+        .common_iv = "d\xf0\xbd" "1MK\xe0<'\x0c+\x1c",
+        .sender_key = "\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22",
+        .recipient_key = "\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11",
+    };
+    returning_assert(!oscore_cryptoerr_is_error(oscore_crypto_aead_from_number(&client_key.aeadalg, 24)));
+    server_key.aeadalg = client_key.aeadalg;
+
+    struct oscore_context_primitive client_primitive = {
+        .immutables = &client_key,
+    };
+    oscore_context_t client = {
+        .type = OSCORE_CONTEXT_PRIMITIVE,
+        .data = (void*)(&client_primitive),
+    };
+    struct oscore_context_primitive server_primitive = {
+        .immutables = &server_key,
+    };
+    oscore_context_t server = {
+        .type = OSCORE_CONTEXT_PRIMITIVE,
+        .data = (void*)(&server_primitive),
+    };
+
+    // Built-in options keep their class
+    returning_assert(!oscore_option_register_class(11, OSCORE_OPTION_CLASS_U));
+    returning_assert(oscore_option_register_class(OPTNUM_REGISTERED,
+                introduce_error ? OSCORE_OPTION_CLASS_E : OSCORE_OPTION_CLASS_U));
+
+    // The registered option is sent in the clear, the unknown one encrypted
+    oscore_msg_native_t msg = oscore_test_msg_create();
+    returning_assert(build_request(msg, &client));
+    returning_assert(has_outer_option(msg, OPTNUM_REGISTERED));
+    returning_assert(!has_outer_option(msg, 65001));
+    returning_assert(!has_outer_option(msg, 11));
+
+    // Unknown elective outer options are ignored
+    returning_assert(!oscore_msgerr_native_is_error(oscore_msg_native_append_option(msg, 65000, (const uint8_t *)"z", 1)));
+    bool complete;
+    returning_assert(read_request(msg, &server, &complete) == OK);
+    returning_assert(complete);
+    oscore_test_msg_destroy(msg);
+
+    // Unknown critical outer options make the message unreadable
+    msg = oscore_test_msg_create();
+    returning_assert(build_request(msg, &client));
+    returning_assert(!oscore_msgerr_native_is_error(oscore_msg_native_append_option(msg, 65003, (const uint8_t *)"z", 1)));
+    returning_assert(read_request(msg, &server, &complete) == INVALID_OUTER_OPTION);
+    oscore_test_msg_destroy(msg);
+
+    return 0;
+}
@@ -0,0 +1,155 @@
+#include <stdio.h>
+#include <oscore_native/platform.h>
+#include <oscore_native/message.h>
+#include <oscore_native/test.h>
+#include <oscore/protection.h>
+#include <oscore/context_impl/primitive.h>
+
+#define returning_assert(cond) if(!(cond)) { return 1; }
+
+static bool find_oscoreoption(oscore_msg_native_t msg, oscore_oscoreoption_t *header)
+{
+    oscore_msg_native_optiter_t iter;
+    uint16_t number;
+    const uint8_t *value;
+    size_t value_len;
+    bool found = false;
+    oscore_msg_native_optiter_init(msg, &iter);
+    while (oscore_msg_native_optiter_next(msg, &iter, &number, &value, &value_len)) {
+        if (number == 9) {
+            found = oscore_oscoreoption_parse(header, value, value_len);
+            break;
+        }
+    }
+    oscore_msg_native_optiter_finish(msg, &iter);
+    return found;
+}
+
+/* Filter of a forward proxy that passes the request on to a backend */
+static bool forward(void *arg, uint16_t option_number, const uint8_t **value, size_t *value_len)
+{
+    bool *drop_proxy_scheme = arg;
+    switch (option_number) {
+    case 3:
+        // Uri-Host
+        *value = (const uint8_t *)"backend.example";
+        *value_len = 15;
+        return true;
+    case 39:
+        // Proxy-Scheme
+        return !*drop_proxy_scheme;
+    default:
+        return true;
+    }
+}
+
+int testmain(int introduce_error)
+{
+    struct oscore_context_primitive_immutables client_key = {
+        .sender_id_len = 1,
+        .sender_id = { 0x01 },
+        .common_iv = "d\xf0\xbd" "1MK\xe0<'\x0c+\x1c",
+        .sender_key = "\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11",
+        .recipient_key = "\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22",
+    };
+    struct oscore_context_primitive_immutables server_key = {
+        .recipient_id_len = 1,
+        .recipient_id = { 0x01 },
+        .common_iv = "d\xf0\xbd" "1MK\xe0<'\x0c+\x1c",
+        .sender_key = "\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22",
+        .recipient_key = "\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11",
+    };
+    returning_assert(!oscore_cryptoerr_is_error(oscore_crypto_aead_from_number(&client_key.aeadalg, 24)));
+    server_key.aeadalg = client_key.aeadalg;
+
+    struct oscore_context_primitive client_primitive = {
+        .immutables = &client_key,
+    };
+    oscore_context_t client = {
+        .type = OSCORE_CONTEXT_PRIMITIVE,
+        .data = (void*)(&client_primitive),
+    };
+    struct oscore_context_primitive server_primitive = {
+        .immutables = &server_key,
+    };
+    oscore_context_t server = {
+        .type = OSCORE_CONTEXT_PRIMITIVE,
+        .data = (void*)(&server_primitive),
+    };
+
+    oscore_msg_native_t msg = oscore_test_msg_create();
+    oscore_msg_protected_t plaintext;
+    oscore_requestid_t request_id;
+    oscore_msg_native_t written;
+    returning_assert(oscore_prepare_request(msg, &plaintext, &client, &request_id) == OSCORE_PREPARE_OK);
+    oscore_msg_protected_set_code(&plaintext, 2);
+    returning_assert(oscore_msg_protected_append_option(&plaintext, 3, (const uint8_t *)"proxy", 5) == OK);
+    returning_assert(oscore_msg_protected_append_option(&plaintext, 11, (const uint8_t *)"a", 1) == OK);
+    returning_assert(oscore_msg_protected_append_option(&plaintext, 39, (const uint8_t *)"coap", 4) == OK);
+    uint8_t *payload;
+    size_t payload_len;
+    returning_assert(oscore_msg_protected_map_payload(&plaintext, &payload, &payload_len) == OK);
+    returning_assert(payload_len >= 4);
+    memcpy(payload, "data", 4);
+    returning_assert(oscore_msg_protected_trim_payload(&plaintext, 4) == OK);
+    returning_assert(oscore_encrypt_message(&plaintext, &written) == OSCORE_FINISH_OK);
+
+    oscore_msg_native_t forwarded = oscore_test_msg_create();
+    bool drop_proxy_scheme = !introduce_error;
+
+    // Only options an intermediary may alter can be added
+    struct oscore_msg_protected_option inner[] = {
+        { .option_number = 11, .value = (const uint8_t *)"b", .value_len = 1 },
+    };
+    returning_assert(oscore_msg_outer_rewrite(msg, forwarded, forward, &drop_proxy_scheme, inner, 1) == INVALID_ARG_ERROR);
+
+    // Uri-Port and Max-Age
+    struct oscore_msg_protected_option added[] = {
+        { .option_number = 7, .value = (const uint8_t *)"\x16\x33", .value_len = 2 },
+        { .option_number = 14, .value = (const uint8_t *)"\x3c", .value_len = 1 },
+    };
+    oscore_test_msg_destroy(forwarded);
+    forwarded = oscore_test_msg_create();
+    returning_assert(oscore_msg_outer_rewrite(msg, forwarded, forward, &drop_proxy_scheme, added, 2) == OK);
+
+    const uint16_t expected[] = { 3, 7, 9, 14 };
+    oscore_msg_native_optiter_t iter;
+    uint16_t number;
+    const uint8_t *value;
+    size_t value_len;
+    size_t count = 0;
+    bool good = true;
+    oscore_msg_native_optiter_init(forwarded, &iter);
+    while (oscore_msg_native_optiter_next(forwarded, &iter, &number, &value, &value_len)) {
+        good = good && count < sizeof(expected) / sizeof(expected[0]) && number == expected[count];
+        if (number == 3) {
+            good = good && value_len == 15 && memcmp(value, "backend.example", 15) == 0;
+        }
+        count += 1;
+    }
+    oscore_msg_native_optiter_finish(forwarded, &iter);
+    returning_assert(good && count == sizeof(expected) / sizeof(expected[0]));
+
+    // The ciphertext is passed on unmodified
+    uint8_t *ciphertext, *forwarded_ciphertext;
+    size_t ciphertext_len, forwarded_ciphertext_len;
+    oscore_msg_native_map_payload(msg, &ciphertext, &ciphertext_len);
+    oscore_msg_native_map_payload(forwarded, &forwarded_ciphertext, &forwarded_ciphertext_len);
+    returning_assert(oscore_msg_native_get_code(forwarded) == oscore_msg_native_get_code(msg));
+    returning_assert(forwarded_ciphertext_len == ciphertext_len);
+    returning_assert(memcmp(forwarded_ciphertext, ciphertext, ciphertext_len) == 0);
+
+    oscore_oscoreoption_t header;
+    oscore_msg_protected_t unprotected;
+    returning_assert(find_oscoreoption(forwarded, &header));
+    returning_assert(oscore_unprotect_request(forwarded, &unprotected, &header, &server, &request_id) == OSCORE_UNPROTECT_REQUEST_OK);
+    returning_assert(oscore_msg_protected_get_code(&unprotected) == 2);
+    returning_assert(oscore_msg_protected_map_payload(&unprotected, &payload, &payload_len) == OK);
+    returning_assert(payload_len == 4 && memcmp(payload, "data", 4) == 0);
+    oscore_release_unprotected(&unprotected);
+
+    oscore_test_msg_destroy(msg);
+    oscore_test_msg_destroy(forwarded);
+
+    return 0;
+}
@@ -0,0 +1,87 @@
+#include <stdio.h>
+#include <oscore_native/platform.h>
+#include <oscore_native/message.h>
+#include <oscore_native/test.h>
+#include <oscore/protection.h>
+#include <oscore/context_impl/primitive.h>
+
+#define returning_assert(cond) if(!(cond)) { return 1; }
+
+/* Observe, Uri-Path, Content-Format, Block2, Size1 */
+static const struct oscore_msg_protected_option planned[] = {
+    { .option_number = 6, .value = (const uint8_t *)"", .value_len = 0 },
+    { .option_number = 11, .value = (const uint8_t *)"abc", .value_len = 3 },
+    { .option_number = 12, .value = (const uint8_t *)"\x2a", .value_len = 1 },
+    { .option_number = 23, .value = (const uint8_t *)"\x06", .value_len = 1 },
+    { .option_number = 60, .value = (const uint8_t *)"\x01\x02", .value_len = 2 },
+};
+#define PLANNED_COUNT (sizeof(planned) / sizeof(planned[0]))
+
+int testmain(int introduce_error)
+{
+    struct oscore_context_primitive_immutables key = {
+        .sender_id_len = 2,
+        .sender_id = { 0x01, 0x02 },
+        .common_iv = "d\xf0\xbd" "1MK\xe0<'\x0c+\x1c",
+        .sender_key = "\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11",
+        .recipient_key = "\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22",
+    };
+    returning_assert(!oscore_cryptoerr_is_error(oscore_crypto_aead_from_number(&key.aeadalg, 24)));
+
+    struct oscore_context_primitive primitive = {
+        .immutables = &key,
+    };
+    oscore_context_t client = {
+        .type = OSCORE_CONTEXT_PRIMITIVE,
+        .data = (void*)(&primitive),
+    };
+
+    oscore_msg_native_t msg;
+    oscore_msg_protected_t plaintext;
+    oscore_requestid_t request_id;
+    uint8_t *payload;
+    size_t plan, replan, actual;
+
+    // The plan never promises more than is available after adding the
+    // options. Backends that keep outer options out of the payload buffer
+    // (like this test's) offer more than planned.
+    for (size_t count = 0; count <= PLANNED_COUNT; ++count) {
+        msg = oscore_test_msg_create();
+        returning_assert(oscore_prepare_request(msg, &plaintext, &client, &request_id) == OSCORE_PREPARE_OK);
+        oscore_msg_protected_set_code(&plaintext, 1);
+        returning_assert(oscore_msg_protected_append_option(&plaintext, 3, (const uint8_t *)"host", 4) == OK);
+
+        returning_assert(oscore_msg_protected_plan_payload(&plaintext, planned, introduce_error ? 0 : count, &plan) == OK);
+        returning_assert(oscore_msg_protected_append_options(&plaintext, planned, count) == OK);
+        returning_assert(oscore_msg_protected_plan_payload(&plaintext, NULL, 0, &replan) == OK);
+        returning_assert(plan <= replan);
+        returning_assert(oscore_msg_protected_map_payload(&plaintext, &payload, &actual) == OK);
+        returning_assert(replan <= actual);
+
+        oscore_test_msg_destroy(msg);
+    }
+
+    // Planning fails just like adding the options would
+    static uint8_t large[5000];
+    const struct oscore_msg_protected_option unsorted[] = {
+        { .option_number = 12, .value = (const uint8_t *)"", .value_len = 0 },
+        { .option_number = 11, .value = (const uint8_t *)"", .value_len = 0 },
+    };
+    const struct oscore_msg_protected_option oversized[] = {
+        { .option_number = 60, .value = large, .value_len = sizeof(large) },
+    };
+    msg = oscore_test_msg_create();
+    returning_assert(oscore_prepare_request(msg, &plaintext, &client, &request_id) == OSCORE_PREPARE_OK);
+    returning_assert(oscore_msg_protected_plan_payload(&plaintext, unsorted, 2, &plan) == OPTION_SEQUENCE);
+    returning_assert(oscore_msg_protected_plan_payload(&plaintext, oversized, 1, &plan) == MESSAGESIZE);
+    oscore_test_msg_destroy(msg);
+
+    returning_assert(oscore_msg_protected_largest_szx(0) == 0);
+    returning_assert(oscore_msg_protected_largest_szx(31) == 0);
+    returning_assert(oscore_msg_protected_largest_szx(32) == 1);
+    returning_assert(oscore_msg_protected_largest_szx(1023) == 5);
+    returning_assert(oscore_msg_protected_largest_szx(1024) == 6);
+    returning_assert(oscore_msg_protected_largest_szx(5000) == 6);
+
+    return 0;
+}
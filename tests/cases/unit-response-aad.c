@@ -0,0 +1,195 @@
+#include <stdio.h>
+#include <oscore_native/platform.h>
+#include <oscore_native/message.h>
+#include <oscore_native/test.h>
+#include <oscore/protection.h>
+#include <oscore/context_impl/primitive.h>
+
+#define returning_assert(cond) if(!(cond)) { return 1; }
+
+static bool find_oscoreoption(oscore_msg_native_t msg, oscore_oscoreoption_t *header)
+{
+    oscore_msg_native_optiter_t iter;
+    uint16_t number;
+    const uint8_t *value;
+    size_t value_len;
+    bool found = false;
+    oscore_msg_native_optiter_init(msg, &iter);
+    while (oscore_msg_native_optiter_next(msg, &iter, &number, &value, &value_len)) {
+        if (number == 9) {
+            found = oscore_oscoreoption_parse(header, value, value_len);
+            break;
+        }
+    }
+    oscore_msg_native_optiter_finish(msg, &iter);
+    return found;
+}
+
+/* Compare two native messages through the generic message API */
+static bool same_message(oscore_msg_native_t a, oscore_msg_native_t b)
+{
+    if (oscore_msg_native_get_code(a) != oscore_msg_native_get_code(b)) {
+        return false;
+    }
+
+    oscore_msg_native_optiter_t iter_a, iter_b;
+    uint16_t number_a, number_b;
+    const uint8_t *value_a, *value_b;
+    size_t len_a, len_b;
+    bool same = true;
+    oscore_msg_native_optiter_init(a, &iter_a);
+    oscore_msg_native_optiter_init(b, &iter_b);
+    while (same) {
+        bool more_a = oscore_msg_native_optiter_next(a, &iter_a, &number_a, &value_a, &len_a);
+        bool more_b = oscore_msg_native_optiter_next(b, &iter_b, &number_b, &value_b, &len_b);
+        if (!more_a || !more_b) {
+            same = more_a == more_b;
+            break;
+        }
+        same = number_a == number_b && len_a == len_b && memcmp(value_a, value_b, len_a) == 0;
+    }
+    oscore_msg_native_optiter_finish(a, &iter_a);
+    oscore_msg_native_optiter_finish(b, &iter_b);
+    if (!same) {
+        return false;
+    }
+
+    uint8_t *payload_a, *payload_b;
+    oscore_msg_native_map_payload(a, &payload_a, &len_a);
+    oscore_msg_native_map_payload(b, &payload_b, &len_b);
+    return len_a == len_b && memcmp(payload_a, payload_b, len_a) == 0;
+}
+
+static bool build_request(oscore_msg_native_t msg, oscore_context_t *client, oscore_requestid_t *request_id)
+{
+    oscore_msg_protected_t plaintext;
+    oscore_msg_native_t written;
+
+    if (oscore_prepare_request(msg, &plaintext, client, request_id) != OSCORE_PREPARE_OK) {
+        return false;
+    }
+    oscore_msg_protected_set_code(&plaintext, 1);
+    // Observe: register
+    if (oscore_msgerr_protected_is_error(oscore_msg_protected_append_option(&plaintext, 6, (const uint8_t *)"", 0)) ||
+            oscore_msgerr_protected_is_error(oscore_msg_protected_trim_payload(&plaintext, 0))) {
+        return false;
+    }
+    return oscore_encrypt_message(&plaintext, &written) == OSCORE_FINISH_OK;
+}
+
+/* Fill a prepared response with content and encrypt it */
+static bool finish_response(oscore_msg_protected_t *plaintext, uint8_t content)
+{
+    oscore_msg_native_t written;
+    uint8_t *payload;
+    size_t payload_len;
+
+    oscore_msg_protected_set_code(plaintext, 0x45);
+    if (oscore_msgerr_protected_is_error(oscore_msg_protected_map_payload(plaintext, &payload, &payload_len)) ||
+            payload_len < 1) {
+        return false;
+    }
+    payload[0] = content;
+    if (oscore_msgerr_protected_is_error(oscore_msg_protected_trim_payload(plaintext, 1))) {
+        return false;
+    }
+    return oscore_encrypt_message(plaintext, &written) == OSCORE_FINISH_OK;
+}
+
+int testmain(int introduce_error)
+{
+    struct oscore_context_primitive_immutables client_key = {
+        .sender_id_len = 1,
+        .sender_id = { 0x01 },
+        .common_iv = "d\xf0\xbd" "1MK\xe0<'\x0c+\x1c",
+        .sender_key = "\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11",
+        .recipient_key = "\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22",
+    };
+    struct oscore_context_primitive_immutables server_key = {
+        .recipient_id_len = 1,
+        .recipient_id = { 0x01 },
+        .common_iv = "d\xf0\xbd" "1MK\xe0<'\x0c+\x1c",
+        .sender_key = "\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22",
+        .recipient_key = "\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11",
+    };
+    returning_assert(!oscore_cryptoerr_is_error(oscore_crypto_aead_from_number(&client_key.aeadalg, 24)));
+    server_key.aeadalg = client_key.aeadalg;
+
+    // Two exchanges from identical states: the first server builds its
+    // responses from the request ID alone, the second from the kept AAD.
+    struct oscore_context_primitive client_primitive[2] = {
+        { .immutables = &client_key, .sender_sequence_number = 20 },
+        { .immutables = &client_key, .sender_sequence_number = 20 },
+    };
+    struct oscore_context_primitive server_primitive[2] = {
+        { .immutables = &server_key, .sender_sequence_number = 7 },
+        { .immutables = &server_key, .sender_sequence_number = 7 },
+    };
+    oscore_context_t client[2], server[2];
+    for (size_t i = 0; i < 2; ++i) {
+        client[i] = (oscore_context_t) {
+            .type = OSCORE_CONTEXT_PRIMITIVE,
+            .data = (void*)(&client_primitive[i]),
+        };
+        server[i] = (oscore_context_t) {
+            .type = OSCORE_CONTEXT_PRIMITIVE,
+            .data = (void*)(&server_primitive[i]),
+        };
+    }
+
+    oscore_msg_native_t request[2];
+    oscore_requestid_t client_request_id[2], server_request_id[2];
+    oscore_request_aad_t request_aad;
+    oscore_oscoreoption_t header;
+    oscore_msg_protected_t unprotected;
+    for (size_t i = 0; i < 2; ++i) {
+        request[i] = oscore_test_msg_create();
+        returning_assert(build_request(request[i], &client[i], &client_request_id[i]));
+    }
+    returning_assert(find_oscoreoption(request[0], &header));
+    returning_assert(oscore_unprotect_request(request[0], &unprotected, &header, &server[0], &server_request_id[0]) == OSCORE_UNPROTECT_REQUEST_OK);
+    oscore_release_unprotected(&unprotected);
+    returning_assert(find_oscoreoption(request[1], &header));
+    returning_assert(oscore_unprotect_request_aad(request[1], &unprotected, &header, &server[1], &server_request_id[1], &request_aad) == OSCORE_UNPROTECT_REQUEST_OK);
+    oscore_release_unprotected(&unprotected);
+
+    // The first response reuses the request's Partial IV; the later ones
+    // (eg. notifications) take sequence numbers of their own
+    for (size_t round = 0; round < 3; ++round) {
+        oscore_msg_native_t response[2];
+        oscore_msg_protected_t plaintext;
+        oscore_requestid_t notification_id[2];
+        oscore_requestid_t *response_id[2] = { &server_request_id[0], &server_request_id[1] };
+        if (round != 0) {
+            for (size_t i = 0; i < 2; ++i) {
+                oscore_requestid_clone(&notification_id[i], &server_request_id[i]);
+                response_id[i] = &notification_id[i];
+            }
+        }
+
+        response[0] = oscore_test_msg_create();
+        returning_assert(oscore_prepare_response(response[0], &plaintext, &server[0], response_id[0]) == OSCORE_PREPARE_OK);
+        returning_assert(finish_response(&plaintext, round));
+
+        response[1] = oscore_test_msg_create();
+        returning_assert(oscore_prepare_response_aad(response[1], &plaintext, &server[1], response_id[1], &request_aad) == OSCORE_PREPARE_OK);
+        returning_assert(finish_response(&plaintext, introduce_error && round == 2 ? 0xff : round));
+
+        returning_assert(same_message(response[0], response[1]));
+
+        returning_assert(find_oscoreoption(response[1], &header));
+        returning_assert((header.partial_iv_len != 0) == (round != 0));
+        returning_assert(oscore_unprotect_response(response[1], &unprotected, &header, &client[1], &client_request_id[1]) == OSCORE_UNPROTECT_RESPONSE_OK);
+        oscore_release_unprotected(&unprotected);
+
+        for (size_t i = 0; i < 2; ++i) {
+            oscore_test_msg_destroy(response[i]);
+        }
+    }
+
+    for (size_t i = 0; i < 2; ++i) {
+        oscore_test_msg_destroy(request[i]);
+    }
+
+    return 0;
+}
@@ -0,0 +1,152 @@
+#include <stdbool.h>
+#include <oscore_native/platform.h>
+#include <oscore_native/test.h>
+
+#include <oscore/response_cache.h>
+
+const int OK = 0;
+const int ERR = 1;
+
+static oscore_requestid_t requestid_from_byte(uint8_t seqno)
+{
+    oscore_requestid_t result = {
+        .used_bytes = 1,
+        .is_first_use = false,
+        .bytes = {0, 0, 0, 0, seqno},
+    };
+    return result;
+}
+
+/* Build a response that looks like a protected one */
+static oscore_msg_native_t build_response(uint8_t seqno)
+{
+    oscore_msg_native_t msg = oscore_test_msg_create();
+    oscore_msg_native_set_code(msg, 0x44);
+    oscore_msg_native_append_option(msg, 9, (const uint8_t *)"", 0);
+    oscore_msg_native_append_option(msg, 65000, &seqno, 1);
+
+    uint8_t *payload;
+    size_t payload_len;
+    oscore_msg_native_map_payload(msg, &payload, &payload_len);
+    memset(payload, seqno, 9);
+    oscore_msg_native_trim_payload(msg, 9);
+    return msg;
+}
+
+/* Check that the cache replays the response built for @p seqno */
+static int check_replay(
+        struct oscore_response_cache *cache,
+        oscore_context_t *secctx,
+        uint8_t seqno
+        )
+{
+    oscore_requestid_t request_id = requestid_from_byte(seqno);
+    oscore_msg_native_t msg = oscore_test_msg_create();
+    int result = ERR;
+
+    if (oscore_response_cache_replay(cache, secctx, &request_id, msg) != OSCORE_RESPONSE_CACHE_HIT) {
+        goto out;
+    }
+    if (oscore_msg_native_get_code(msg) != 0x44) {
+        goto out;
+    }
+
+    oscore_msg_native_optiter_t iter;
+    uint16_t option_number;
+    const uint8_t *value;
+    size_t value_len;
+    int count = 0;
+    oscore_msg_native_optiter_init(msg, &iter);
+    while (oscore_msg_native_optiter_next(msg, &iter, &option_number, &value, &value_len)) {
+        if (count == 0 && (option_number != 9 || value_len != 0)) {
+            goto out;
+        }
+        if (count == 1 && (option_number != 65000 || value_len != 1 || value[0] != seqno)) {
+            goto out;
+        }
+        count++;
+    }
+    if (oscore_msgerr_native_is_error(oscore_msg_native_optiter_finish(msg, &iter)) || count != 2) {
+        goto out;
+    }
+
+    uint8_t *payload;
+    size_t payload_len;
+    oscore_msg_native_map_payload(msg, &payload, &payload_len);
+    if (payload_len != 9 || payload[0] != seqno || payload[8] != seqno) {
+        goto out;
+    }
+
+    result = OK;
+out:
+    oscore_test_msg_destroy(msg);
+    return result;
+}
+
+int testmain(int introduce_error)
+{
+    int primitive_a, primitive_b;
+    oscore_context_t ctx_a = { .type = OSCORE_CONTEXT_PRIMITIVE, .data = &primitive_a };
+    oscore_context_t ctx_b = { .type = OSCORE_CONTEXT_PRIMITIVE, .data = &primitive_b };
+
+    struct oscore_response_cache_entry entries[2];
+    struct oscore_response_cache cache;
+    oscore_response_cache_init(&cache, entries, 2);
+
+    oscore_requestid_t request_id = requestid_from_byte(1);
+    oscore_msg_native_t msg = oscore_test_msg_create();
+    if (oscore_response_cache_replay(&cache, &ctx_a, &request_id, msg) != OSCORE_RESPONSE_CACHE_MISS) {
+        return ERR;
+    }
+    oscore_test_msg_destroy(msg);
+
+    for (uint8_t seqno = 1; seqno <= 3; ++seqno) {
+        request_id = requestid_from_byte(seqno);
+        msg = build_response(seqno);
+        bool stored = oscore_response_cache_store(&cache, &ctx_a, &request_id, msg);
+        oscore_test_msg_destroy(msg);
+        if (!stored) {
+            return ERR;
+        }
+    }
+
+    // The first response was evicted by the third
+    if (check_replay(&cache, &ctx_a, introduce_error ? 1 : 2) != OK ||
+            check_replay(&cache, &ctx_a, 3) != OK) {
+        return ERR;
+    }
+    request_id = requestid_from_byte(1);
+    msg = oscore_test_msg_create();
+    if (oscore_response_cache_replay(&cache, &ctx_a, &request_id, msg) != OSCORE_RESPONSE_CACHE_MISS) {
+        return ERR;
+    }
+    // Same Partial IV on a different context
+    request_id = requestid_from_byte(3);
+    if (oscore_response_cache_replay(&cache, &ctx_b, &request_id, msg) != OSCORE_RESPONSE_CACHE_MISS) {
+        return ERR;
+    }
+    oscore_test_msg_destroy(msg);
+
+    // Storing again for the same request replaces the entry in place
+    msg = build_response(3);
+    oscore_msg_native_set_code(msg, 0x45);
+    if (!oscore_response_cache_store(&cache, &ctx_a, &request_id, msg)) {
+        return ERR;
+    }
+    oscore_test_msg_destroy(msg);
+    if (check_replay(&cache, &ctx_a, 2) != OK) {
+        return ERR;
+    }
+
+    // Responses that do not fit are not cached
+    msg = oscore_test_msg_create();
+    uint8_t large[OSCORE_RESPONSE_CACHE_MAXLEN] = {0};
+    oscore_msg_native_append_option(msg, 65000, large, sizeof(large));
+    request_id = requestid_from_byte(4);
+    if (oscore_response_cache_store(&cache, &ctx_a, &request_id, msg)) {
+        return ERR;
+    }
+    oscore_test_msg_destroy(msg);
+
+    return OK;
+}
@@ -0,0 +1,131 @@
+#include <stdio.h>
+#include <oscore_native/platform.h>
+#include <oscore_native/message.h>
+#include <oscore_native/test.h>
+#include <oscore/protection.h>
+#include <oscore/context_impl/primitive.h>
+
+#define returning_assert(cond) if(!(cond)) { return 1; }
+
+static const uint8_t etag[] = {0x01, 0x02, 0x03, 0x04};
+static const uint8_t content_format[] = {0x3c};
+static const uint8_t payload[] = "hello";
+
+/* Compare two native messages through the generic message API */
+static bool same_message(oscore_msg_native_t a, oscore_msg_native_t b)
+{
+    if (oscore_msg_native_get_code(a) != oscore_msg_native_get_code(b)) {
+        return false;
+    }
+
+    oscore_msg_native_optiter_t iter_a, iter_b;
+    uint16_t number_a, number_b;
+    const uint8_t *value_a, *value_b;
+    size_t len_a, len_b;
+    bool same = true;
+    oscore_msg_native_optiter_init(a, &iter_a);
+    oscore_msg_native_optiter_init(b, &iter_b);
+    while (same) {
+        bool more_a = oscore_msg_native_optiter_next(a, &iter_a, &number_a, &value_a, &len_a);
+        bool more_b = oscore_msg_native_optiter_next(b, &iter_b, &number_b, &value_b, &len_b);
+        if (!more_a || !more_b) {
+            same = more_a == more_b;
+            break;
+        }
+        same = number_a == number_b && len_a == len_b && memcmp(value_a, value_b, len_a) == 0;
+    }
+    oscore_msg_native_optiter_finish(a, &iter_a);
+    oscore_msg_native_optiter_finish(b, &iter_b);
+    if (!same) {
+        return false;
+    }
+
+    uint8_t *payload_a, *payload_b;
+    oscore_msg_native_map_payload(a, &payload_a, &len_a);
+    oscore_msg_native_map_payload(b, &payload_b, &len_b);
+    return len_a == len_b && memcmp(payload_a, payload_b, len_a) == 0;
+}
+
+/* Write the template's content through the regular message API */
+static bool write_regular(oscore_msg_protected_t *msg)
+{
+    oscore_msg_protected_set_code(msg, 2);
+    if (oscore_msgerr_protected_is_error(oscore_msg_protected_append_option(msg, 4, etag, sizeof(etag))) ||
+            oscore_msgerr_protected_is_error(oscore_msg_protected_append_option(msg, 12, content_format, sizeof(content_format)))) {
+        return false;
+    }
+    uint8_t *writable;
+    size_t writable_len;
+    if (oscore_msgerr_protected_is_error(oscore_msg_protected_map_payload(msg, &writable, &writable_len)) ||
+            writable_len < sizeof(payload) - 1) {
+        return false;
+    }
+    memcpy(writable, payload, sizeof(payload) - 1);
+    return !oscore_msgerr_protected_is_error(oscore_msg_protected_trim_payload(msg, sizeof(payload) - 1));
+}
+
+int testmain(int introduce_error)
+{
+    struct oscore_context_primitive_immutables key = {
+        .recipient_id_len = 1,
+        .recipient_id = { 0x01 },
+        .common_iv = "d\xf0\xbd" "1MK\xe0<'\x0c+\x1c",
+        .sender_key = "\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11",
+        .recipient_key = "\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22",
+    };
+    returning_assert(!oscore_cryptoerr_is_error(oscore_crypto_aead_from_number(&key.aeadalg, 24)));
+
+    // Three clients in the same state produce the same Partial IV
+    struct oscore_context_primitive primitive[3];
+    oscore_context_t client[3];
+    for (size_t i = 0; i < 3; ++i) {
+        primitive[i] = (struct oscore_context_primitive) { .immutables = &key };
+        client[i] = (oscore_context_t) {
+            .type = OSCORE_CONTEXT_PRIMITIVE,
+            .data = (void*)(&primitive[i]),
+        };
+    }
+
+    struct oscore_msg_protected_option options[] = {
+        { .option_number = 4, .value = etag, .value_len = sizeof(etag) },
+        { .option_number = 12, .value = content_format, .value_len = sizeof(content_format) },
+    };
+    oscore_msg_protected_template_t tpl;
+    returning_assert(oscore_msg_protected_template_build(&tpl, 2, options, 2, payload, sizeof(payload) - 1) == OK);
+
+    oscore_msg_native_t msg[3];
+    oscore_msg_protected_t plaintext;
+    oscore_requestid_t request_id;
+    oscore_msg_native_t written;
+
+    msg[0] = oscore_test_msg_create();
+    returning_assert(oscore_prepare_request(msg[0], &plaintext, &client[0], &request_id) == OSCORE_PREPARE_OK);
+    returning_assert(oscore_msg_protected_apply_template(&plaintext, &tpl) == OK);
+    returning_assert(oscore_encrypt_message(&plaintext, &written) == OSCORE_FINISH_OK);
+
+    msg[1] = oscore_test_msg_create();
+    returning_assert(oscore_prepare_request(msg[1], &plaintext, &client[1], &request_id) == OSCORE_PREPARE_OK);
+    returning_assert(write_regular(&plaintext));
+    if (introduce_error) {
+        oscore_msg_protected_set_code(&plaintext, 3);
+    }
+    returning_assert(oscore_encrypt_message(&plaintext, &written) == OSCORE_FINISH_OK);
+
+    // Applying the template is equivalent to writing its content
+    returning_assert(same_message(msg[0], msg[1]));
+
+    // Once the message is trimmed to the template, no inner option can move
+    // the payload any more
+    msg[2] = oscore_test_msg_create();
+    returning_assert(oscore_prepare_request(msg[2], &plaintext, &client[2], &request_id) == OSCORE_PREPARE_OK);
+    returning_assert(oscore_msg_protected_apply_template(&plaintext, &tpl) == OK);
+    returning_assert(oscore_msg_protected_append_option(&plaintext, 14, NULL, 0) == INVALID_ARG_ERROR);
+    returning_assert(oscore_encrypt_message(&plaintext, &written) == OSCORE_FINISH_OK);
+    returning_assert(same_message(msg[0], msg[2]));
+
+    for (size_t i = 0; i < 3; ++i) {
+        oscore_test_msg_destroy(msg[i]);
+    }
+
+    return 0;
+}
@@ -0,0 +1,211 @@
+#include <stdio.h>
+#include <oscore_native/platform.h>
+#include <oscore_native/message.h>
+#include <oscore_native/test.h>
+#include <oscore/protection.h>
+#include <oscore/context_impl/primitive.h>
+
+#define returning_assert(cond) if(!(cond)) { return 1; }
+
+static const uint8_t payload[] = "hello";
+
+static bool find_oscoreoption(oscore_msg_native_t msg, oscore_oscoreoption_t *header)
+{
+    oscore_msg_native_optiter_t iter;
+    uint16_t number;
+    const uint8_t *value;
+    size_t value_len;
+    bool found = false;
+    oscore_msg_native_optiter_init(msg, &iter);
+    while (oscore_msg_native_optiter_next(msg, &iter, &number, &value, &value_len)) {
+        if (number == 9) {
+            found = oscore_oscoreoption_parse(header, value, value_len);
+            break;
+        }
+    }
+    oscore_msg_native_optiter_finish(msg, &iter);
+    return found;
+}
+
+/* Build a POST request with an ETag and a payload */
+static bool build_request(oscore_msg_native_t msg, oscore_context_t *client)
+{
+    oscore_msg_protected_t plaintext;
+    oscore_requestid_t request_id;
+    oscore_msg_native_t written;
+    const uint8_t etag[] = {0x01, 0x02};
+
+    if (oscore_prepare_request(msg, &plaintext, client, &request_id) != OSCORE_PREPARE_OK) {
+        return false;
+    }
+    oscore_msg_protected_set_code(&plaintext, 2);
+    if (oscore_msgerr_protected_is_error(oscore_msg_protected_append_option(&plaintext, 4, etag, sizeof(etag)))) {
+        return false;
+    }
+    uint8_t *writable;
+    size_t writable_len;
+    if (oscore_msgerr_protected_is_error(oscore_msg_protected_map_payload(&plaintext, &writable, &writable_len)) ||
+            writable_len < sizeof(payload) - 1) {
+        return false;
+    }
+    memcpy(writable, payload, sizeof(payload) - 1);
+    if (oscore_msgerr_protected_is_error(oscore_msg_protected_trim_payload(&plaintext, sizeof(payload) - 1))) {
+        return false;
+    }
+    return oscore_encrypt_message(&plaintext, &written) == OSCORE_FINISH_OK;
+}
+
+/* Compare two unprotected messages through the protected message API */
+static bool same_plaintext(oscore_msg_protected_t *a, oscore_msg_protected_t *b)
+{
+    if (oscore_msg_protected_get_code(a) != oscore_msg_protected_get_code(b)) {
+        return false;
+    }
+
+    oscore_msg_protected_optiter_t iter_a, iter_b;
+    uint16_t number_a, number_b;
+    const uint8_t *value_a, *value_b;
+    size_t len_a, len_b;
+    bool same = true;
+    oscore_msg_protected_optiter_init(a, &iter_a);
+    oscore_msg_protected_optiter_init(b, &iter_b);
+    while (same) {
+        bool more_a = oscore_msg_protected_optiter_next(a, &iter_a, &number_a, &value_a, &len_a);
+        bool more_b = oscore_msg_protected_optiter_next(b, &iter_b, &number_b, &value_b, &len_b);
+        if (!more_a || !more_b) {
+            same = more_a == more_b;
+            break;
+        }
+        same = number_a == number_b && len_a == len_b && memcmp(value_a, value_b, len_a) == 0;
+    }
+    if (oscore_msgerr_protected_is_error(oscore_msg_protected_optiter_finish(a, &iter_a)) ||
+            oscore_msgerr_protected_is_error(oscore_msg_protected_optiter_finish(b, &iter_b)) ||
+            !same) {
+        return false;
+    }
+
+    uint8_t *payload_a, *payload_b;
+    if (oscore_msgerr_protected_is_error(oscore_msg_protected_map_payload(a, &payload_a, &len_a)) ||
+            oscore_msgerr_protected_is_error(oscore_msg_protected_map_payload(b, &payload_b, &len_b))) {
+        return false;
+    }
+    return len_a == len_b && memcmp(payload_a, payload_b, len_a) == 0;
+}
+
+int testmain(int introduce_error)
+{
+    // The client talks to the server as recipient 0x01; the server has
+    // another context of that recipient ID with a different key, and one of
+    // a different recipient.
+    struct oscore_context_primitive_immutables client_key = {
+        .sender_id_len = 1,
+        .sender_id = { 0x01 },
+        .common_iv = "d\xf0\xbd" "1MK\xe0<'\x0c+\x1c",
+        .sender_key = "\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11",
+        .recipient_key = "\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22",
+    };
+    struct oscore_context_primitive_immutables server_key = {
+        .recipient_id_len = 1,
+        .recipient_id = { 0x01 },
+        .common_iv = "d\xf0\xbd" "1MK\xe0<'\x0c+\x1c",
+        .sender_key = "\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22",
+        .recipient_key = "\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11",
+    };
+    struct oscore_context_primitive_immutables wrong_key = server_key;
+    memset(wrong_key.recipient_key, 0x33, sizeof(wrong_key.recipient_key));
+    struct oscore_context_primitive_immutables other_key = server_key;
+    other_key.recipient_id[0] = 0x02;
+    returning_assert(!oscore_cryptoerr_is_error(oscore_crypto_aead_from_number(&client_key.aeadalg, 24)));
+    server_key.aeadalg = wrong_key.aeadalg = other_key.aeadalg = client_key.aeadalg;
+
+    // Two clients in the same state produce the same request
+    struct oscore_context_primitive client_primitive[2] = {
+        { .immutables = &client_key },
+        { .immutables = &client_key },
+    };
+    oscore_context_t client[2] = {
+        { .type = OSCORE_CONTEXT_PRIMITIVE, .data = (void*)(&client_primitive[0]) },
+        { .type = OSCORE_CONTEXT_PRIMITIVE, .data = (void*)(&client_primitive[1]) },
+    };
+
+    // The server's contexts have seen some requests already
+    struct oscore_context_primitive server_primitive[4] = {
+        { .immutables = &other_key, .replay_window_left_edge = 5, .replay_window = 0x80000000 },
+        { .immutables = &wrong_key, .replay_window_left_edge = 5, .replay_window = 0x80000000 },
+        { .immutables = &server_key },
+        // Same as the previous one, for comparison with in-place decryption
+        { .immutables = &server_key },
+    };
+    oscore_context_t server[4];
+    for (size_t i = 0; i < 4; ++i) {
+        server[i] = (oscore_context_t) {
+            .type = OSCORE_CONTEXT_PRIMITIVE,
+            .data = (void*)(&server_primitive[i]),
+        };
+    }
+    oscore_context_t *candidates[] = { &server[0], &server[1], &server[2] };
+
+    oscore_msg_native_t msg[2];
+    for (size_t i = 0; i < 2; ++i) {
+        msg[i] = oscore_test_msg_create();
+        returning_assert(build_request(msg[i], &client[i]));
+    }
+
+    oscore_oscoreoption_t header;
+    oscore_msg_protected_t unprotected, unprotected_inplace;
+    oscore_requestid_t request_id, request_id_inplace;
+    size_t matched;
+    uint8_t scratch[64];
+
+    // A scratch buffer that is too small makes all attempts fail
+    returning_assert(find_oscoreoption(msg[0], &header));
+    returning_assert(oscore_unprotect_request_trial(msg[0], &unprotected, &header,
+                candidates, 3, &matched, &request_id, scratch, 3) == OSCORE_UNPROTECT_REQUEST_INVALID);
+
+    // A KID context in the request rules out all contexts without one
+    returning_assert(find_oscoreoption(msg[0], &header));
+    header.kid_context = (const uint8_t *)"ctx";
+    header.kid_context_len = 3;
+    returning_assert(oscore_unprotect_request_trial(msg[0], &unprotected, &header,
+                candidates, 3, &matched, &request_id, scratch, sizeof(scratch)) == OSCORE_UNPROTECT_REQUEST_INVALID);
+
+    returning_assert(find_oscoreoption(msg[0], &header));
+    returning_assert(oscore_unprotect_request_trial(msg[0], &unprotected, &header,
+                candidates, 3, &matched, &request_id, scratch, sizeof(scratch)) == OSCORE_UNPROTECT_REQUEST_OK);
+    returning_assert(matched == 2);
+
+    // The candidate that was tried and failed still has its window
+    returning_assert(server_primitive[1].replay_window_left_edge == 5);
+    returning_assert(server_primitive[1].replay_window == 0x80000000);
+    returning_assert(server_primitive[0].replay_window_left_edge == 5);
+
+    // The plaintext does not depend on the scratch buffer, and is the same
+    // as that from in-place decryption
+    memset(scratch, 0xff, sizeof(scratch));
+    returning_assert(find_oscoreoption(msg[1], &header));
+    returning_assert(oscore_unprotect_request(msg[1], &unprotected_inplace, &header,
+                introduce_error ? &server[1] : &server[3], &request_id_inplace) == OSCORE_UNPROTECT_REQUEST_OK);
+    returning_assert(same_plaintext(&unprotected, &unprotected_inplace));
+
+    // Only the winner's window was updated
+    returning_assert(server_primitive[2].replay_window_left_edge == server_primitive[3].replay_window_left_edge);
+    returning_assert(server_primitive[2].replay_window == server_primitive[3].replay_window);
+
+    oscore_release_unprotected(&unprotected);
+    oscore_release_unprotected(&unprotected_inplace);
+    for (size_t i = 0; i < 2; ++i) {
+        oscore_test_msg_destroy(msg[i]);
+    }
+
+    // A repeated request is recognized by the matching context
+    client_primitive[0].sender_sequence_number = 0;
+    msg[0] = oscore_test_msg_create();
+    returning_assert(build_request(msg[0], &client[0]));
+    returning_assert(find_oscoreoption(msg[0], &header));
+    returning_assert(oscore_unprotect_request_trial(msg[0], &unprotected, &header,
+                candidates, 3, &matched, &request_id, scratch, sizeof(scratch)) == OSCORE_UNPROTECT_REQUEST_DUPLICATE);
+    returning_assert(matched == 2);
+    oscore_test_msg_destroy(msg[0]);
+
+    return 0;
+}
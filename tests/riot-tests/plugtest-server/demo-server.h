@@ -16,11 +16,11 @@
 #define DEMO_SERVER_H
 
 #include <oscore/message.h>
+#include <oscore/blockwise.h>
 #include "persistence.h"
 
 struct sensordata_blockopt {
-    uint32_t num;
-    uint8_t szx;
+    struct oscore_block2_request block;
     uint8_t responsecode;
 };
 
@@ -22,6 +22,9 @@
  * RIOT lacks a generic journaling configuration storage mechanism, actual
  * applications will have their own mechanisms for commissioning and
  * configuration anyway, which can then provide more elaborate persistence.
+ * (For the frequently changing sequence number, @ref
+ * oscore_context_b1_ringlog provides a format that avoids erasing a page on
+ * every write).
  *
  * On native RIOT boards, the behavior of flash memory is emulated by reading
  * from and writing to a `persistence.flash` file, which is discarded when